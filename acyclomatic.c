@@ -8,328 +8,2082 @@
 * Expression should be composed of following characters:
 *   alphabetical low-case characters 'a'-'z',
 *   additive low-priority operations '+' and '-',
-*   multiplicative high-priority operations '*' and '/',
+*   multiplicative high-priority operations '*', '/' and '%',
+*   right-associative power '^' binding tighter than all of them,
+*   unary minus '-' (written as '~' in the postfix form),
 *   round brackets '(' and ')'.
 *
 * Example:
 *   a+(b+c*d)*e+f/g+h   ->   abcd*+e*+fg/+h+
+*   -a^b^c%d            ->   abc^^~d%
+*
+* Usage:
+*   acyclomatic [options] expression   converts a single expression
+*   acyclomatic [options]              converts one expression per line
+*
+* Options:
+*   -f file   read expressions from the file instead of stdin ("-" means stdin)
+*   -e engine conversion engine: recursive (default), trampoline or simd
+*   -j jobs   convert the stream with the given number of threads (default: one per CPU)
+*   -m        map the input file into memory and convert it in place, without copies
+*   -t        tokenizer mode: identifiers and decimal literals, tokens separated by spaces
+*   -p        print the expression tree as (operation operand ...) instead of the postfix form
+*   -d        the same with the identical subexpressions shared, printed once as #N=(...)
+*             and referred to as #N# later
+*   -c size   cache the outputs of repeated expressions in size megabytes (default: 16),
+*             the numbers of hits and misses are reported to stderr
+*   -b        write every expression as a binary record of its opcodes packed in 5 bits
+*             each instead of the postfix form, see acyclomatic.h
+*   -o        simplify the expression: fold x-x, x/x and the constants, cancel the terms
+*             of the chains of + and - and of * and /, add up the rest as balanced trees,
+*             and print the postfix form of the result, e.g. a*(b/b)+c-c -> a; the
+*             operands of % are left as they are, since the remainder is not continuous
+*   -s path   serve the requests of the clients of the Unix socket (default: acyclomatic.sock)
+*             until SIGINT or SIGTERM: a request is the length of the expression as 4 bytes
+*             followed by the expression, the reply is the length of the output and the
+*             status as 4 bytes each followed by the output; the requests of a connection
+*             may be sent without waiting for the replies, which come in the same order
+*   -x        convert every long expression by the threads of -j (default: one per CPU),
+*             each one from a + or - outside the brackets, the lines one after another
+*   --        treat the rest of arguments as an expression
+*             (an argument is an option only if it is '-' and an option letter, so
+*             -e+f or --a are expressions, and -b is given as an expression after --)
+*
+* An expression with an error gives a single line "Error in the expression at offset N: reason"
+* instead of its postfix form, the other expressions are converted as usual. The exit
+* status is 1 if any of the expressions has an error.
 *
 * Copyright 2006-2016 Mikhail Durnev (mdurnev@gmail.com). Released under the GPLv3
 ============================================================================================*/
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <signal.h>
+#include <errno.h>
+
+#include "acyclomatic.h"
 
 
+/* counters of all the contexts, written to stderr at exit with -DACYCLOMATIC_STATS */
+#ifdef ACYCLOMATIC_STATS
+#define STATS_MERGE(into, ctx) add_stats(&(into)->stats, &(ctx)->stats)
+#define STATS_REPORT(ctx) write_stats(&(ctx)->stats, STDERR_FILENO)
+#else
+#define STATS_MERGE(into, ctx) ((void)0)
+#define STATS_REPORT(ctx) ((void)0)
+#endif
+
+/* data types */
+typedef struct OPTIONS OPTIONS;
+typedef struct STREAM STREAM;
+typedef struct POOL POOL;
+typedef struct WORKER WORKER;
+typedef struct MAPPING MAPPING;
+typedef struct SERVER SERVER;
+typedef struct CONNECTION CONNECTION;
+
 /* function prototypes */
-int  check_interval(int value, int low, int high);
-
-void convert(char* str);
-void handle_error(char* str);
-void handle_end(char* str);
-void handle_symbol(char* str);
-void handle_add_sub(char* str);
-void handle_mul_div(char* str);
-void handle_open_bracket(char* str);
-void handle_close_bracket(char* str);
-
-void print_nothing(char c);
-void print_char(char c);
-void print_symbol(char c);
-
-void push(char c, char** stack_top);
-char pop(char** stack_top);
-char pop_mul_div(char** stack_top);
-void pop0(char** stack_top);
+void parse_args(OPTIONS* options, char** argv);
+void parse_end(OPTIONS* options, char** argv);
+void parse_option(OPTIONS* options, char** argv);
+void parse_positional(OPTIONS* options, char** argv);
+void parse_rest(OPTIONS* options, char** argv);
+char** option_file(OPTIONS* options, char** argv);
+char** option_end(OPTIONS* options, char** argv);
+char** option_engine(OPTIONS* options, char** argv);
+char** option_jobs(OPTIONS* options, char** argv);
+char** option_map(OPTIONS* options, char** argv);
+char** option_tokens(OPTIONS* options, char** argv);
+char** option_tree(OPTIONS* options, char** argv);
+char** option_dag(OPTIONS* options, char** argv);
+char** option_cache(OPTIONS* options, char** argv);
+char** option_socket(OPTIONS* options, char** argv);
+char** option_packed(OPTIONS* options, char** argv);
+char** option_simplify(OPTIONS* options, char** argv);
+char** option_split(OPTIONS* options, char** argv);
+void engine_known(void);
+void engine_unknown(void);
+void cache_report(CACHE* cache);
+void cache_silent(CACHE* cache);
+
+void run_single(OPTIONS* options, CONTEXT* ctx, OUTPUT* output);
+void run_stream(OPTIONS* options, CONTEXT* ctx, OUTPUT* output);
+FILE* open_file(char* file_name);
+FILE* open_stdin(char* file_name);
+void stream_lines(STREAM* stream);
+void stream_failed(STREAM* stream);
+int  stream_step(void* arg);
+void stream_line(STREAM* stream, size_t length);
+void stream_nothing(STREAM* stream, size_t length);
+
+void run_parallel(OPTIONS* options, CONTEXT* ctx, OUTPUT* output);
+void pool_start(POOL* pool);
+void pool_failed(POOL* pool);
+void pool_run(POOL* pool);
+int  pool_step(void* arg);
+void pool_read(POOL* pool);
+void pool_map_read(POOL* pool);
+void pool_round(POOL* pool);
+void pool_shift(POOL* pool);
+void pool_advance(POOL* pool);
+void pool_grow(POOL* pool);
+void pool_resize(POOL* pool);
+void pool_nothing(POOL* pool);
+void each_worker(POOL* pool, int index, void (*action)(WORKER* worker));
+void each_worker_rest(POOL* pool, int index, void (*action)(WORKER* worker));
+void each_worker_nothing(POOL* pool, int index, void (*action)(WORKER* worker));
+void worker_init(WORKER* worker);
+void worker_create(WORKER* worker);
+void worker_failed(WORKER* worker);
+void worker_join(WORKER* worker);
+void worker_free(WORKER* worker);
+void worker_split(WORKER* worker);
+void worker_write(WORKER* worker);
+void* worker_main(void* arg);
+int  worker_step(void* arg);
+void worker_round(WORKER* worker);
+void worker_nothing(WORKER* worker);
+void chunk_convert(WORKER* worker);
+int  chunk_step(void* arg);
+
+void run_mapped(OPTIONS* options, CONTEXT* ctx, OUTPUT* output);
+int  open_descriptor(char* file_name);
+int  stdin_descriptor(char* file_name);
+void mapped_lines(MAPPING* mapping, OPTIONS* options);
+void mapped_pool(MAPPING* mapping, OPTIONS* options);
+void mapped_fallback(MAPPING* mapping, OPTIONS* options);
+int  mapped_step(void* arg);
+
+void run_server(OPTIONS* options, CONTEXT* ctx, OUTPUT* output);
+void server_run(SERVER* server);
+void server_failed(SERVER* server);
+void server_stop(int signal_number);
+int  server_step(void* arg);
+void server_events(SERVER* server);
+void server_nothing(SERVER* server);
+int  event_step(void* arg);
+void event_accept(SERVER* server, CONNECTION* connection, uint32_t events);
+void event_connection(SERVER* server, CONNECTION* connection, uint32_t events);
+void accept_connection(SERVER* server, int fd);
+void accept_nothing(SERVER* server, int fd);
+void connection_start(SERVER* server, CONNECTION* connection, int fd);
+void connection_refuse(SERVER* server, CONNECTION* connection, int fd);
+CONNECTION* connection_new(SERVER* server);
+void connection_setup(SERVER* server, CONNECTION* connection);
+void setup_nothing(SERVER* server, CONNECTION* connection);
+CONNECTION* connection_reuse(SERVER* server);
+void connection_read(CONNECTION* connection);
+void connection_send(CONNECTION* connection);
+void connection_nothing(CONNECTION* connection);
+void connection_update(CONNECTION* connection);
+void connection_keep(CONNECTION* connection, uint32_t events);
+void connection_modify(CONNECTION* connection, uint32_t events);
+void connection_close(CONNECTION* connection, uint32_t events);
+int  request_step(void* arg);
+void request_convert(CONNECTION* connection, uint32_t length);
+void request_wait(CONNECTION* connection, uint32_t length);
+void release_connections(SERVER* server);
+int  release_step(void* arg);
+void socket_keep(const char* path);
+void socket_remove(const char* path);
 
 /* data types */
-typedef void (*ACTION)(char* str);
-typedef void (*PRINT_ACTION)(char str);
+typedef void (*ARG_ACTION)(OPTIONS* options, char** argv);
+typedef char** (*OPTION_ACTION)(OPTIONS* options, char** argv);
+typedef void (*CHECK_ACTION)(void);
+typedef void (*RUN_ACTION)(OPTIONS* options, CONTEXT* ctx, OUTPUT* output);
+typedef FILE* (*OPEN_ACTION)(char* file_name);
+typedef void (*STREAM_ACTION)(STREAM* stream);
+typedef void (*LINE_ACTION)(STREAM* stream, size_t length);
+typedef void (*POOL_ACTION)(POOL* pool);
+typedef void (*EACH_ACTION)(POOL* pool, int index, void (*action)(WORKER* worker));
+typedef void (*WORKER_ACTION)(WORKER* worker);
+typedef void (*MAPPED_ACTION)(MAPPING* mapping, OPTIONS* options);
+typedef int (*DESCRIPTOR_ACTION)(char* file_name);
+typedef void (*REPORT_ACTION)(CACHE* cache);
+typedef void (*SERVER_ACTION)(SERVER* server);
+typedef void (*EVENT_ACTION)(SERVER* server, CONNECTION* connection, uint32_t events);
+typedef void (*ACCEPT_ACTION)(SERVER* server, int fd);
+typedef CONNECTION* (*TAKE_ACTION)(SERVER* server);
+typedef void (*START_ACTION)(SERVER* server, CONNECTION* connection, int fd);
+typedef void (*SETUP_ACTION)(SERVER* server, CONNECTION* connection);
+typedef void (*CONNECTION_ACTION)(CONNECTION* connection);
+typedef void (*UPDATE_ACTION)(CONNECTION* connection, uint32_t events);
+typedef void (*REQUEST_ACTION)(CONNECTION* connection, uint32_t length);
+typedef void (*REMOVE_ACTION)(const char* path);
+
+/* command line options */
+struct OPTIONS
+{
+    char* expression;       /* expression given on the command line, or 0 */
+    char* file_name;        /* file to read expressions from in streaming mode */
+    int engine;             /* conversion engine */
+    int jobs;               /* number of threads converting the stream, 0 - no threads */
+    int map;                /* 1 - map the input file into memory */
+    int tokens;             /* 1 - tokenizer mode */
+    int tree;               /* 1 - print the expression tree */
+    int dag;                /* 1 - share the identical subtrees */
+    size_t cache_size;      /* memory of the cache in bytes, 0 - no cache */
+    CACHE* cache;           /* cache of the main thread, it counts all the hits and misses */
+    char* socket_path;      /* Unix socket of the server mode, or 0 */
+    int packed;             /* 1 - write packed records */
+    int simplify;           /* 1 - simplify the expressions */
+    int split;              /* threads converting a long expression, 0 - no split */
+};
+
+/* state of the streaming mode */
+struct STREAM
+{
+    FILE* file;             /* input stream */
+    char* line;             /* line buffer reused for all the lines */
+    size_t capacity;        /* size of the line buffer */
+    CONTEXT* ctx;           /* conversion context reused for all the lines */
+    OUTPUT* output;         /* output of all the lines */
+    CACHE* cache;           /* cache in front of the conversion */
+};
+
+/* pool of worker threads converting the stream by chunks of lines */
+struct POOL
+{
+    FILE* file;             /* input stream, or 0 when the input is mapped */
+    char* buffer;           /* input of the current round, a window of the mapped input */
+    size_t capacity;        /* size of the input buffer */
+    size_t length;          /* number of bytes in the input buffer */
+    size_t complete;        /* number of bytes of complete lines in the buffer */
+    size_t chunk;           /* number of bytes per worker in the current round */
+    const char* split;      /* end of the chunk of the last worker split so far */
+    int eof;                /* 1 when the whole input is read */
+    int stop;               /* 1 when the workers should exit */
+    int count;              /* number of workers */
+    int engine;             /* conversion engine of the workers */
+    int tokens;             /* 1 - tokenizer mode of the workers */
+    int tree;               /* 1 - tree mode of the workers */
+    int dag;                /* 1 - DAG mode of the workers */
+    int packed;             /* 1 - packed mode of the workers */
+    int simplify;           /* 1 - simplify mode of the workers */
+    size_t cache_size;      /* memory of the cache of every worker */
+    CACHE* cache;           /* cache the hits and misses of the workers are added to */
+    int mapped;             /* 1 when the input is mapped into memory */
+    const char* map_end;    /* end of the mapped input */
+    WORKER* workers;
+    OUTPUT* output;         /* output the results are written to in input order */
+    size_t errors;          /* number of expressions with errors in all the chunks */
+    CONTEXT* ctx;           /* context the counters of the workers are added to */
+    pthread_barrier_t start;/* the round begins when all the workers wait here */
+    pthread_barrier_t done; /* the round ends when all the workers wait here */
+};
+
+/* worker thread with its own context and output */
+struct WORKER
+{
+    pthread_t thread;
+    POOL* pool;
+    CONTEXT ctx;            /* operator stack of the worker */
+    OUTPUT output;          /* output of the chunk, written after the round */
+    CACHE cache;            /* cache of the worker */
+    const char* begin;      /* chunk of lines of the current round */
+    const char* end;
+};
+
+/* input file mapped into memory */
+struct MAPPING
+{
+    int fd;                 /* mapped file */
+    char* data;             /* mapped bytes, or MAP_FAILED */
+    size_t size;
+    const char* position;   /* next line to convert */
+    CONTEXT* ctx;
+    OUTPUT* output;
+    CACHE* cache;
+};
+
+/* state of the server mode, connections are served by an epoll event loop */
+struct SERVER
+{
+    int listener;           /* listening socket */
+    int epoll;
+    OPTIONS* options;       /* modes of the contexts and the cache shared by the connections */
+    CONTEXT* ctx;           /* context of the main thread, it counts the errors of all the requests */
+    CONNECTION* free;       /* closed connections, their contexts and buffers are reused */
+    CONNECTION* all;        /* all the connections, open or closed */
+    struct epoll_event* events;     /* events of the last wait */
+    int count;              /* number of events of the last wait */
+    int index;              /* next event to handle */
+};
+
+/* connection of a client with its own context */
+struct CONNECTION
+{
+    SERVER* server;
+    int fd;                 /* socket of the client, -1 when it is closed */
+    CONTEXT ctx;            /* context of the conversions of the client */
+    OUTPUT input;           /* bytes received, the requests are converted as they complete */
+    size_t consumed;        /* bytes of the input converted so far */
+    OUTPUT output;          /* replies not sent yet, in the order of the requests */
+    uint32_t events;        /* events the connection waits for */
+    int closing;            /* 1 when the client has sent everything */
+    int failed;             /* 1 after an error of the socket or a request too big */
+    CONNECTION* next;       /* next free connection */
+    CONNECTION* link;       /* next connection of all */
+};
 
 
 /* function arrays */
 
-/* global call table */
-ACTION call_table[] =
+/* command line argument call table, see parse_args() */
+ARG_ACTION arg_call_table[] =
+{
+    parse_end,
+    parse_option,
+    parse_positional
+};
+
+/* argument call table used after "--" */
+ARG_ACTION rest_call_table[] =
+{
+    parse_rest,
+    parse_end
+};
+
+/* option call table, ordered as OPTION_LETTERS */
+OPTION_ACTION option_call_table[] =
+{
+    option_file,
+    option_end,
+    option_engine,
+    option_jobs,
+    option_map,
+    option_tokens,
+    option_tree,
+    option_cache,
+    option_dag,
+    option_socket,
+    option_packed,
+    option_simplify,
+    option_split
+};
+
+/* engine check call table, indexed by the engine being unknown */
+CHECK_ACTION engine_check_table[] =
+{
+    engine_known,
+    engine_unknown
+};
+
+/* cache report call table, indexed by the cache being enabled */
+REPORT_ACTION report_call_table[] =
+{
+    cache_silent,
+    cache_report
+};
+
+/* run call table, see main() */
+RUN_ACTION run_call_table[] =
+{
+    run_stream,
+    run_parallel,
+    run_single,
+    run_mapped,
+    run_server
+};
+
+/* open call table, indexed by file name being "-" */
+OPEN_ACTION open_call_table[] =
+{
+    open_file,
+    open_stdin
+};
+
+/* stream call table, indexed by failure to open the input */
+STREAM_ACTION stream_call_table[] =
+{
+    stream_lines,
+    stream_failed
+};
+
+/* line call table, indexed by end of the input */
+LINE_ACTION line_call_table[] =
+{
+    stream_line,
+    stream_nothing
+};
+
+/* pool call table, indexed by failure to open the input */
+POOL_ACTION pool_call_table[] =
+{
+    pool_start,
+    pool_failed
+};
+
+/* round call table, indexed by absence of complete lines in the buffer */
+POOL_ACTION round_call_table[] =
+{
+    pool_round,
+    pool_grow
+};
+
+/* input call table, indexed by the input being mapped */
+POOL_ACTION read_call_table[] =
+{
+    pool_read,
+    pool_map_read
+};
+
+/* call table dropping the converted lines, indexed by the input being mapped */
+POOL_ACTION consume_call_table[] =
+{
+    pool_shift,
+    pool_advance
+};
+
+/* call table growing the buffer, indexed by the input being mapped */
+POOL_ACTION resize_call_table[] =
+{
+    pool_resize,
+    pool_nothing
+};
+
+/* descriptor call table, indexed by file name being "-" */
+DESCRIPTOR_ACTION descriptor_call_table[] =
+{
+    open_descriptor,
+    stdin_descriptor
+};
+
+/* mapped input call table, see run_mapped() */
+MAPPED_ACTION mapped_call_table[] =
+{
+    mapped_lines,
+    mapped_pool,
+    mapped_fallback,
+    mapped_fallback
+};
+
+/* worker iteration call table, indexed by having visited all the workers */
+EACH_ACTION each_call_table[] =
+{
+    each_worker_rest,
+    each_worker_nothing
+};
+
+/* worker call table, indexed by the stop flag */
+WORKER_ACTION worker_call_table[] =
+{
+    worker_round,
+    worker_nothing
+};
+
+/* thread call table, indexed by failure to start the worker thread */
+WORKER_ACTION thread_call_table[] =
+{
+    worker_nothing,
+    worker_failed
+};
+
+/* chunk call table, indexed by the chunk being empty */
+WORKER_ACTION chunk_call_table[] =
+{
+    chunk_convert,
+    worker_nothing
+};
+
+/* server call table, indexed by failure to listen on the socket */
+SERVER_ACTION server_call_table[] =
+{
+    server_run,
+    server_failed
+};
+
+/* events call table, indexed by having any events */
+SERVER_ACTION events_call_table[] =
+{
+    server_nothing,
+    server_events
+};
+
+/* event call table, indexed by the event being for the listening socket */
+EVENT_ACTION event_call_table[] =
+{
+    event_connection,
+    event_accept
+};
+
+/* accept call table, indexed by a connection being accepted */
+ACCEPT_ACTION accept_call_table[] =
+{
+    accept_nothing,
+    accept_connection
+};
+
+/* connection call table, indexed by having a closed connection to reuse */
+TAKE_ACTION take_call_table[] =
+{
+    connection_new,
+    connection_reuse
+};
+
+/* connection start call table, indexed by having a connection for the socket */
+START_ACTION start_call_table[] =
+{
+    connection_refuse,
+    connection_start
+};
+
+/* connection setup call table, indexed by the connection being allocated */
+SETUP_ACTION setup_call_table[] =
+{
+    setup_nothing,
+    connection_setup
+};
+
+/* read call table, indexed by the socket being readable */
+CONNECTION_ACTION receive_call_table[] =
+{
+    connection_nothing,
+    connection_read
+};
+
+/* send call table, indexed by having replies to send */
+CONNECTION_ACTION send_call_table[] =
+{
+    connection_nothing,
+    connection_send
+};
+
+/* update call table, indexed by the events changing, or 2 when the connection is done */
+UPDATE_ACTION update_call_table[] =
+{
+    connection_keep,
+    connection_modify,
+    connection_close
+};
+
+/* request call table, indexed by the request being complete */
+REQUEST_ACTION request_call_table[] =
+{
+    request_wait,
+    request_convert
+};
+
+/* release call table, indexed by having any connections */
+SERVER_ACTION release_call_table[] =
 {
-    handle_error,
-    handle_end,
-    handle_symbol,
-    handle_add_sub,
-    handle_mul_div,
-    handle_open_bracket,
-    handle_close_bracket
+    server_nothing,
+    release_connections
 };
 
-/* print call table */
-PRINT_ACTION print_call_table[] =
+/* call table removing the file of the socket, indexed by it being a socket */
+REMOVE_ACTION remove_call_table[] =
 {
-    print_nothing,
-    print_char
+    socket_keep,
+    socket_remove
 };
 
+/* the server is stopped by SIGINT or SIGTERM */
+static volatile sig_atomic_t server_stopped = 0;
+
 
 /* constants */
-#define ASCII_MAX 127
 
-/* following constants are indexes in global call table for corresponding functions */
-#define HANDLE_ERROR 0
-#define HANDLE_END 1
-#define HANDLE_SYMBOL 2
-#define HANDLE_ADD_SUB 3
-#define HANDLE_MUL_DIV 4
-#define HANDLE_OPEN_BRKT 5
-#define HANDLE_CLOSE_BRKT 6
+/* option letters, each one has its handler in option call table */
+#define OPTION_LETTERS "f-ejmtpcdsbox"
+
+/* engine letters, ordered as ENGINE_* constants */
+#define ENGINE_LETTERS "rts"
+
+/* initial size of the line buffer in streaming mode */
+#define LINE_BUFFER_SIZE 256
 
-#define MAX_STACK_DEPTH 64
+/* size of the output buffer, the output is written by blocks of this size */
+#define OUTPUT_BUFFER_SIZE (1 << 20)
 
-/* global variables */
-char* stack_bottom = 0;
-char* stack_top = 0;
+/* size of the cache in megabytes for -c without a size */
+#define CACHE_DEFAULT_SIZE "16"
+
+/* number of input bytes each worker gets per round */
+#define CHUNK_SIZE (1 << 20)
+
+/* socket of the server mode for -s without a path */
+#define SERVER_DEFAULT_PATH "acyclomatic.sock"
+
+/* number of events handled per wait */
+#define SERVER_EVENTS 64
+
+/* bytes read from a connection at once */
+#define SERVER_READ_SIZE (1 << 16)
+
+/* bytes of the header of a request, the length, and of a reply, the length and */
+/* the status, all in the byte order of the CPU                                  */
+#define REQUEST_HEADER 4
+#define REPLY_HEADER 8
+
+/* longest request accepted, a longer one closes the connection */
+#define SERVER_MAX_REQUEST (1u << 30)
+
+/* a connection is not read while it has more replies than this to send */
+#define SERVER_BACKLOG (1 << 22)
 
 /********************************************
 * Program entry point
 ********************************************/
-void main(int argc, char* argv[])
+int  main(int argc, char* argv[])
 {
-    /* get arithmetical expression */
-    char* input_str = argv[argc - 1];
+    OPTIONS options = { 0, "-", ENGINE_RECURSIVE, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int single;
+    int streamed;
+    int index;
+    int status;
+    CONTEXT ctx;
+    OUTPUT output;
+    CACHE cache;
+    char* buffer = malloc(OUTPUT_BUFFER_SIZE);
 
-    /* display the expression */
-    printf("INPUT:  %s\n", input_str);
+    check_allocation(buffer);
 
-    /* prepare display for output */
-    printf("OUTPUT: ");
+    /* collect options and the expression */
+    parse_args(&options, argv + 1);
+
+    /* -x takes the threads of -j, or one per CPU, and the lines are */
+    /* converted one after another                                   */
+    options.split *= options.jobs + (cpus - options.jobs) * (options.jobs == 0);
+    options.jobs *= (options.split == 0);
+
+    /* initialize conversion context and output */
+    init_context(&ctx);
+    ctx.engine = options.engine;
+    ctx.tokens = options.tokens;
+    ctx.tree = options.tree;
+    ctx.dag = options.dag;
+    ctx.packed = options.packed;
+    ctx.simplify = options.simplify;
+    ctx.split = options.split;
+    init_output(&output, buffer, OUTPUT_BUFFER_SIZE, STDOUT_FILENO);
+    init_cache(&cache, options.cache_size);
+    options.cache = &cache;
+
+    /* convert the expression (2), the mapped input (3) or the stream */
+    /* of expressions with threads (1) or without them (0), or serve  */
+    /* the requests of the socket (4)                                 */
+    single = (options.expression != 0);
+    streamed = (single ^ 1) & (options.map ^ 1);
+    index = single * 2 + (single ^ 1) * options.map * 3 + (streamed & (options.jobs > 0));
+    index += (4 - index) * (options.socket_path != 0);
+    run_call_table[index](&options, &ctx, &output);
+
+    /* write out the rest of the output */
+    flush_output(&output);
+
+    /* any expression with an error or a failed write makes the exit status 1 */
+    status = (ctx.errors != 0) | output.failed;
+
+    report_call_table[options.cache_size != 0](&cache);
+    STATS_REPORT(&ctx);
 
-    /* initialize stack */
-    stack_bottom = malloc(MAX_STACK_DEPTH);
-    stack_top = stack_bottom;
-    *stack_top = 0;
+    /* deallocate context, cache and output */
+    free_context(&ctx);
+    free_cache(&cache);
+    free(buffer);
 
-    /* start recursive conversion */
-    convert(input_str);
+    return status;
+}
+
+/********************************************
+* Parses command line arguments recursively
+* Arguments of '-' and a known option letter
+* are options, the last of the other
+* arguments is the expression, so -b or --a
+* are expressions with a unary minus
+********************************************/
+void parse_args(OPTIONS* options, char** argv)
+{
+    /* never look into the terminating null pointer */
+    char* args[2] = { argv[0], "" };
+    int end = (argv[0] == 0);
+    char* arg = args[end];
+    size_t length = strnlen(arg, 3);
+
+    /* find the option letter in the list of known letters, */
+    /* never looking past the end of a shorter argument     */
+    char letter[2] = { arg[length > 1], 0 };
+    int known = (length == 2) & check_interval(arg[0], '-', '-') &
+                check_interval(strcspn(OPTION_LETTERS, letter), 0, sizeof(OPTION_LETTERS) - 2);
 
-    /* deallocate stack */
-    free(stack_bottom);
+    /* 0 - end of arguments, 1 - option, 2 - positional argument */
+    arg_call_table[(end ^ 1) * (2 - known)](options, argv);
 }
 
 /********************************************
-* Recursive conversion routine
+* Stops parsing of arguments
 ********************************************/
-void convert(char* str)
+void parse_end(OPTIONS* options, char** argv)
 {
-    static int call_index; /* it is static to reduce stack usage */
-    call_index = 0;
+}
 
-    /* all the checks below are mutually exclusive */
+/********************************************
+* Handles an option and parses the rest
+********************************************/
+void parse_option(OPTIONS* options, char** argv)
+{
+    char letter[2] = { argv[0][1], 0 };
 
-    /* check for end of string */
-    call_index = check_interval(*str, '\0', '\0') * HANDLE_END;
+    parse_args(options, option_call_table[strcspn(OPTION_LETTERS, letter)](options, argv));
+}
 
-    /* check for symbol a-z */
-    call_index += check_interval(*str, 'a', 'z') * HANDLE_SYMBOL;
+/********************************************
+* Handles the expression argument
+********************************************/
+void parse_positional(OPTIONS* options, char** argv)
+{
+    options->expression = argv[0];
 
-    /* check for arithmetical operations */
-    call_index += check_interval(*str, '+', '+') * HANDLE_ADD_SUB;
-    call_index += check_interval(*str, '-', '-') * HANDLE_ADD_SUB;
-    call_index += check_interval(*str, '*', '*') * HANDLE_MUL_DIV;
-    call_index += check_interval(*str, '/', '/') * HANDLE_MUL_DIV;
+    parse_args(options, ++argv);
+}
 
-    /* check for brackets */
-    call_index += check_interval(*str, '(', '(') * HANDLE_OPEN_BRKT;
-    call_index += check_interval(*str, ')', ')') * HANDLE_CLOSE_BRKT;
+/********************************************
+* Handles arguments after "--", all of them
+* are positional
+********************************************/
+void parse_rest(OPTIONS* options, char** argv)
+{
+    options->expression = argv[0];
 
-    call_table[call_index](str);
+    ++argv;
+    rest_call_table[argv[0] == 0](options, argv);
 }
 
 /********************************************
-* This function returns 1 if:
-*  low <= value <= high
-* Otherwise it returns 0
+* Option -f file
 ********************************************/
-int  check_interval(int value, int low, int high)
+char** option_file(OPTIONS* options, char** argv)
 {
-    /* if value lies between low and high then                          */
-    /* both high - value and value - low are greater than or equal to 0 */
-    /* use | to mix them together                                       */
-    /* then take inverted sign bit as result                            */
-    return ~(((high - value) | (value - low)) >> (sizeof(int) * 8 - 1)) & 1;
+    /* -f without a file name means stdin */
+    int missing = (argv[1] == 0);
+    char* names[2] = { argv[1], "-" };
+
+    options->file_name = names[missing];
+
+    return argv + 2 - missing;
 }
 
 /********************************************
-* This function indicates errors in the
-* input expression
+* Option -- ends the options
 ********************************************/
-void handle_error(char* str)
+char** option_end(OPTIONS* options, char** argv)
 {
-    printf("\nError in the expression\n");
+    static char* no_args[] = { 0 };
+
+    ++argv;
+    rest_call_table[argv[0] == 0](options, argv);
+
+    /* nothing is left to parse */
+    return no_args;
 }
 
 /********************************************
-* This function handles the end of
-* input expression
+* Option -e engine
+* The engine is chosen by its first letter
 ********************************************/
-void handle_end(char* str)
+char** option_engine(OPTIONS* options, char** argv)
 {
-    /* stack may contain only up to 2 operations */
-    /* and we should extract all of them if any  */
-    print_symbol(pop(&stack_top)); /* extract and print *, /, + or - */
-    print_symbol(pop(&stack_top)); /* extract and print + or - */
+    /* -e without an engine name means the default engine */
+    int missing = (argv[1] == 0);
+    char* names[2] = { argv[1], "r" };
+    char letter[2] = { names[missing][0], 0 };
+    size_t index = strcspn(ENGINE_LETTERS, letter);
+
+    engine_check_table[index == sizeof(ENGINE_LETTERS) - 1]();
+
+    options->engine = index;
 
-    printf("\n");
+    return argv + 2 - missing;
 }
 
 /********************************************
-* This function handles a symbol a-z from
-* input expression
+* Option -j jobs
 ********************************************/
-void handle_symbol(char* str)
+char** option_jobs(OPTIONS* options, char** argv)
 {
-    /* display the symbol */
-    printf("%c", *str);
+    /* -j without a number of jobs means one job per CPU */
+    int missing = (argv[1] == 0);
+    char* numbers[2] = { argv[1], "0" };
+    int jobs = atoi(numbers[missing]);
+    int cpus = sysconf(_SC_NPROCESSORS_ONLN);
 
-    convert(++str);
+    /* use the number of CPUs instead of zero or negative numbers */
+    options->jobs = jobs + (cpus - jobs) * (jobs <= 0);
+
+    return argv + 2 - missing;
 }
 
 /********************************************
-* This function handles + or - from
-* input expression
+* Option -m
 ********************************************/
-void handle_add_sub(char* str)
+char** option_map(OPTIONS* options, char** argv)
 {
-    /* stack may contain only up to 2 operations */
-    /* and we should extract all of them if any  */
-    print_symbol(pop(&stack_top)); /* extract and print *, /, + or - */
-    print_symbol(pop(&stack_top)); /* extract and print + or - */
+    options->map = 1;
+
+    return argv + 1;
+}
 
-    /* then we have to push current operation */
-    push(*str, &stack_top);
+/********************************************
+* Option -t
+********************************************/
+char** option_tokens(OPTIONS* options, char** argv)
+{
+    options->tokens = 1;
 
-    convert(++str);
+    return argv + 1;
 }
 
 /********************************************
-* This function handles * or / from
-* input expression
+* Option -p
 ********************************************/
-void handle_mul_div(char* str)
+char** option_tree(OPTIONS* options, char** argv)
 {
-    /* stack may contain only 1 operation or nothing */
-    /* and we should extract it if available         */
-    print_symbol(pop_mul_div(&stack_top)); /* extract and print * or / */
+    options->tree = 1;
+
+    return argv + 1;
+}
 
-    /* then we have to push current operation */
-    push(*str, &stack_top);
+/********************************************
+* Option -d
+********************************************/
+char** option_dag(OPTIONS* options, char** argv)
+{
+    options->tree = 1;
+    options->dag = 1;
 
-    convert(++str);
+    return argv + 1;
 }
 
 /********************************************
-* This function handles open brackets from
-* input expression
+* Option -c size
 ********************************************/
-void handle_open_bracket(char* str)
+char** option_cache(OPTIONS* options, char** argv)
 {
-    /* place delimiter 0 in the stack to separate the bracketed expression */
-    push(0, &stack_top);
+    /* -c without a size means the default size, 0 or less means no cache, */
+    /* the size is there if the next argument starts with a digit          */
+    char* next[2] = { argv[1], "" };
+    int missing = check_interval(next[argv[1] == 0][0], '0', '9') ^ 1;
+    char* sizes[2] = { argv[1], CACHE_DEFAULT_SIZE };
+    long size = atol(sizes[missing]);
+
+    options->cache_size = (size_t)size * (1 << 20) * (size > 0);
 
-    /* convert the bracketed expression separately */
-    convert(++str);
+    return argv + 2 - missing;
 }
 
 /********************************************
-* This function handles close brackets from
-* input expression
+* Option -s path
 ********************************************/
-void handle_close_bracket(char* str)
+char** option_socket(OPTIONS* options, char** argv)
 {
-    /* stack may contain only up to 2 operations */
-    /* and we should extract all of them if any  */
-    print_symbol(pop(&stack_top)); /* extract and print *, /, + or - */
-    print_symbol(pop(&stack_top)); /* extract and print + or - */
+    /* -s without a path means the default socket */
+    int missing = (argv[1] == 0);
+    char* paths[2] = { argv[1], SERVER_DEFAULT_PATH };
 
-    /* remove delimiter */
-    pop0(&stack_top);
+    options->socket_path = paths[missing];
 
-    /* continue convertion */
-    convert(++str);
+    return argv + 2 - missing;
 }
 
 /********************************************
-* Just a dummy function
+* Option -b
+********************************************/
+char** option_packed(OPTIONS* options, char** argv)
+{
+    options->packed = 1;
+
+    return argv + 1;
+}
+
+/********************************************
+* Option -o
+********************************************/
+char** option_simplify(OPTIONS* options, char** argv)
+{
+    options->tree = 1;
+    options->simplify = 1;
+
+    return argv + 1;
+}
+
+/********************************************
+* Option -x
+********************************************/
+char** option_split(OPTIONS* options, char** argv)
+{
+    options->split = 1;
+
+    return argv + 1;
+}
+
+/********************************************
+* Accepts the engine
+********************************************/
+void engine_known(void)
+{
+}
+
+/********************************************
+* Reports an unknown engine and exits
+********************************************/
+void engine_unknown(void)
+{
+    fprintf(stderr, "Unknown engine, use one of: recursive, trampoline, simd\n");
+
+    exit(1);
+}
+
+/********************************************
+* Reports the hits and misses of the cache
+********************************************/
+void cache_report(CACHE* cache)
+{
+    fprintf(stderr, "Cache: %zu hits, %zu misses\n", cache->hits, cache->misses);
+}
+
+/********************************************
+* Reports nothing, there is no cache
+********************************************/
+void cache_silent(CACHE* cache)
+{
+}
+
+/********************************************
+* Converts the single expression given on
+* the command line
+********************************************/
+void run_single(OPTIONS* options, CONTEXT* ctx, OUTPUT* output)
+{
+    /* get arithmetical expression */
+    char* input_str = options->expression;
+    size_t length = strlen(input_str);
+
+    /* display the expression */
+    output_string(output, "INPUT:  ", 8);
+    output_string(output, input_str, length);
+    output_char(output, '\n');
+
+    /* prepare display for output */
+    output_string(output, "OUTPUT: ", 8);
+
+    /* start conversion */
+    convert(ctx, input_str, length, output);
+}
+
+/********************************************
+* Converts expressions from the input file
+* or stdin, one expression per line
+********************************************/
+void run_stream(OPTIONS* options, CONTEXT* ctx, OUTPUT* output)
+{
+    STREAM stream;
+
+    stream.file = open_call_table[strcmp(options->file_name, "-") == 0](options->file_name);
+    stream.capacity = LINE_BUFFER_SIZE;
+    stream.line = malloc(stream.capacity);
+    check_allocation(stream.line);
+    stream.ctx = ctx;
+    stream.output = output;
+    stream.cache = options->cache;
+
+    stream_call_table[stream.file == 0](&stream);
+
+    free(stream.line);
+}
+
+/********************************************
+* Opens the input file
 ********************************************/
-void print_nothing(char c)
+FILE* open_file(char* file_name)
 {
+    return fopen(file_name, "r");
 }
 
 /********************************************
-* Prints the symbol
+* Uses stdin as the input file
 ********************************************/
-void print_char(char c)
+FILE* open_stdin(char* file_name)
 {
-    printf("%c", c);
+    return stdin;
 }
 
 /********************************************
-* Checks and prints the symbol
+* Converts all the lines of the input
 ********************************************/
-void print_symbol(char c)
+void stream_lines(STREAM* stream)
 {
-    int call_index = check_interval(c, 1, ASCII_MAX);
+    iterate(stream_step, stream);
+
+    fclose(stream->file);
+}
 
-    print_call_table[call_index](c);
+/********************************************
+* Reports that the input cannot be opened
+********************************************/
+void stream_failed(STREAM* stream)
+{
+    fprintf(stderr, "Cannot open the input file\n");
 }
 
 /********************************************
-* Pushes data into the stack
+* Reads and converts one line of the input
+* Returns 1 at the end of the input
 ********************************************/
-void push(char c, char** stack_top)
+int  stream_step(void* arg)
 {
-    ++(*stack_top);
-    **stack_top = c;
+    STREAM* stream = arg;
+    ssize_t length = getline(&stream->line, &stream->capacity, stream->file);
+    int eof = (length < 0);
+
+    line_call_table[eof](stream, length);
+
+    return eof;
 }
 
 /********************************************
-* Pops data from the stack
+* Converts a line read from the input
 ********************************************/
-char pop(char** stack_top)
+void stream_line(STREAM* stream, size_t length)
 {
-    char c = **stack_top;
+    /* leave out the line terminator, length is at least 1 here */
+    length -= check_interval(stream->line[length - 1], '\n', '\n');
 
-    /* do not change stack pointer if we are at the bottom, */
-    /* i.e. if we found 0 */
-    *stack_top -= (check_interval(c, 0, 0) ^ 1);
+    convert_cached(stream->cache, stream->ctx, stream->line, length, stream->output);
+}
 
-    return c;
+/********************************************
+* Does nothing at the end of the input
+********************************************/
+void stream_nothing(STREAM* stream, size_t length)
+{
 }
 
 /********************************************
-* Pops * or / only
+* Converts expressions from the input file
+* or stdin, one expression per line, with
+* a pool of worker threads
+* Each round the input is read by big blocks
+* and split into chunks of complete lines,
+* one chunk per worker, and the outputs of
+* the workers are written in input order
 ********************************************/
-char pop_mul_div(char** stack_top)
+void run_parallel(OPTIONS* options, CONTEXT* ctx, OUTPUT* output)
 {
-    int cond = 0;
+    POOL pool;
 
-    char c = **stack_top;
+    pool.file = open_call_table[strcmp(options->file_name, "-") == 0](options->file_name);
+    pool.count = options->jobs;
+    pool.engine = options->engine;
+    pool.tokens = options->tokens;
+    pool.tree = options->tree;
+    pool.dag = options->dag;
+    pool.packed = options->packed;
+    pool.simplify = options->simplify;
+    pool.cache_size = options->cache_size / options->jobs;
+    pool.cache = options->cache;
+    pool.output = output;
+    pool.mapped = 0;
+    pool.errors = 0;
+    pool.ctx = ctx;
 
-    cond = check_interval(c, '*', '*') | check_interval(c, '/', '/');
-    /* cond equals 1 if this is * or / */
-    /* otherwise cond equals 0         */
+    pool_call_table[pool.file == 0](&pool);
+
+    ctx->errors += pool.errors;
+}
 
-    /* validate symbol multiplying it by cond (1 or 0) */
-    c *= cond;
+/********************************************
+* Converts the input read into the buffer
+********************************************/
+void pool_start(POOL* pool)
+{
+    pool->capacity = (size_t)CHUNK_SIZE * pool->count;
+    pool->buffer = malloc(pool->capacity);
+    check_allocation(pool->buffer);
+    pool->length = 0;
 
-    /* use cond also to change stack pointer */
-    *stack_top -= cond;
+    pool_run(pool);
 
-    return c;
+    free(pool->buffer);
+    fclose(pool->file);
+}
+
+/********************************************
+* Starts the workers, converts the input
+* and stops the workers
+********************************************/
+void pool_run(POOL* pool)
+{
+    pool->eof = 0;
+    pool->stop = 0;
+    pool->workers = calloc(pool->count, sizeof(WORKER));
+    check_allocation(pool->workers);
+
+    /* the main thread takes part in both barriers */
+    pthread_barrier_init(&pool->start, 0, pool->count + 1);
+    pthread_barrier_init(&pool->done, 0, pool->count + 1);
+
+    each_worker(pool, 0, worker_init);
+    each_worker(pool, 0, worker_create);
+
+    iterate(pool_step, pool);
+
+    /* let the workers exit */
+    pool->stop = 1;
+    pthread_barrier_wait(&pool->start);
+
+    each_worker(pool, 0, worker_join);
+    each_worker(pool, 0, worker_free);
+
+    pthread_barrier_destroy(&pool->start);
+    pthread_barrier_destroy(&pool->done);
+    free(pool->workers);
+}
+
+/********************************************
+* Reports that the input cannot be opened
+********************************************/
+void pool_failed(POOL* pool)
+{
+    fprintf(stderr, "Cannot open the input file\n");
+}
+
+/********************************************
+* Reads the next block of the input and
+* converts its complete lines
+* Returns 1 when the whole input is done
+********************************************/
+int  pool_step(void* arg)
+{
+    POOL* pool = arg;
+    const char* last_newline;
+    const char* ends[2];
+
+    read_call_table[pool->mapped](pool);
+
+    /* complete lines end at the last line terminator, or at the end of the input */
+    last_newline = memrchr(pool->buffer, '\n', pool->length);
+    ends[0] = last_newline + 1;
+    ends[1] = pool->buffer;
+    pool->complete = (ends[last_newline == 0] - pool->buffer) * (pool->eof ^ 1) +
+                     pool->length * pool->eof;
+
+    /* a line longer than the whole buffer makes the buffer grow */
+    round_call_table[(pool->complete == 0) & (pool->eof ^ 1)](pool);
+
+    return pool->eof & (pool->length == 0);
+}
+
+/********************************************
+* Reads the input after the rest of the last
+* round up to the end of the buffer
+********************************************/
+void pool_read(POOL* pool)
+{
+    pool->length += fread(pool->buffer + pool->length, 1, pool->capacity - pool->length, pool->file);
+    pool->eof = (feof(pool->file) != 0) | (ferror(pool->file) != 0);
+}
+
+/********************************************
+* Takes the next window of the mapped input,
+* nothing is read or copied
+********************************************/
+void pool_map_read(POOL* pool)
+{
+    size_t left = pool->map_end - pool->buffer;
+
+    /* take the minimum of the rest of the input and the buffer size */
+    pool->length = left ^ ((left ^ pool->capacity) & -(size_t)(pool->capacity < left));
+    pool->eof = (pool->length == left);
+}
+
+/********************************************
+* Converts the complete lines by the workers
+* and keeps the rest for the next round
+********************************************/
+void pool_round(POOL* pool)
+{
+    pool->chunk = pool->complete / pool->count;
+    pool->split = pool->buffer;
+    each_worker(pool, 0, worker_split);
+
+    /* let the workers convert their chunks and wait for them */
+    pthread_barrier_wait(&pool->start);
+    pthread_barrier_wait(&pool->done);
+
+    each_worker(pool, 0, worker_write);
+
+    pool->length -= pool->complete;
+    consume_call_table[pool->mapped](pool);
+}
+
+/********************************************
+* Moves the rest of the buffer to its
+* beginning
+********************************************/
+void pool_shift(POOL* pool)
+{
+    memmove(pool->buffer, pool->buffer + pool->complete, pool->length);
+}
+
+/********************************************
+* Moves the window of the mapped input past
+* the converted lines
+********************************************/
+void pool_advance(POOL* pool)
+{
+    pool->buffer += pool->complete;
+}
+
+/********************************************
+* Grows the input buffer twice
+********************************************/
+void pool_grow(POOL* pool)
+{
+    pool->capacity *= 2;
+    resize_call_table[pool->mapped](pool);
+}
+
+/********************************************
+* Reallocates the input buffer
+********************************************/
+void pool_resize(POOL* pool)
+{
+    pool->buffer = realloc(pool->buffer, pool->capacity);
+    check_allocation(pool->buffer);
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+void pool_nothing(POOL* pool)
+{
+}
+
+/********************************************
+* Applies the action to the workers from
+* the index on in their order
+********************************************/
+void each_worker(POOL* pool, int index, void (*action)(WORKER* worker))
+{
+    each_call_table[index == pool->count](pool, index, action);
+}
+
+/********************************************
+* Applies the action to the worker and goes
+* on with the next one
+********************************************/
+void each_worker_rest(POOL* pool, int index, void (*action)(WORKER* worker))
+{
+    pool->workers[index].pool = pool;
+
+    action(pool->workers + index);
+
+    each_worker(pool, index + 1, action);
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+void each_worker_nothing(POOL* pool, int index, void (*action)(WORKER* worker))
+{
+}
+
+/********************************************
+* Initializes context and output of a worker
+********************************************/
+void worker_init(WORKER* worker)
+{
+    init_context(&worker->ctx);
+    worker->ctx.engine = worker->pool->engine;
+    worker->ctx.tokens = worker->pool->tokens;
+    worker->ctx.tree = worker->pool->tree;
+    worker->ctx.dag = worker->pool->dag;
+    worker->ctx.packed = worker->pool->packed;
+    worker->ctx.simplify = worker->pool->simplify;
+    init_cache(&worker->cache, worker->pool->cache_size);
+
+    /* the output of the chunk grows as needed and is written to the pool output */
+    init_memory_output(&worker->output, CHUNK_SIZE);
+    worker->output.fd = worker->pool->output->fd;
+}
+
+/********************************************
+* Starts the worker thread
+********************************************/
+void worker_create(WORKER* worker)
+{
+    /* the barriers count all the workers, the ones started would wait forever */
+    thread_call_table[pthread_create(&worker->thread, 0, worker_main, worker) != 0](worker);
+}
+
+/********************************************
+* Reports that the worker thread cannot be
+* started and exits
+********************************************/
+void worker_failed(WORKER* worker)
+{
+    fprintf(stderr, "Cannot start a thread\n");
+
+    exit(1);
+}
+
+/********************************************
+* Waits for the worker thread to exit
+********************************************/
+void worker_join(WORKER* worker)
+{
+    pthread_join(worker->thread, 0);
+}
+
+/********************************************
+* Deallocates context, output and cache of a
+* worker and counts its errors, hits and
+* misses
+********************************************/
+void worker_free(WORKER* worker)
+{
+    worker->pool->errors += worker->ctx.errors;
+    worker->pool->cache->hits += worker->cache.hits;
+    worker->pool->cache->misses += worker->cache.misses;
+    STATS_MERGE(worker->pool->ctx, &worker->ctx);
+
+    free_context(&worker->ctx);
+    free_cache(&worker->cache);
+    free_memory_output(&worker->output);
+}
+
+/********************************************
+* Gives the worker its chunk of lines
+* The chunk ends at the first line terminator
+* after the chunk size, the last worker takes
+* all the rest of complete lines
+********************************************/
+void worker_split(WORKER* worker)
+{
+    POOL* pool = worker->pool;
+    const char* limit = pool->buffer + pool->complete;
+    size_t left = limit - pool->split;
+
+    /* take the minimum of chunk size and the rest of complete lines */
+    size_t size = left ^ ((left ^ pool->chunk) & -(size_t)(pool->chunk < left));
+
+    const char* newline = memchr(pool->split + size, '\n', left - size);
+    const char* ends[2] = { newline + 1, limit };
+    int last = (worker == pool->workers + pool->count - 1);
+
+    worker->begin = pool->split;
+    worker->end = ends[(newline == 0) | last];
+
+    pool->split = worker->end;
+}
+
+/********************************************
+* Writes the output of the worker's chunk,
+* a failed write fails the pool output and
+* drops the chunks after it
+********************************************/
+void worker_write(WORKER* worker)
+{
+    worker->output.failed |= worker->pool->output->failed;
+    flush_output(&worker->output);
+
+    worker->pool->output->failed |= worker->output.failed;
+}
+
+/********************************************
+* Worker thread, converts a chunk each round
+* until the pool stops
+********************************************/
+void* worker_main(void* arg)
+{
+    iterate(worker_step, arg);
+
+    return 0;
+}
+
+/********************************************
+* Waits for the next round and converts the
+* chunk of lines
+* Returns 1 when the pool stops
+********************************************/
+int  worker_step(void* arg)
+{
+    WORKER* worker = arg;
+    int stop;
+
+    pthread_barrier_wait(&worker->pool->start);
+
+    stop = worker->pool->stop;
+    worker_call_table[stop](worker);
+
+    return stop;
+}
+
+/********************************************
+* Converts the chunk and tells the pool
+* the round is done
+********************************************/
+void worker_round(WORKER* worker)
+{
+    chunk_call_table[worker->begin == worker->end](worker);
+
+    pthread_barrier_wait(&worker->pool->done);
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+void worker_nothing(WORKER* worker)
+{
+}
+
+/********************************************
+* Converts all the lines of the chunk
+********************************************/
+void chunk_convert(WORKER* worker)
+{
+    iterate(chunk_step, worker);
+}
+
+/********************************************
+* Converts the next line of the chunk
+* Returns 1 at the end of the chunk
+********************************************/
+int  chunk_step(void* arg)
+{
+    WORKER* worker = arg;
+    const char* newline = memchr(worker->begin, '\n', worker->end - worker->begin);
+
+    /* the last line at the end of the input may have no terminator */
+    const char* ends[2] = { newline, worker->end };
+    const char* line_end = ends[newline == 0];
+
+    convert_cached(&worker->cache, &worker->ctx, worker->begin, line_end - worker->begin, &worker->output);
+
+    worker->begin = line_end + 1;
+
+    return worker->begin >= worker->end;
+}
+
+/********************************************
+* Converts expressions from the input file
+* mapped into memory, one expression per
+* line, by this thread or by the pool
+* The input that cannot be mapped (a pipe,
+* an empty file) is read as a stream
+********************************************/
+void run_mapped(OPTIONS* options, CONTEXT* ctx, OUTPUT* output)
+{
+    MAPPING mapping;
+    struct stat status;
+
+    mapping.fd = descriptor_call_table[strcmp(options->file_name, "-") == 0](options->file_name);
+    mapping.ctx = ctx;
+    mapping.output = output;
+    mapping.cache = options->cache;
+
+    /* a failed fstat() leaves the size 0, the mapping fails then */
+    memset(&status, 0, sizeof(status));
+    fstat(mapping.fd, &status);
+    mapping.size = status.st_size;
+    mapping.data = mmap(0, mapping.size, PROT_READ, MAP_PRIVATE, mapping.fd, 0);
+
+    /* 0 - by this thread, 1 - by the pool, 2 and 3 - as a stream */
+    mapped_call_table[(mapping.data == MAP_FAILED) * 2 + (options->jobs > 0)](&mapping, options);
+
+    close(mapping.fd);
+}
+
+/********************************************
+* Opens the input file for mapping
+********************************************/
+int  open_descriptor(char* file_name)
+{
+    return open(file_name, O_RDONLY);
+}
+
+/********************************************
+* Uses stdin as the input file for mapping
+********************************************/
+int  stdin_descriptor(char* file_name)
+{
+    return STDIN_FILENO;
+}
+
+/********************************************
+* Converts all the lines of the mapped input
+********************************************/
+void mapped_lines(MAPPING* mapping, OPTIONS* options)
+{
+    madvise(mapping->data, mapping->size, MADV_SEQUENTIAL);
+
+    mapping->position = mapping->data;
+    iterate(mapped_step, mapping);
+
+    munmap(mapping->data, mapping->size);
+}
+
+/********************************************
+* Converts all the lines of the mapped input
+* with the pool of worker threads, the chunks
+* of the workers point into the mapping
+********************************************/
+void mapped_pool(MAPPING* mapping, OPTIONS* options)
+{
+    POOL pool;
+
+    madvise(mapping->data, mapping->size, MADV_SEQUENTIAL);
+
+    pool.file = 0;
+    pool.count = options->jobs;
+    pool.engine = options->engine;
+    pool.tokens = options->tokens;
+    pool.tree = options->tree;
+    pool.dag = options->dag;
+    pool.packed = options->packed;
+    pool.simplify = options->simplify;
+    pool.cache_size = options->cache_size / options->jobs;
+    pool.cache = options->cache;
+    pool.output = mapping->output;
+    pool.mapped = 1;
+    pool.buffer = mapping->data;
+    pool.map_end = mapping->data + mapping->size;
+    pool.capacity = (size_t)CHUNK_SIZE * pool.count;
+    pool.length = 0;
+    pool.errors = 0;
+    pool.ctx = mapping->ctx;
+
+    pool_run(&pool);
+
+    mapping->ctx->errors += pool.errors;
+
+    munmap(mapping->data, mapping->size);
+}
+
+/********************************************
+* Reads the input that cannot be mapped as
+* a stream, with threads or without them
+********************************************/
+void mapped_fallback(MAPPING* mapping, OPTIONS* options)
+{
+    run_call_table[options->jobs > 0](options, mapping->ctx, mapping->output);
+}
+
+/********************************************
+* Converts the next line of the mapped input
+* Returns 1 at the end of the input
+********************************************/
+int  mapped_step(void* arg)
+{
+    MAPPING* mapping = arg;
+    const char* end = mapping->data + mapping->size;
+    const char* newline = memchr(mapping->position, '\n', end - mapping->position);
+
+    /* the last line may have no terminator, the conversion never reads past its end */
+    const char* ends[2] = { newline, end };
+    const char* line_end = ends[newline == 0];
+
+    convert_cached(mapping->cache, mapping->ctx, mapping->position, line_end - mapping->position,
+                   mapping->output);
+
+    mapping->position = line_end + 1;
+
+    return mapping->position >= end;
+}
+
+/********************************************
+* Serves the requests of the clients of the
+* Unix socket until SIGINT or SIGTERM
+* Every connection has its own context, the
+* contexts of the closed connections are
+* reused by the new ones
+********************************************/
+void run_server(OPTIONS* options, CONTEXT* ctx, OUTPUT* output)
+{
+    SERVER server;
+    struct sockaddr_un address;
+    struct stat status;
+    struct epoll_event events[SERVER_EVENTS];
+    struct epoll_event listening;
+    size_t length = strlen(options->socket_path);
+    int fits = (length < sizeof(address.sun_path));
+    int failed;
+
+    /* a path too long for the address gives an empty address, binding to it fails */
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, options->socket_path, length * fits);
+
+    /* the socket left by a server that is gone is removed, any other file is kept */
+    memset(&status, 0, sizeof(status));
+    stat(options->socket_path, &status);
+    remove_call_table[S_ISSOCK(status.st_mode) != 0](options->socket_path);
+
+    server.listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    server.epoll = epoll_create1(EPOLL_CLOEXEC);
+    server.options = options;
+    server.ctx = ctx;
+    server.free = 0;
+    server.all = 0;
+    server.events = events;
+
+    /* the events of the listening socket have no connection */
+    listening.events = EPOLLIN;
+    listening.data.ptr = 0;
+
+    failed = (bind(server.listener, (struct sockaddr*)&address, sizeof(address) * fits) != 0);
+    failed |= (listen(server.listener, SOMAXCONN) != 0);
+    failed |= (epoll_ctl(server.epoll, EPOLL_CTL_ADD, server.listener, &listening) != 0);
+
+    server_call_table[failed](&server);
+
+    close(server.epoll);
+    close(server.listener);
+}
+
+/********************************************
+* Handles the events until the server is
+* stopped, then closes the connections and
+* removes the socket
+********************************************/
+void server_run(SERVER* server)
+{
+    struct sigaction action;
+
+    /* no SA_RESTART, so a signal wakes up epoll_wait() */
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = server_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, 0);
+    sigaction(SIGTERM, &action, 0);
+
+    iterate(server_step, server);
+
+    release_call_table[server->all != 0](server);
+    unlink(server->options->socket_path);
+}
+
+/********************************************
+* Reports that the socket cannot be listened
+* on, the exit status is 1
+********************************************/
+void server_failed(SERVER* server)
+{
+    fprintf(stderr, "Cannot listen on the socket %s\n", server->options->socket_path);
+
+    ++server->ctx->errors;
+}
+
+/********************************************
+* Stops the server, the signal handler
+********************************************/
+void server_stop(int signal_number)
+{
+    server_stopped = 1;
+}
+
+/********************************************
+* Waits for events and handles them
+* Returns 1 when the server is stopped or
+* the wait fails
+********************************************/
+int  server_step(void* arg)
+{
+    SERVER* server = arg;
+
+    server->count = epoll_wait(server->epoll, server->events, SERVER_EVENTS, -1);
+
+    events_call_table[server->count > 0](server);
+
+    return server_stopped | ((server->count < 0) & (errno != EINTR));
+}
+
+/********************************************
+* Handles all the events of the last wait
+********************************************/
+void server_events(SERVER* server)
+{
+    server->index = 0;
+
+    iterate(event_step, server);
+}
+
+/********************************************
+* Does nothing, there are no events or no
+* connections
+********************************************/
+void server_nothing(SERVER* server)
+{
+}
+
+/********************************************
+* Handles the next event
+* Returns 1 after the last event
+********************************************/
+int  event_step(void* arg)
+{
+    SERVER* server = arg;
+    struct epoll_event* event = &server->events[server->index];
+
+    event_call_table[event->data.ptr == 0](server, event->data.ptr, event->events);
+    ++server->index;
+
+    return server->index >= server->count;
+}
+
+/********************************************
+* Accepts a connection, the rest of them are
+* accepted on the next events
+********************************************/
+void event_accept(SERVER* server, CONNECTION* connection, uint32_t events)
+{
+    int fd = accept4(server->listener, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    accept_call_table[fd >= 0](server, fd);
+}
+
+/********************************************
+* Converts the requests received and sends
+* the replies that can be sent now
+********************************************/
+void event_connection(SERVER* server, CONNECTION* connection, uint32_t events)
+{
+    /* a hang-up or an error is found by reading */
+    receive_call_table[(events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0](connection);
+
+    /* the replies are sent at once, the output event only comes when the socket was full */
+    send_call_table[connection->output.length != 0](connection);
+
+    connection_update(connection);
+}
+
+/********************************************
+* Starts serving the accepted connection
+********************************************/
+void accept_connection(SERVER* server, int fd)
+{
+    CONNECTION* connection = take_call_table[server->free != 0](server);
+
+    start_call_table[connection != 0](server, connection, fd);
+}
+
+/********************************************
+* Starts serving the socket accepted with
+* the connection
+********************************************/
+void connection_start(SERVER* server, CONNECTION* connection, int fd)
+{
+    struct epoll_event event;
+
+    connection->fd = fd;
+    connection->input.length = 0;
+    connection->consumed = 0;
+    connection->output.length = 0;
+    connection->output.mark = 0;
+    connection->events = EPOLLIN;
+    connection->closing = 0;
+
+    event.events = EPOLLIN;
+    event.data.ptr = connection;
+
+    /* a connection that cannot be waited for is closed at once */
+    connection->failed = (epoll_ctl(server->epoll, EPOLL_CTL_ADD, fd, &event) != 0);
+
+    connection_update(connection);
+}
+
+/********************************************
+* Does nothing, no connection is accepted
+********************************************/
+void accept_nothing(SERVER* server, int fd)
+{
+}
+
+/********************************************
+* Closes the socket accepted, there is no
+* memory for its connection, the others are
+* served as usual
+********************************************/
+void connection_refuse(SERVER* server, CONNECTION* connection, int fd)
+{
+    fprintf(stderr, "Not enough memory for a connection\n");
+
+    close(fd);
+}
+
+/********************************************
+* Allocates a connection with its context
+* and buffers
+* Returns the connection, or 0 if it cannot
+* be allocated
+********************************************/
+CONNECTION* connection_new(SERVER* server)
+{
+    CONNECTION* connection = malloc(sizeof(CONNECTION));
+
+    setup_call_table[connection != 0](server, connection);
+
+    return connection;
+}
+
+/********************************************
+* Sets up the connection just allocated
+********************************************/
+void connection_setup(SERVER* server, CONNECTION* connection)
+{
+    connection->server = server;
+
+    init_context(&connection->ctx);
+    connection->ctx.engine = server->options->engine;
+    connection->ctx.tokens = server->options->tokens;
+    connection->ctx.tree = server->options->tree;
+    connection->ctx.dag = server->options->dag;
+    connection->ctx.packed = server->options->packed;
+    connection->ctx.simplify = server->options->simplify;
+    connection->ctx.split = server->options->split;
+
+    init_memory_output(&connection->input, SERVER_READ_SIZE);
+    init_memory_output(&connection->output, SERVER_READ_SIZE);
+
+    connection->link = server->all;
+    server->all = connection;
+}
+
+/********************************************
+* Sets up nothing, no connection is allocated
+********************************************/
+void setup_nothing(SERVER* server, CONNECTION* connection)
+{
+}
+
+/********************************************
+* Takes a closed connection, its context and
+* buffers are reused
+********************************************/
+CONNECTION* connection_reuse(SERVER* server)
+{
+    CONNECTION* connection = server->free;
+
+    server->free = connection->next;
+
+    return connection;
+}
+
+/********************************************
+* Reads what the client has sent and
+* converts the requests that are complete
+********************************************/
+void connection_read(CONNECTION* connection)
+{
+    char buffer[SERVER_READ_SIZE];
+    ssize_t length = read(connection->fd, buffer, sizeof(buffer));
+    int again = (length < 0) & ((errno == EAGAIN) | (errno == EINTR));
+    OUTPUT* input = &connection->input;
+
+    output_string(input, buffer, length * (length > 0));
+
+    connection->closing |= (length == 0);
+    connection->failed |= (length < 0) & (again ^ 1);
+
+    iterate(request_step, connection);
+
+    /* the rest of an incomplete request goes to the beginning */
+    memmove(input->buffer, input->buffer + connection->consumed, input->length - connection->consumed);
+    input->length -= connection->consumed;
+    connection->consumed = 0;
+}
+
+/********************************************
+* Sends as many replies as the socket takes
+********************************************/
+void connection_send(CONNECTION* connection)
+{
+    OUTPUT* output = &connection->output;
+    ssize_t length = send(connection->fd, output->buffer, output->length, MSG_NOSIGNAL);
+    int again = (length < 0) & ((errno == EAGAIN) | (errno == EINTR));
+    size_t sent = length * (length > 0);
+
+    connection->failed |= (length < 0) & (again ^ 1);
+
+    memmove(output->buffer, output->buffer + sent, output->length - sent);
+    output->length -= sent;
+}
+
+/********************************************
+* Does nothing, there is nothing to read or
+* to send
+********************************************/
+void connection_nothing(CONNECTION* connection)
+{
+}
+
+/********************************************
+* Waits for the events the connection needs
+* now, or closes it when it is done
+* The connection is not read while it has
+* too many replies to send, so a client that
+* does not read them cannot take all the
+* memory
+********************************************/
+void connection_update(CONNECTION* connection)
+{
+    size_t pending = connection->output.length;
+    int open = (connection->closing | connection->failed) ^ 1;
+    uint32_t events = (EPOLLIN * (open & (pending < SERVER_BACKLOG))) |
+                      (EPOLLOUT * ((pending != 0) & (connection->failed ^ 1)));
+    int finished = connection->failed | (connection->closing & (pending == 0));
+    int changed = (events != connection->events);
+
+    /* 0 - the same events, 1 - other events, 2 - closed */
+    update_call_table[changed + (2 - changed) * finished](connection, events);
+}
+
+/********************************************
+* Keeps waiting for the same events
+********************************************/
+void connection_keep(CONNECTION* connection, uint32_t events)
+{
+}
+
+/********************************************
+* Waits for other events
+********************************************/
+void connection_modify(CONNECTION* connection, uint32_t events)
+{
+    struct epoll_event event;
+
+    event.events = events;
+    event.data.ptr = connection;
+
+    epoll_ctl(connection->server->epoll, EPOLL_CTL_MOD, connection->fd, &event);
+    connection->events = events;
+}
+
+/********************************************
+* Closes the connection, it is kept to be
+* reused
+********************************************/
+void connection_close(CONNECTION* connection, uint32_t events)
+{
+    SERVER* server = connection->server;
+
+    close(connection->fd);
+    connection->fd = -1;
+
+    connection->next = server->free;
+    server->free = connection;
+}
+
+/********************************************
+* Converts the next request if it is complete
+* A request too long closes the connection
+* Returns 1 when no complete request is left
+********************************************/
+int  request_step(void* arg)
+{
+    CONNECTION* connection = arg;
+    size_t left = connection->input.length - connection->consumed;
+    int header = (left >= REQUEST_HEADER);
+    uint32_t length = 0;
+    int complete;
+
+    memcpy(&length, connection->input.buffer + connection->consumed, REQUEST_HEADER * header);
+
+    connection->failed |= (length > SERVER_MAX_REQUEST);
+    complete = header & (length <= left - REQUEST_HEADER) & (connection->failed ^ 1);
+
+    request_call_table[complete](connection, length);
+
+    return complete ^ 1;
+}
+
+/********************************************
+* Converts the request into a reply after
+* the ones not sent yet
+********************************************/
+void request_convert(CONNECTION* connection, uint32_t length)
+{
+    OUTPUT* output = &connection->output;
+    size_t start = output->length;
+    uint32_t reply[2] = { 0, 0 };
+    const char* expression = connection->input.buffer + connection->consumed + REQUEST_HEADER;
+
+    /* the header is filled in when the length of the output is known, the output */
+    /* of an expression with an error is replaced from after the header           */
+    output_string(output, (const char*)reply, REPLY_HEADER);
+
+    reply[1] = convert_cached(connection->server->options->cache, &connection->ctx, expression, length, output);
+    reply[0] = output->length - start - REPLY_HEADER;
+
+    memcpy(output->buffer + start, reply, REPLY_HEADER);
+
+    connection->consumed += REQUEST_HEADER + length;
+}
+
+/********************************************
+* Does nothing, the request is not complete
+********************************************/
+void request_wait(CONNECTION* connection, uint32_t length)
+{
+}
+
+/********************************************
+* Closes and deallocates all the connections
+* and counts their errors
+********************************************/
+void release_connections(SERVER* server)
+{
+    iterate(release_step, server);
+}
+
+/********************************************
+* Closes and deallocates the next connection
+* Returns 1 after the last connection
+********************************************/
+int  release_step(void* arg)
+{
+    SERVER* server = arg;
+    CONNECTION* connection = server->all;
+
+    server->all = connection->link;
+
+    /* the closed connections have no descriptor, close() of -1 does nothing */
+    close(connection->fd);
+
+    server->ctx->errors += connection->ctx.errors;
+    STATS_MERGE(server->ctx, &connection->ctx);
+
+    free_context(&connection->ctx);
+    free_memory_output(&connection->input);
+    free_memory_output(&connection->output);
+    free(connection);
+
+    return server->all == 0;
+}
+
+/********************************************
+* Keeps the file, it is not a socket
+********************************************/
+void socket_keep(const char* path)
+{
 }
 
 /********************************************
-* Pops 0 from the stack
-* to go below the bottom
+* Removes the socket left by another server
 ********************************************/
-void pop0(char** stack_top)
+void socket_remove(const char* path)
 {
-    *stack_top -= check_interval(**stack_top, 0, 0);
+    unlink(path);
 }
@@ -0,0 +1,451 @@
+/*============================================================================================
+* libacyclomatic - conversion of arithmetical expressions into the postfix form
+*
+* All the state of a conversion is kept in a conversion context, so any number of
+* conversions can run concurrently as long as each of them uses its own context and
+* its own output.
+*
+* Example:
+*   CONTEXT ctx;
+*   OUTPUT out;
+*
+*   init_context(&ctx);
+*   init_output(&out, buffer, sizeof(buffer), STDOUT_FILENO);
+*   convert(&ctx, "a+b*c", 5, &out);
+*   flush_output(&out);
+*   free_context(&ctx);
+*
+* Copyright 2006-2016 Mikhail Durnev (mdurnev@gmail.com). Released under the GPLv3
+============================================================================================*/
+#ifndef ACYCLOMATIC_H
+#define ACYCLOMATIC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* counters, see STATS */
+#define STATS_HANDLERS 9            /* entries of the global call table and the finished step */
+#define STATS_BUCKETS 32            /* the last one counts all the longer conversions */
+
+/* data types */
+typedef struct OUTPUT OUTPUT;
+typedef struct CONTEXT CONTEXT;
+typedef struct PROGRAM PROGRAM;
+typedef struct NODE NODE;
+typedef struct CACHE CACHE;
+typedef struct CACHE_SET CACHE_SET;
+typedef struct NATIVE NATIVE;
+typedef struct NATIVE_CACHE NATIVE_CACHE;
+typedef struct NATIVE_ENTRY NATIVE_ENTRY;
+typedef struct STATS STATS;
+typedef struct CHECKPOINT CHECKPOINT;
+typedef struct INCREMENTAL INCREMENTAL;
+
+/* output sink collecting the output in a caller-owned buffer */
+struct OUTPUT
+{
+    char* buffer;           /* output buffer */
+    size_t size;            /* size of the output buffer */
+    size_t length;          /* number of bytes collected in the buffer */
+    int fd;                 /* file descriptor the buffer is flushed to */
+    void (*full)(OUTPUT* output); /* called when the buffer gets full */
+    size_t mark;            /* length of the buffer before the current conversion */
+    int failed;             /* 1 once a write to the file descriptor has failed */
+};
+
+#ifdef ACYCLOMATIC_STATS
+/* counters of the conversions of a context, built with -DACYCLOMATIC_STATS only; */
+/* the fields from handlers to histogram are added up by add_stats()             */
+struct STATS
+{
+    uint64_t handlers[STATS_HANDLERS];  /* calls by index in the global call table, the */
+                                        /* last one counts the steps after the end      */
+    uint64_t prints[2];                 /* pops of print_nothing() and print_char() */
+    uint64_t expressions;               /* number of conversions */
+    uint64_t cycles;                    /* clock ticks of all the conversions */
+    uint64_t histogram[STATS_BUCKETS];  /* conversions by log2 of their ticks */
+    uint64_t max_cycles;                /* ticks of the longest conversion */
+    uint64_t max_stack;                 /* largest stack_top - stack_bottom reached */
+    uint64_t start;                     /* clock at the start of the current conversion */
+};
+#endif
+
+/* conversion context */
+struct CONTEXT
+{
+    char* stack_bottom;     /* operator stack */
+    char* stack_top;
+    size_t stack_size;
+    OUTPUT* output;         /* output of the current conversion */
+    const char* end;        /* end of the current expression */
+    const char* cursor;     /* current position of the trampoline */
+    int finished;           /* 1 when the end or an error is reached */
+    int status;             /* status of the last conversion */
+    int engine;             /* conversion engine */
+    const char* begin;      /* beginning of the current expression */
+    const char* (*step)(CONTEXT* ctx, const char* str); /* step of the trampoline at the */
+                            /* position, returns the next one                          */
+    unsigned char* classes; /* classes of the input found by the SIMD prepass */
+    size_t classes_size;
+    uint64_t* symbols;      /* bit N set for a symbol a-z at symbols_from + N, or for a */
+    const char* symbols_from; /* byte of an identifier in the tokenizer mode; the same */
+                            /* buffer as the classes                                   */
+    size_t error_offset;    /* offset of the error in the last expression */
+    size_t errors;          /* number of expressions with errors so far */
+    size_t depth;           /* depth of brackets at the current position */
+    size_t open_offset;     /* offset of the outermost bracket that is open */
+    int imbalance;          /* status of the brackets at the current position */
+    int tokens;             /* 1 - tokenizer mode, see below */
+    int operand;            /* 1 after an operand or ')', so '-' is binary */
+    int emitted;            /* 1 once a token of the current expression is emitted */
+    void (*emit)(CONTEXT* ctx, const char* token, size_t length); /* emits a token, or 0 */
+    void (*emitter)(CONTEXT* ctx, const char* token, size_t length); /* chosen by convert() */
+    void (*char_emitter)(CONTEXT* ctx, const char* c); /* the same for single characters */
+    void (*checkpoint)(CONTEXT* ctx, const CHECKPOINT* at); /* called at every bracket, or 0 */
+    int tree;               /* 1 - tree mode, see below */
+    NODE* root;             /* tree of the last expression, or 0 */
+    NODE* nodes;            /* node arena, reused for every expression */
+    size_t nodes_size;
+    NODE* node_next;        /* next free node of the arena */
+    NODE* tree_top;         /* last subtree built, linked to the ones before it */
+    const NODE** pending;   /* nodes pending to print */
+    int dag;                /* 1 - identical subtrees are shared, see below */
+    NODE** shared;          /* hash table of the distinct subtrees, 0 - vacant */
+    size_t shared_mask;     /* size of the part of the table in use - 1 */
+    size_t slots;           /* number of subtrees used more than once */
+    size_t* labels;         /* labels of the shared subtrees printed so far */
+    int packed;             /* 1 - packed mode, see below */
+    int packing;            /* 1 when the conversion writes a packed record */
+    uint64_t bits;          /* codes of the record not written yet, from bit 0 on */
+    unsigned bit_count;     /* number of bits in bits */
+    int simplify;           /* 1 - simplify mode, see below */
+    NODE** terms;           /* terms of the chain being simplified and its operations */
+    int split;              /* threads converting a long expression, see convert_split() */
+#ifdef ACYCLOMATIC_STATS
+    STATS stats;            /* counters of all the conversions of the context */
+#endif
+};
+
+/* node of the expression tree */
+struct NODE
+{
+    const char* token;      /* operand in the input, or the operation */
+    size_t length;          /* length of the token, 0 for a missing operand */
+    NODE* left;             /* operands of an operation, the unary minus */
+    NODE* right;            /* has the left one only                     */
+    NODE* next;             /* subtree built before this one */
+    int arity;              /* number of operands, 0 for an operand */
+    char operation;         /* operation, 0 for an operand */
+    NODE* same;             /* first node built identical to this one, or itself */
+    size_t uses;            /* number of operations using the node, in the DAG mode */
+    size_t slot;            /* 1-based slot of an operation used more than once, or 0 */
+    NODE* simple;           /* the subtree simplified, in the simplify mode */
+    int inner;              /* 1 - an operand of a chain of + and - or of * and / used */
+                            /* by the chain only, it is simplified with the chain     */
+    int sign;               /* the sign of an inner operand in its chain */
+    long weight;            /* times the subtree is added (or multiplied) in the chain */
+                            /* simplified, less the times it is subtracted (divided)  */
+};
+
+/* postfix form compiled for evaluation, one opcode per token */
+struct PROGRAM
+{
+    unsigned char* code;    /* opcodes, the last one is OPCODE_END */
+    size_t length;          /* number of opcodes */
+    size_t capacity;        /* size of the code buffer */
+    size_t depth;           /* maximal depth of the evaluation stack */
+    size_t slots;           /* number of values saved for reuse */
+};
+
+
+/* program compiled into native code, see compile_native() */
+struct NATIVE
+{
+    unsigned char* code;    /* executable memory, or 0 when the program is interpreted */
+    size_t size;            /* size of the executable memory */
+    double (*function)(const double* bindings); /* the native code, or 0 */
+    const PROGRAM* program; /* program interpreted without native code */
+};
+
+/* cache of the native code of expressions, see native_cached() */
+struct NATIVE_CACHE
+{
+    NATIVE_ENTRY* entries;  /* compiled expressions by their hashes */
+    size_t mask;            /* number of entries - 1, a power of 2 - 1 */
+    CONTEXT ctx;            /* context converting the expressions */
+    OUTPUT output;          /* output of the conversions, not used */
+    size_t hits;            /* number of expressions found compiled */
+    size_t misses;          /* number of expressions compiled */
+};
+
+/* state of a conversion before a bracket, see convert_resume() */
+struct CHECKPOINT
+{
+    size_t offset;          /* offset of the bracket in the expression */
+    size_t output_length;   /* length of the output of the expression before the bracket */
+    const char* stack;      /* operations in the stack above the bottom */
+    size_t stack_length;
+    size_t depth;           /* depth of brackets */
+    size_t open_offset;     /* offset of the outermost open bracket */
+    int operand;            /* 1 after an operand or ')' */
+    int emitted;            /* 1 once a token is emitted */
+};
+
+/* conversions of the versions of an edited expression, see convert_incremental() */
+struct INCREMENTAL
+{
+    CONTEXT ctx;            /* context of the conversions, its hook keeps the checkpoints */
+    OUTPUT expression;      /* the last expression */
+    OUTPUT postfix;         /* output of the last expression */
+    OUTPUT marks;           /* checkpoints of the last expression by offsets, the first */
+                            /* one is the beginning                                     */
+    OUTPUT stacks;          /* operations in the stacks of the checkpoints */
+    size_t kept;            /* bytes of the output of the expression before it that are kept */
+    size_t resumed;         /* offset the last conversion resumed at */
+};
+
+/* cache of the outputs of repeated expressions, see convert_cached() */
+struct CACHE
+{
+    void* memory;           /* memory of the sets */
+    CACHE_SET* sets;        /* sets of entries, aligned to cache lines */
+    size_t set_count;       /* number of sets, a power of 2, 0 - the cache is disabled */
+    OUTPUT scratch;         /* output of the conversions on misses */
+    size_t hits;            /* number of expressions found in the cache */
+    size_t misses;          /* number of expressions converted and looked for */
+};
+
+
+/* conversion engines */
+#define ENGINE_RECURSIVE 0
+#define ENGINE_TRAMPOLINE 1
+#define ENGINE_SIMD 2
+#define ENGINE_COUNT 3
+
+/* conversion status */
+#define STATUS_OK 0
+#define STATUS_ERROR 1              /* invalid character */
+#define STATUS_UNMATCHED_CLOSE 2    /* ')' without '(' before it */
+#define STATUS_UNCLOSED_OPEN 3      /* '(' without ')' after it */
+
+/* shortest expression convert() splits between the threads, see convert_split() */
+#define SPLIT_MINIMUM (1 << 18)
+
+/* opcodes of a program, 0-25 push the value of the symbols 'a'-'z' */
+#define SYMBOL_COUNT 26
+#define OPCODE_ADD 26
+#define OPCODE_SUB 27
+#define OPCODE_MUL 28
+#define OPCODE_DIV 29
+#define OPCODE_MOD 30
+#define OPCODE_POW 31
+#define OPCODE_NEG 32               /* the unary minus '~' */
+#define OPCODE_SAVE 33              /* followed by a slot, see compile_tree() */
+#define OPCODE_REUSE 34             /* the same */
+#define OPCODE_SLOT_BYTES 4         /* bytes of the slot, in the byte order of the CPU */
+#define OPCODE_ZERO 35              /* the constants of the simplify mode */
+#define OPCODE_ONE 36
+#define OPCODE_END 37
+#define OPCODE_INVALID 38
+
+/* packed records, see the packed mode below */
+#define RECORD_HEADER 4             /* the length of the rest and the status */
+#define RECORD_STATUS_BITS 2        /* low bits of the header holding the status */
+#define RECORD_CODE_BITS 5          /* bits of a code */
+#define RECORD_ESCAPE 31            /* the code is the opcode 31 + the next code */
+#define RECORD_LENGTH_MAX ((1u << (32 - RECORD_STATUS_BITS)) - 1) /* longest rest of a record */
+
+
+/* function prototypes */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* conversion context */
+void init_context(CONTEXT* ctx);
+void free_context(CONTEXT* ctx);
+
+/* In the tokenizer mode (ctx->tokens = 1) operands are identifiers [a-z_][a-z0-9_]* */
+/* and decimal literals [0-9]+(.[0-9]*)?, and the tokens of the postfix form are     */
+/* separated by spaces. Otherwise every symbol a-z is an operand on its own.        */
+/* The tokens of the postfix form are written to the output, or passed to ctx->emit */
+/* if it is set; operands point into the input, so the emit function can take their */
+/* offsets (token - ctx->begin) instead of copying them                            */
+
+/* In the tree mode (ctx->tree = 1) the tokens build the expression tree in the   */
+/* node arena of the context instead, ctx->root is the tree until the next       */
+/* conversion, and the output is the tree as (operation operand ...), nested.    */
+/* The nodes are taken from the arena with no allocation per node, the arena is */
+/* reset for every expression and grows with the longest one                    */
+
+/* In the DAG mode (ctx->dag = 1 with ctx->tree = 1) every node is looked up in a */
+/* hash table as it is built, a subtree identical to one built before is not     */
+/* linked into the tree, the first one is used again, so ctx->root is a DAG.      */
+/* The output is printed with the Lisp notation of shared structure: a subtree   */
+/* used more than once is printed as #N=(...) the first time and as #N# later,   */
+/* e.g. (b+c*d)*(b+c*d) -> (* #1=(+ b (* c d)) #1#)                              */
+
+/* In the simplify mode (ctx->simplify = 1 with ctx->tree = 1) the tree is a DAG    */
+/* as in the DAG mode and it is simplified when it is built: the chains of + and -  */
+/* and of * and / are flattened, the same subtree added and subtracted (multiplied  */
+/* and divided) is cancelled, and what is left is added up into a balanced tree, so */
+/* a-a -> 0, a*(b/b) -> a and a+b+c+d -> ab+cd++; x^1, x^0, 1^x and 0%x are folded  */
+/* too. The output is the postfix form of the simplified tree, with the constants   */
+/* 0 and 1 where they are left, and ctx->root is the simplified tree. The rules     */
+/* are the ones of the real numbers: x-x is 0 and x/x is 1 for any x, 0*x and 0%x   */
+/* are 0, and the sums and products are computed in another order, so the results   */
+/* may differ in the last bits. The operands of % are not simplified, the remainder */
+/* is not continuous and a last bit of its operands may change it by the divisor    */
+
+/* In the packed mode (ctx->packed = 1 in the symbol mode, neither ctx->tokens nor */
+/* ctx->tree) the output of every expression is a record: the header is a 4-byte   */
+/* integer in the byte order of the CPU, the length of the rest of the record      */
+/* shifted by RECORD_STATUS_BITS and the status in the low bits; the tokens follow */
+/* as their opcodes packed in RECORD_CODE_BITS bits each from the low bits of the  */
+/* first byte up, the opcodes from RECORD_ESCAPE on take a second code with the    */
+/* rest of the opcode, and the bits after the last code are ones. The record of an */
+/* expression with an error holds the error line instead, as does the record of a */
+/* postfix form longer than RECORD_LENGTH_MAX. The header is filled in             */
+/* when the conversion ends, so the record is kept in the output buffer; when it   */
+/* may be longer than a buffer written to a file, it is made in memory and written */
+/* out whole. The checkpoints of the packed mode cannot be resumed                 */
+
+/* converts len bytes of the input (or less if there is '\0') into the output */
+/* returns the conversion status, on error ctx->error_offset is the offset of */
+/* the invalid character, of the unmatched ')' or of the unclosed '(', and    */
+/* the output of the expression is replaced with a single line               */
+/* "Error in the expression at offset N: reason"; the partial output is       */
+/* discarded as long as it fits into the output buffer                       */
+int  convert(CONTEXT* ctx, const char* in, size_t len, OUTPUT* out);
+
+/* the same by ctx->split threads: the expression is split at its binary + and - */
+/* outside of the brackets, the runs between them are converted by the threads    */
+/* with the modes of the context and their outputs are joined, so the output, the */
+/* status and the error offset are the ones of convert(); convert() calls it for  */
+/* the expressions of SPLIT_MINIMUM bytes or more when ctx->split > 1. The tree   */
+/* and packed modes, the emit hook and the checkpoints need the whole expression, */
+/* they are converted by the calling thread                                       */
+int  convert_split(CONTEXT* ctx, const char* in, size_t len, OUTPUT* out);
+
+/* ctx->checkpoint, if it is set, is given the state before every bracket; the     */
+/* conversion of an expression with the same bytes up to the bracket can resume    */
+/* there: the stack and the flags of the checkpoint are restored, the output of    */
+/* the expression before the bracket must be the last at->output_length bytes of  */
+/* the output buffer, and the conversion goes on from at->offset; the checkpoints */
+/* of the tree mode cannot be resumed                                             */
+int  convert_resume(CONTEXT* ctx, const char* in, size_t len, const CHECKPOINT* at, OUTPUT* out);
+
+/* conversion of an expression edited since the last call: it resumes at the last */
+/* checkpoint before the first byte that changed, inc->kept bytes of the output   */
+/* of the last expression stay the same and only the rest of the output is       */
+/* written to out, inc->postfix holds the whole output; inc->ctx may be set to   */
+/* any mode but the tree mode after init_incremental()                            */
+void init_incremental(INCREMENTAL* inc);
+void free_incremental(INCREMENTAL* inc);
+int  convert_incremental(INCREMENTAL* inc, const char* in, size_t len, OUTPUT* out);
+
+/* cache in front of convert(), bounded by memory bytes, 0 disables it; a cache */
+/* is used by one thread and with one mode of the context; on a hit the output */
+/* of the expression is copied from the cache, the status, ctx->error_offset   */
+/* and ctx->errors are as after convert(), and ctx->root is 0                  */
+void init_cache(CACHE* cache, size_t memory);
+void free_cache(CACHE* cache);
+int  convert_cached(CACHE* cache, CONTEXT* ctx, const char* in, size_t len, OUTPUT* out);
+
+/* output sink, the buffer is written to fd when it is full */
+void init_output(OUTPUT* output, char* buffer, size_t size, int fd);
+
+/* output sink, the malloc'ed buffer grows when it is full */
+void init_memory_output(OUTPUT* output, size_t size);
+void free_memory_output(OUTPUT* output);
+
+void output_char(OUTPUT* output, char c);
+void output_string(OUTPUT* output, const char* str, size_t length);
+void flush_output(OUTPUT* output);
+
+/* checks the memory just allocated: if it is 0, reports "Not enough memory" to */
+/* stderr and exits, as the library does when it cannot allocate memory         */
+void check_allocation(void* memory);
+
+/* evaluation of the postfix form, a zero-initialized program can be compiled */
+/* any number of times, the compilation returns the status, an invalid      */
+/* program evaluates to 0                                                   */
+int  compile_program(PROGRAM* program, const char* postfix, size_t length);
+
+/* the same for a record of the packed mode, length is the number of bytes that */
+/* can be read from the record on                                              */
+int  compile_record(PROGRAM* program, const char* record, size_t length);
+
+/* writes the offset of every record in length bytes of records to the index as */
+/* 8-byte integers in the byte order of the CPU, so the records can be read in  */
+/* any order; returns the number of records, an incomplete one is left out     */
+size_t index_records(const char* records, size_t length, OUTPUT* index);
+
+/* the same for the tree of the last conversion in the tree mode, in the DAG and */
+/* simplify modes a subtree used more than once is computed once, its value is */
+/* saved in a slot and pushed again where it is used; there is no tree after an */
+/* error                                                                        */
+int  compile_tree(PROGRAM* program, const CONTEXT* ctx);
+void free_program(PROGRAM* program);
+
+/* bindings[i] is the value of 'a' + i */
+double evaluate(const PROGRAM* program, const double* bindings);
+
+/* columns[i][row] is the value of 'a' + i in the row, one result per row */
+void evaluate_rows(const PROGRAM* program, const double* const* columns, size_t rows, double* results);
+
+/* the same, running every opcode over a block of rows at once */
+void evaluate_columns(const PROGRAM* program, const double* const* columns, size_t rows, double* results);
+
+/* the same for integers, arithmetic wraps around, division by zero gives 0 */
+/* and so does a negative exponent                                          */
+void evaluate_columns_int64(const PROGRAM* program, const int64_t* const* columns, size_t rows, int64_t* results);
+
+/* compiles the program into x86-64 machine code evaluating it like evaluate() */
+/* with no dispatch of opcodes, the program is kept and interpreted where     */
+/* there is no native code: on other CPUs, without executable memory, and for */
+/* the programs too deep for a frame of one page of the stack (about 500      */
+/* values of the stack and the slots)                                         */
+/* returns STATUS_OK for native code, STATUS_ERROR for the interpreter        */
+int  compile_native(NATIVE* native, const PROGRAM* program);
+void free_native(NATIVE* native);
+double evaluate_native(const NATIVE* native, const double* bindings);
+
+/* cache of entries expressions compiled into native code, rounded down to a  */
+/* power of 2; an expression is converted in the DAG mode, so the shared      */
+/* subexpressions are computed once, and it takes the entry of its hash, the  */
+/* code returned stays valid until another expression takes the entry        */
+void init_native_cache(NATIVE_CACHE* cache, size_t entries);
+void free_native_cache(NATIVE_CACHE* cache);
+const NATIVE* native_cached(NATIVE_CACHE* cache, const char* expression, size_t len);
+
+/* the simplification of the simplify mode, called by the conversion when the   */
+/* tree is built: it replaces ctx->root with the simplified tree, counts the uses */
+/* and the slots of its nodes again and prints its postfix form; share_node()     */
+/* takes a copy of the node from the arena, or the identical one built before    */
+void simplify_tree(CONTEXT* ctx);
+NODE* share_node(CONTEXT* ctx, const NODE* model);
+
+/* helpers used all over the place */
+int  check_interval(int value, int low, int high);
+void iterate(int (*step)(void* arg), void* arg);
+
+/* hash of len bytes, never 0 */
+uint64_t hash_bytes(const char* in, size_t len);
+
+#ifdef ACYCLOMATIC_STATS
+/* counters, ctx->stats is reset by init_context() and counts every conversion with  */
+/* the context; write_stats() writes them as a single line of JSON                  */
+void init_stats(STATS* stats);
+uint64_t stats_clock(void);
+void stats_expression(STATS* stats, uint64_t cycles);
+void add_stats(STATS* total, const STATS* stats);
+void write_stats(const STATS* stats, int fd);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ACYCLOMATIC_H */
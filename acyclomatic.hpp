@@ -0,0 +1,732 @@
+/*============================================================================================
+* acyclomatic.hpp - conversion of fixed arithmetical expressions at compile time (C++17)
+*
+* The same state machine as the trampoline engine of libacyclomatic: a table of step
+* handlers indexed by the class of the character, the operations kept in a stack and
+* popped by the precedence and binding tables. Every function is constexpr, so a formula
+* known at build time is converted by the compiler and costs nothing at startup:
+*
+*   static constexpr auto f = acyclomatic::convert("a+(b+c*d)*e");
+*
+*   static_assert(f.status == STATUS_OK);
+*   puts(f.c_str());                                    prints abcd*+e*+
+*   double y = acyclomatic::formula<f>::evaluate(values);
+*
+* formula<f>::evaluate() is fused: the opcodes and the depth of the stack at every one of
+* them are constants, so it compiles into straight-line code with no dispatch, reading
+* the values of the symbols a-z from the array. It is a constant expression itself unless
+* the formula has '%' or '^', which call fmod() and pow().
+*
+* Only the symbols a-z are operands, as in the default mode of convert() in C. Steps are
+* done in halves, like iterate() does in blocks, so the depth of recursion is logarithmic
+* in the length of the formula and stays far below the constexpr limits.
+*
+* Copyright 2006-2016 Mikhail Durnev (mdurnev@gmail.com). Released under the GPLv3
+============================================================================================*/
+#ifndef ACYCLOMATIC_HPP
+#define ACYCLOMATIC_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <utility>
+
+#include "acyclomatic.h"
+
+namespace acyclomatic
+{
+
+/* data types */
+
+/* postfix form of a formula of N - 1 characters, it is never longer than the formula */
+template <size_t N>
+struct postfix
+{
+    char data[N];           /* the postfix form ending with 0, empty on error */
+    size_t length;          /* length of the postfix form */
+    int status;             /* STATUS_* constants of acyclomatic.h */
+    size_t error_offset;    /* offset of the error in the formula */
+
+    constexpr const char* c_str() const { return data; }
+};
+
+/* fused evaluator of the postfix form P, a constexpr object at namespace scope */
+template <const auto& P>
+struct formula;
+
+namespace detail
+{
+
+/* state of a conversion */
+struct STATE
+{
+    const char* begin;      /* the formula */
+    const char* position;   /* next character to handle */
+    char* stack_bottom;     /* stack of operations, the bottom holds the delimiter 0 */
+    char* stack_top;
+    char* output;           /* the postfix form */
+    size_t length;          /* length of the postfix form */
+    int depth;              /* depth of brackets */
+    size_t open_offset;     /* offset of the outermost open bracket */
+    int imbalance;          /* STATUS_* constant of the bracket error found by balance() */
+    int operand;            /* 1 after an operand or ')', a '-' is binary then */
+    int finished;           /* 1 after the end or an error */
+    int status;
+    size_t error_offset;
+};
+
+typedef const char* (*STEP_ACTION)(STATE& s, const char* str);
+typedef void (*REPEAT_ACTION)(STATE& s, size_t count);
+typedef void (*DRAIN_ACTION)(STATE& s, int binding, size_t count);
+typedef void (*PRINT_ACTION)(STATE& s, char c);
+typedef void (*OPERATION)(double* top, const double* values, char c);
+typedef int (*DEPTH_ACTION)(const char* data, size_t from, size_t count);
+
+
+/* function prototypes */
+constexpr int  check_interval(int value, int low, int high);
+constexpr int  classify(char c);
+constexpr int  precedence(char c);
+constexpr int  binding(char c);
+constexpr int  balance(STATE& s, int call_index);
+
+constexpr void repeat(STATE& s, size_t count);
+constexpr void repeat_split(STATE& s, size_t count);
+constexpr void repeat_once(STATE& s, size_t count);
+constexpr void repeat_nothing(STATE& s, size_t count);
+
+constexpr const char* step_error(STATE& s, const char* str);
+constexpr const char* step_end(STATE& s, const char* str);
+constexpr const char* step_symbol(STATE& s, const char* str);
+constexpr const char* step_operator(STATE& s, const char* str);
+constexpr const char* step_open_bracket(STATE& s, const char* str);
+constexpr const char* step_close_bracket(STATE& s, const char* str);
+constexpr const char* step_finished(STATE& s, const char* str);
+
+constexpr void push(char c, char** stack_top);
+constexpr void pop0(char** stack_top);
+constexpr void pop_operators(STATE& s, int binding);
+constexpr int  pop_operator(STATE& s, int binding);
+constexpr void drain(STATE& s, int binding, size_t count);
+constexpr void drain_split(STATE& s, int binding, size_t count);
+constexpr void drain_once(STATE& s, int binding, size_t count);
+constexpr void drain_nothing(STATE& s, int binding, size_t count);
+constexpr void print_nothing(STATE& s, char c);
+constexpr void print_char(STATE& s, char c);
+
+constexpr int  operation_index(char c);
+constexpr int  stack_depth(const char* data, size_t from, size_t count);
+constexpr int  depth_split(const char* data, size_t from, size_t count);
+constexpr int  depth_once(const char* data, size_t from, size_t count);
+constexpr int  depth_nothing(const char* data, size_t from, size_t count);
+
+constexpr void op_symbol(double* top, const double* values, char c);
+constexpr void op_add(double* top, const double* values, char c);
+constexpr void op_sub(double* top, const double* values, char c);
+constexpr void op_mul(double* top, const double* values, char c);
+constexpr void op_div(double* top, const double* values, char c);
+inline    void op_mod(double* top, const double* values, char c);
+inline    void op_pow(double* top, const double* values, char c);
+constexpr void op_neg(double* top, const double* values, char c);
+
+template <const auto& P, size_t I>
+constexpr void operate(double* stack, const double* values);
+template <const auto& P, size_t... I>
+constexpr double run(const double* values, std::index_sequence<I...>);
+
+
+/* constants */
+
+/* indexes in the step table, the same as in the global call table of libacyclomatic */
+constexpr int HANDLE_ERROR = 0;
+constexpr int HANDLE_END = 1;
+constexpr int HANDLE_SYMBOL = 2;
+constexpr int HANDLE_OPERATOR = 3;
+constexpr int HANDLE_OPEN_BRKT = 4;
+constexpr int HANDLE_CLOSE_BRKT = 5;
+constexpr int STEP_FINISHED = 6;
+
+/* the unary minus in the postfix form */
+constexpr char UNARY_MINUS = '~';
+
+/* binding that pops every operation down to the delimiter of brackets */
+constexpr int BINDING_ALL = 1;
+
+
+/* function arrays */
+
+/* step call table, indexed by the class of the character or STEP_FINISHED */
+inline constexpr STEP_ACTION step_table[] =
+{
+    step_error,
+    step_end,
+    step_symbol,
+    step_operator,
+    step_open_bracket,
+    step_close_bracket,
+    step_finished
+};
+
+/* repeat call table, indexed by the count of steps being above 0, plus above 1 */
+inline constexpr REPEAT_ACTION repeat_call_table[] =
+{
+    repeat_nothing,
+    repeat_once,
+    repeat_split
+};
+
+/* drain call table, indexed as the repeat call table */
+inline constexpr DRAIN_ACTION drain_call_table[] =
+{
+    drain_nothing,
+    drain_once,
+    drain_split
+};
+
+/* print call table, indexed by the operation being popped */
+inline constexpr PRINT_ACTION print_call_table[] =
+{
+    print_nothing,
+    print_char
+};
+
+/* depth call table, indexed as the repeat call table */
+inline constexpr DEPTH_ACTION depth_call_table[] =
+{
+    depth_nothing,
+    depth_once,
+    depth_split
+};
+
+/* operations of the evaluator, indexed by operation_index() */
+inline constexpr OPERATION operation_table[] =
+{
+    op_symbol,
+    op_add,
+    op_sub,
+    op_mul,
+    op_div,
+    op_mod,
+    op_pow,
+    op_neg
+};
+
+/* change of the depth of the stack by the operations, indexed the same */
+inline constexpr int effect_table[] =
+{
+    1, -1, -1, -1, -1, -1, -1, 0
+};
+
+} /* namespace detail */
+
+
+/* error reasons, indexed by STATUS_* constants */
+inline constexpr const char* error_reasons[] =
+{
+    "",
+    "invalid character",
+    "unmatched close bracket",
+    "unclosed bracket"
+};
+
+
+
+/********************************************
+* Converts the formula into the postfix form
+* The formula of N - 1 characters takes N
+* steps with the end
+********************************************/
+template <size_t N>
+constexpr postfix<N> convert(const char (&in)[N])
+{
+    postfix<N> result {};
+    char stack[N + 1] {};
+    detail::STATE s {};
+
+    s.begin = in;
+    s.position = in;
+    s.stack_bottom = stack;
+    s.stack_top = stack;
+    s.output = result.data;
+
+    detail::repeat(s, N);
+
+    result.length = s.length;
+    result.status = s.status;
+    result.error_offset = s.error_offset;
+
+    return result;
+}
+
+template <const auto& P>
+struct formula
+{
+    static_assert(P.status == STATUS_OK, "the formula has an error");
+
+    /********************************************
+    * Evaluates the formula with the values of
+    * the symbols a-z
+    ********************************************/
+    static constexpr double evaluate(const double* values)
+    {
+        return detail::run<P>(values, std::make_index_sequence<P.length>());
+    }
+};
+
+namespace detail
+{
+
+/********************************************
+* This function returns 1 if:
+*  low <= value <= high
+* Otherwise it returns 0
+********************************************/
+constexpr int  check_interval(int value, int low, int high)
+{
+    return ~(((high - value) | (value - low)) >> (sizeof(int) * 8 - 1)) & 1;
+}
+
+/********************************************
+* Classifies the character and returns an
+* index in the step table
+********************************************/
+constexpr int  classify(char c)
+{
+    /* all the checks below are mutually exclusive */
+    int call_index = check_interval(c, '\0', '\0') * HANDLE_END;
+
+    call_index += check_interval(c, 'a', 'z') * HANDLE_SYMBOL;
+
+    call_index += check_interval(c, '+', '+') * HANDLE_OPERATOR;
+    call_index += check_interval(c, '-', '-') * HANDLE_OPERATOR;
+    call_index += check_interval(c, '*', '*') * HANDLE_OPERATOR;
+    call_index += check_interval(c, '/', '/') * HANDLE_OPERATOR;
+    call_index += check_interval(c, '%', '%') * HANDLE_OPERATOR;
+    call_index += check_interval(c, '^', '^') * HANDLE_OPERATOR;
+
+    call_index += check_interval(c, '(', '(') * HANDLE_OPEN_BRKT;
+    call_index += check_interval(c, ')', ')') * HANDLE_CLOSE_BRKT;
+
+    return call_index;
+}
+
+/********************************************
+* Returns the precedence of the operation in
+* the stack, 0 for the delimiter of brackets:
+*   + -  1,   * / %  2,   ~  3,   ^  4
+********************************************/
+constexpr int  precedence(char c)
+{
+    return (check_interval(c, '+', '+') + check_interval(c, '-', '-')) * 1 +
+           (check_interval(c, '*', '*') + check_interval(c, '/', '/') + check_interval(c, '%', '%')) * 2 +
+           check_interval(c, UNARY_MINUS, UNARY_MINUS) * 3 +
+           check_interval(c, '^', '^') * 4;
+}
+
+/********************************************
+* Returns the binding of the operation from
+* the formula, the right-associative '^' and
+* the prefix '~' pop nothing:
+*   + -  1,   * / %  2,   ~ ^  5
+********************************************/
+constexpr int  binding(char c)
+{
+    return (check_interval(c, '+', '+') + check_interval(c, '-', '-')) * 1 +
+           (check_interval(c, '*', '*') + check_interval(c, '/', '/') + check_interval(c, '%', '%')) * 2 +
+           (check_interval(c, UNARY_MINUS, UNARY_MINUS) + check_interval(c, '^', '^')) * 5;
+}
+
+/********************************************
+* Checks the brackets at the position of the
+* character of the class given by call_index
+* Returns HANDLE_ERROR for ')' at the depth 0
+* and for the end at a depth above 0, call
+* index as is otherwise
+********************************************/
+constexpr int  balance(STATE& s, int call_index)
+{
+    int unmatched = (call_index == HANDLE_CLOSE_BRKT) & (s.depth == 0);
+    int unclosed = (call_index == HANDLE_END) & (s.depth != 0);
+
+    s.imbalance = unmatched * STATUS_UNMATCHED_CLOSE + unclosed * STATUS_UNCLOSED_OPEN;
+
+    return call_index * ((unmatched | unclosed) ^ 1);
+}
+
+/********************************************
+* Does count steps, in two halves if there
+* are more than one
+********************************************/
+constexpr void repeat(STATE& s, size_t count)
+{
+    repeat_call_table[(count > 0) + (count > 1)](s, count);
+}
+
+/********************************************
+* Does the first half of the steps, then the
+* second one
+********************************************/
+constexpr void repeat_split(STATE& s, size_t count)
+{
+    repeat(s, count / 2);
+    repeat(s, count - count / 2);
+}
+
+/********************************************
+* Does one step, it stays at the same
+* position once the conversion is finished
+********************************************/
+constexpr void repeat_once(STATE& s, size_t count)
+{
+    int call_index = balance(s, classify(*s.position));
+
+    call_index += (STEP_FINISHED - call_index) * s.finished;
+
+    s.position = step_table[call_index](s, s.position);
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+constexpr void repeat_nothing(STATE& s, size_t count)
+{
+}
+
+/********************************************
+* Indicates errors in the formula, discards
+* the output and finishes the conversion
+********************************************/
+constexpr const char* step_error(STATE& s, const char* str)
+{
+    int unclosed = (s.imbalance == STATUS_UNCLOSED_OPEN);
+
+    /* an unclosed bracket is reported where it is open, not at the end */
+    size_t offsets[2] = { size_t(str - s.begin), s.open_offset };
+
+    s.status = s.imbalance + STATUS_ERROR * (s.imbalance == STATUS_OK);
+    s.error_offset = offsets[unclosed];
+    s.finished = 1;
+
+    s.output[0] = 0;
+    s.length = 0;
+
+    return str;
+}
+
+/********************************************
+* Handles the end of the formula and
+* finishes the conversion
+********************************************/
+constexpr const char* step_end(STATE& s, const char* str)
+{
+    pop_operators(s, BINDING_ALL);
+
+    s.finished = 1;
+
+    return str;
+}
+
+/********************************************
+* Handles a symbol a-z
+* Returns the next position
+********************************************/
+constexpr const char* step_symbol(STATE& s, const char* str)
+{
+    print_char(s, *str);
+
+    /* a '-' after the operand is binary */
+    s.operand = 1;
+
+    return ++str;
+}
+
+/********************************************
+* Handles an operation
+* Returns the next position
+********************************************/
+constexpr const char* step_operator(STATE& s, const char* str)
+{
+    /* '-' is the unary minus unless it follows an operand or ')' */
+    int unary = check_interval(*str, '-', '-') & (s.operand ^ 1);
+    char c = *str ^ (('-' ^ UNARY_MINUS) * unary);
+
+    /* extract and print the operations that bind at least as tightly */
+    pop_operators(s, binding(c));
+
+    push(c, &s.stack_top);
+    s.operand = 0;
+
+    return ++str;
+}
+
+/********************************************
+* Handles open brackets
+* Returns the next position
+********************************************/
+constexpr const char* step_open_bracket(STATE& s, const char* str)
+{
+    /* place delimiter 0 in the stack to separate the bracketed expression */
+    push(0, &s.stack_top);
+
+    /* remember where the outermost bracket opens */
+    s.open_offset += (str - s.begin - s.open_offset) * (s.depth == 0);
+    ++s.depth;
+    s.operand = 0;
+
+    return ++str;
+}
+
+/********************************************
+* Handles close brackets
+* Returns the next position
+********************************************/
+constexpr const char* step_close_bracket(STATE& s, const char* str)
+{
+    pop_operators(s, BINDING_ALL);
+
+    /* remove delimiter, it is always there since balance() has checked the depth */
+    pop0(&s.stack_top);
+    --s.depth;
+    s.operand = 1;
+
+    return ++str;
+}
+
+/********************************************
+* Stays at the same position after the end
+* of conversion
+********************************************/
+constexpr const char* step_finished(STATE& s, const char* str)
+{
+    return str;
+}
+
+/********************************************
+* Pushes data into the stack
+********************************************/
+constexpr void push(char c, char** stack_top)
+{
+    ++(*stack_top);
+    **stack_top = c;
+}
+
+/********************************************
+* Pops 0 from the stack
+* to go below the bottom
+********************************************/
+constexpr void pop0(char** stack_top)
+{
+    *stack_top -= check_interval(**stack_top, 0, 0);
+}
+
+/********************************************
+* Pops and prints the operations with the
+* precedence of at least binding, down to
+* the delimiter of brackets
+********************************************/
+constexpr void pop_operators(STATE& s, int binding)
+{
+    /* mostly there are up to two operations to pop, the rest is drained */
+    /* by as many pops as there are operations left in the stack, a pop  */
+    /* after the last one pops nothing                                  */
+    int more = pop_operator(s, binding);
+
+    more &= pop_operator(s, binding);
+
+    drain(s, binding, (s.stack_top - s.stack_bottom) * more);
+}
+
+/********************************************
+* Pops and prints the operation at the top of
+* the stack if its precedence is at least
+* binding
+* Returns 1 if the operation is popped
+********************************************/
+constexpr int  pop_operator(STATE& s, int binding)
+{
+    char c = *s.stack_top;
+    int popped = (precedence(c) >= binding);
+
+    print_call_table[popped](s, c);
+    s.stack_top -= popped;
+
+    return popped;
+}
+
+/********************************************
+* Pops count times, in two halves if there
+* are more than one
+********************************************/
+constexpr void drain(STATE& s, int binding, size_t count)
+{
+    drain_call_table[(count > 0) + (count > 1)](s, binding, count);
+}
+
+/********************************************
+* Pops the first half, then the second one
+********************************************/
+constexpr void drain_split(STATE& s, int binding, size_t count)
+{
+    drain(s, binding, count / 2);
+    drain(s, binding, count - count / 2);
+}
+
+/********************************************
+* Pops one more operation
+********************************************/
+constexpr void drain_once(STATE& s, int binding, size_t count)
+{
+    pop_operator(s, binding);
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+constexpr void drain_nothing(STATE& s, int binding, size_t count)
+{
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+constexpr void print_nothing(STATE& s, char c)
+{
+}
+
+/********************************************
+* Prints the character to the postfix form
+********************************************/
+constexpr void print_char(STATE& s, char c)
+{
+    s.output[s.length] = c;
+    ++s.length;
+}
+
+/********************************************
+* Returns the index in the operation table of
+* the character of the postfix form
+********************************************/
+constexpr int  operation_index(char c)
+{
+    /* all the checks below are mutually exclusive, a-z give 0 */
+    return check_interval(c, '+', '+') * 1 +
+           check_interval(c, '-', '-') * 2 +
+           check_interval(c, '*', '*') * 3 +
+           check_interval(c, '/', '/') * 4 +
+           check_interval(c, '%', '%') * 5 +
+           check_interval(c, '^', '^') * 6 +
+           check_interval(c, UNARY_MINUS, UNARY_MINUS) * 7;
+}
+
+/********************************************
+* Returns the depth of the stack after count
+* operations of the postfix form from the
+* given one, in two halves if there are more
+* than one
+********************************************/
+constexpr int  stack_depth(const char* data, size_t from, size_t count)
+{
+    return depth_call_table[(count > 0) + (count > 1)](data, from, count);
+}
+
+/********************************************
+* Adds the depths of the two halves
+********************************************/
+constexpr int  depth_split(const char* data, size_t from, size_t count)
+{
+    return stack_depth(data, from, count / 2) + stack_depth(data, from + count / 2, count - count / 2);
+}
+
+/********************************************
+* Returns the change of the depth by the
+* operation
+********************************************/
+constexpr int  depth_once(const char* data, size_t from, size_t count)
+{
+    return effect_table[operation_index(data[from])];
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+constexpr int  depth_nothing(const char* data, size_t from, size_t count)
+{
+    return 0;
+}
+
+/********************************************
+* Operations of the evaluator, top is above
+* the top of the stack
+********************************************/
+constexpr void op_symbol(double* top, const double* values, char c)
+{
+    top[0] = values[c - 'a'];
+}
+
+constexpr void op_add(double* top, const double* values, char c)
+{
+    top[-2] += top[-1];
+}
+
+constexpr void op_sub(double* top, const double* values, char c)
+{
+    top[-2] -= top[-1];
+}
+
+constexpr void op_mul(double* top, const double* values, char c)
+{
+    top[-2] *= top[-1];
+}
+
+constexpr void op_div(double* top, const double* values, char c)
+{
+    top[-2] /= top[-1];
+}
+
+inline    void op_mod(double* top, const double* values, char c)
+{
+    top[-2] = std::fmod(top[-2], top[-1]);
+}
+
+inline    void op_pow(double* top, const double* values, char c)
+{
+    top[-2] = std::pow(top[-2], top[-1]);
+}
+
+constexpr void op_neg(double* top, const double* values, char c)
+{
+    top[-1] = -top[-1];
+}
+
+/********************************************
+* Performs the operation I of the postfix
+* form P, the operation and the depth of
+* the stack are constants
+********************************************/
+template <const auto& P, size_t I>
+constexpr void operate(double* stack, const double* values)
+{
+    constexpr OPERATION operation = operation_table[operation_index(P.data[I])];
+    constexpr int depth = stack_depth(P.data, 0, I);
+
+    operation(stack + depth, values, P.data[I]);
+}
+
+/********************************************
+* Performs all the operations of the postfix
+* form P one after another
+********************************************/
+template <const auto& P, size_t... I>
+constexpr double run(const double* values, std::index_sequence<I...>)
+{
+    double stack[P.length + 1] {};
+
+    (operate<P, I>(stack, values), ...);
+
+    return stack[0];
+}
+
+} /* namespace detail */
+
+} /* namespace acyclomatic */
+
+#endif
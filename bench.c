@@ -0,0 +1,532 @@
+/*============================================================================================
+* Benchmark of the conversion engines
+*
+* Generates expressions with the given length, nesting depth and operator mix, then
+* converts them with every engine and reports throughput in MB/s and ns per token.
+* Then it compiles the first expression and evaluates it over rows of pseudo-random values,
+* row by row and by columns, reporting millions of rows per second.
+*
+* Usage:
+*   bench [count [length [depth [operators [repeat [corpus]]]]]]
+*
+*   count      number of expressions (default 100000)
+*   length     approximate length of an expression (default 64)
+*   depth      maximal nesting depth of brackets (default 4)
+*   operators  operators to choose from, repeat one to make it more frequent
+*              (default: all four of them)
+*   repeat     number of times the whole set is converted (default 10)
+*   corpus     file the expressions are written to instead of running the benchmark,
+*              one per line, see the pgo target of Makefile
+*
+* The classifier is chosen at build time, see Makefile.
+*
+* Copyright 2006-2016 Mikhail Durnev (mdurnev@gmail.com). Released under the GPLv3
+============================================================================================*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "acyclomatic.h"
+
+
+/* data types */
+typedef struct GENERATOR GENERATOR;
+typedef struct BENCH BENCH;
+
+/* function prototypes */
+char* bench_arg(int argc, char* argv[], int index, char* value);
+int  generate_step(void* arg);
+void generate_term(GENERATOR* gen);
+void generate_operator(GENERATOR* gen);
+void generate_end(GENERATOR* gen);
+uint32_t generate_random(GENERATOR* gen);
+
+void bench_run(BENCH* bench, const char* corpus);
+void bench_write(BENCH* bench, const char* corpus);
+void bench_engines(BENCH* bench, int engine);
+void bench_engine(BENCH* bench, int engine);
+void bench_nothing(BENCH* bench, int engine);
+int  bench_repeat_step(void* arg);
+int  bench_line_step(void* arg);
+double bench_time(void);
+void bench_evaluate(BENCH* bench);
+void bench_evaluators(BENCH* bench, int evaluator);
+void bench_evaluator(BENCH* bench, int evaluator);
+int  bench_fill_step(void* arg);
+int  bench_column_step(void* arg);
+int  bench_evaluate_step(void* arg);
+
+/* data types */
+typedef void (*GENERATOR_ACTION)(GENERATOR* gen);
+typedef void (*BENCH_ACTION)(BENCH* bench, int engine);
+typedef void (*CORPUS_ACTION)(BENCH* bench, const char* corpus);
+
+/* state of the expression generator */
+struct GENERATOR
+{
+    char* buffer;           /* generated expressions, one per line */
+    size_t length;          /* number of bytes generated so far */
+    size_t line_start;      /* offset of the current expression */
+    size_t target;          /* approximate length of an expression */
+    int depth;              /* current nesting depth */
+    int max_depth;          /* maximal nesting depth */
+    const char* operators;  /* operators to choose from */
+    size_t operator_count;
+    size_t count;           /* number of expressions left to generate */
+    uint32_t seed;          /* state of the random number generator */
+};
+
+/* state of the benchmark */
+struct BENCH
+{
+    const char* input;      /* generated expressions */
+    size_t length;
+    size_t tokens;          /* number of tokens in the input */
+    int repeat;             /* number of times the input is converted */
+    int left;               /* number of times left */
+    const char* position;   /* next line to convert */
+    CONTEXT ctx;
+    OUTPUT output;
+    PROGRAM program;        /* the first expression compiled */
+    double* values;         /* values of the symbols by columns */
+    const double* columns[SYMBOL_COUNT];
+    double* results;
+    size_t filled;          /* number of values or columns filled so far */
+    int evaluator;          /* evaluator being measured */
+};
+
+/* evaluator being measured */
+typedef void (*EVALUATOR)(const PROGRAM* program, const double* const* columns, size_t rows, double* results);
+
+
+/* function arrays */
+
+/* generator call table, indexed by the expression being long enough */
+GENERATOR_ACTION generator_call_table[] =
+{
+    generate_operator,
+    generate_end
+};
+
+/* main call table, indexed by having the corpus file */
+CORPUS_ACTION corpus_call_table[] =
+{
+    bench_run,
+    bench_write
+};
+
+/* benchmark call table, indexed by having run all the engines */
+BENCH_ACTION bench_call_table[] =
+{
+    bench_engine,
+    bench_nothing
+};
+
+/* evaluation benchmark call table, indexed by having run all the evaluators */
+BENCH_ACTION evaluate_call_table[] =
+{
+    bench_evaluator,
+    bench_nothing
+};
+
+/* engine names, indexed by ENGINE_* constants */
+const char* engine_names[] =
+{
+    "recursive",
+    "trampoline",
+    "simd"
+};
+
+/* evaluators and their names */
+const EVALUATOR evaluators[] =
+{
+    evaluate_rows,
+    evaluate_columns
+};
+
+const char* evaluator_names[] =
+{
+    "rows",
+    "columns"
+};
+
+
+/* constants */
+#ifdef TABLE_CLASSIFIER
+#define CLASSIFIER_NAME "table"
+#else
+#define CLASSIFIER_NAME "arithmetic"
+#endif
+
+/* output buffer, it is emptied after every expression */
+#define BENCH_OUTPUT_SIZE (1 << 16)
+
+/* number of rows of values for the evaluation */
+#define BENCH_ROWS (1 << 16)
+
+/* number of times the rows are evaluated */
+#define BENCH_EVALUATIONS 16
+
+/* number of evaluators */
+#define EVALUATOR_COUNT 2
+
+/********************************************
+* Program entry point
+********************************************/
+int  main(int argc, char* argv[])
+{
+    GENERATOR gen;
+    BENCH bench;
+    size_t count = atol(bench_arg(argc, argv, 1, "100000"));
+
+    /* at least one expression */
+    count += (count == 0);
+
+    gen.count = count;
+    gen.target = atol(bench_arg(argc, argv, 2, "64"));
+    gen.max_depth = atoi(bench_arg(argc, argv, 3, "4"));
+    gen.operators = bench_arg(argc, argv, 4, "+-*/");
+    gen.operator_count = strlen(gen.operators);
+    gen.seed = 2006;
+    gen.depth = 0;
+    gen.length = 0;
+    gen.line_start = 0;
+
+    /* every step adds at most max_depth + 3 bytes, the last one closes the brackets */
+    gen.buffer = malloc(count * (gen.target + 3 * (gen.max_depth + 3)));
+    check_allocation(gen.buffer);
+
+    iterate(generate_step, &gen);
+
+    bench.input = gen.buffer;
+    bench.length = gen.length;
+    bench.tokens = gen.length - count;
+    bench.repeat = atoi(bench_arg(argc, argv, 5, "10"));
+
+    printf("%zu expressions, %zu bytes, depth %d, operators %s, classifier %s\n",
+           count, gen.length, gen.max_depth, gen.operators, CLASSIFIER_NAME);
+
+    corpus_call_table[argc > 6](&bench, bench_arg(argc, argv, 6, ""));
+
+    free(gen.buffer);
+
+    return 0;
+}
+
+/********************************************
+* Returns the argument or the default value
+* if there are not so many arguments
+********************************************/
+char* bench_arg(int argc, char* argv[], int index, char* value)
+{
+    int present = (index < argc);
+    char* values[2] = { value, argv[index * present] };
+
+    return values[present];
+}
+
+/********************************************
+* Generates the next term of the expression
+* and either an operator or the end of line
+* Returns 1 when all expressions are done
+********************************************/
+int  generate_step(void* arg)
+{
+    GENERATOR* gen = arg;
+
+    generate_term(gen);
+
+    generator_call_table[gen->length - gen->line_start >= gen->target](gen);
+
+    return gen->count == 0;
+}
+
+/********************************************
+* Generates a symbol a-z, maybe opening a
+* bracket before it and closing one after it
+********************************************/
+void generate_term(GENERATOR* gen)
+{
+    int open = (generate_random(gen) % 3 == 0) & (gen->depth < gen->max_depth);
+    int close;
+
+    gen->buffer[gen->length] = '(';
+    gen->length += open;
+    gen->depth += open;
+
+    gen->buffer[gen->length++] = 'a' + generate_random(gen) % 26;
+
+    /* do not close the bracket just opened, (a) would be too common */
+    close = (generate_random(gen) % 3 == 0) & (gen->depth > 0) & (open ^ 1);
+
+    gen->buffer[gen->length] = ')';
+    gen->length += close;
+    gen->depth -= close;
+}
+
+/********************************************
+* Generates an operator from the mix
+********************************************/
+void generate_operator(GENERATOR* gen)
+{
+    gen->buffer[gen->length++] = gen->operators[generate_random(gen) % gen->operator_count];
+}
+
+/********************************************
+* Closes all open brackets and ends the line
+********************************************/
+void generate_end(GENERATOR* gen)
+{
+    memset(gen->buffer + gen->length, ')', gen->depth);
+    gen->length += gen->depth;
+    gen->depth = 0;
+
+    gen->buffer[gen->length++] = '\n';
+    gen->line_start = gen->length;
+
+    --gen->count;
+}
+
+/********************************************
+* Returns the next pseudo-random number
+********************************************/
+uint32_t generate_random(GENERATOR* gen)
+{
+    /* xorshift32 */
+    gen->seed ^= gen->seed << 13;
+    gen->seed ^= gen->seed >> 17;
+    gen->seed ^= gen->seed << 5;
+
+    return gen->seed >> 8;
+}
+
+/********************************************
+* Runs the benchmark of the engines and of
+* the evaluators
+********************************************/
+void bench_run(BENCH* bench, const char* corpus)
+{
+    bench_engines(bench, 0);
+    bench_evaluate(bench);
+}
+
+/********************************************
+* Writes the expressions to the corpus file
+********************************************/
+void bench_write(BENCH* bench, const char* corpus)
+{
+    int fd = open(corpus, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    write(fd, bench->input, bench->length);
+    close(fd);
+}
+
+/********************************************
+* Runs the benchmark for the engines from
+* the given one on
+********************************************/
+void bench_engines(BENCH* bench, int engine)
+{
+    bench_call_table[engine == ENGINE_COUNT](bench, engine);
+}
+
+/********************************************
+* Runs the benchmark for the engine and goes
+* on with the next engine
+********************************************/
+void bench_engine(BENCH* bench, int engine)
+{
+    double start;
+    double seconds;
+
+    init_context(&bench->ctx);
+    bench->ctx.engine = engine;
+    init_memory_output(&bench->output, BENCH_OUTPUT_SIZE);
+
+    bench->left = bench->repeat;
+
+    start = bench_time();
+    iterate(bench_repeat_step, bench);
+    seconds = bench_time() - start;
+
+    printf("%-10s  %-10s  %10.1f MB/s  %8.2f ns/token\n",
+           CLASSIFIER_NAME, engine_names[engine],
+           bench->length * (double)bench->repeat / seconds / 1e6,
+           seconds * 1e9 / ((double)bench->tokens * bench->repeat));
+
+    free_memory_output(&bench->output);
+    free_context(&bench->ctx);
+
+    bench_engines(bench, engine + 1);
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+void bench_nothing(BENCH* bench, int engine)
+{
+}
+
+/********************************************
+* Converts the whole input once
+* Returns 1 when it is done repeat times
+********************************************/
+int  bench_repeat_step(void* arg)
+{
+    BENCH* bench = arg;
+
+    bench->position = bench->input;
+    iterate(bench_line_step, bench);
+
+    --bench->left;
+
+    return bench->left <= 0;
+}
+
+/********************************************
+* Converts the next line of the input
+* Returns 1 at the end of the input
+********************************************/
+int  bench_line_step(void* arg)
+{
+    BENCH* bench = arg;
+    const char* end = bench->input + bench->length;
+    const char* newline = memchr(bench->position, '\n', end - bench->position);
+    const char* ends[2] = { newline, end };
+    const char* line_end = ends[newline == 0];
+
+    convert(&bench->ctx, bench->position, line_end - bench->position, &bench->output);
+    bench->output.length = 0;
+
+    bench->position = line_end + 1;
+
+    return bench->position >= end;
+}
+
+/********************************************
+* Returns monotonic time in seconds
+********************************************/
+double bench_time(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/********************************************
+* Runs the benchmark for the evaluators with
+* the first expression
+********************************************/
+void bench_evaluate(BENCH* bench)
+{
+    const char* newline = memchr(bench->input, '\n', bench->length);
+    OUTPUT output;
+
+    init_context(&bench->ctx);
+    init_memory_output(&output, BENCH_OUTPUT_SIZE);
+    convert(&bench->ctx, bench->input, newline - bench->input, &output);
+
+    memset(&bench->program, 0, sizeof(bench->program));
+    /* the conversion ends the postfix form with a newline */
+    compile_program(&bench->program, output.buffer, output.length - 1);
+
+    bench->values = malloc(SYMBOL_COUNT * BENCH_ROWS * sizeof(double));
+    bench->results = malloc(BENCH_ROWS * sizeof(double));
+    check_allocation(bench->values);
+    check_allocation(bench->results);
+
+    bench->filled = 0;
+    iterate(bench_fill_step, bench);
+    bench->filled = 0;
+    iterate(bench_column_step, bench);
+
+    printf("%zu rows, %zu opcodes\n", (size_t)BENCH_ROWS, bench->program.length);
+
+    bench_evaluators(bench, 0);
+
+    free(bench->results);
+    free(bench->values);
+    free_program(&bench->program);
+    free_memory_output(&output);
+    free_context(&bench->ctx);
+}
+
+/********************************************
+* Runs the benchmark for the evaluators from
+* the given one on
+********************************************/
+void bench_evaluators(BENCH* bench, int evaluator)
+{
+    evaluate_call_table[evaluator == EVALUATOR_COUNT](bench, evaluator);
+}
+
+/********************************************
+* Runs the benchmark for the evaluator and
+* goes on with the next evaluator
+********************************************/
+void bench_evaluator(BENCH* bench, int evaluator)
+{
+    double start;
+    double seconds;
+
+    bench->evaluator = evaluator;
+    bench->left = BENCH_EVALUATIONS;
+
+    start = bench_time();
+    iterate(bench_evaluate_step, bench);
+    seconds = bench_time() - start;
+
+    printf("%-10s  %-10s  %10.1f Mrows/s\n", "evaluate", evaluator_names[evaluator],
+           (double)BENCH_ROWS * BENCH_EVALUATIONS / seconds / 1e6);
+
+    bench_evaluators(bench, evaluator + 1);
+}
+
+/********************************************
+* Fills the next value, from -8 to 8
+* Returns 1 when all the values are filled
+********************************************/
+int  bench_fill_step(void* arg)
+{
+    BENCH* bench = arg;
+
+    bench->values[bench->filled] = (int)(bench->filled * 2654435761u >> 20 & 0xFFF) / 256.0 - 8;
+    ++bench->filled;
+
+    return bench->filled >= SYMBOL_COUNT * BENCH_ROWS;
+}
+
+/********************************************
+* Points the next column into the values
+* Returns 1 when all the columns are set
+********************************************/
+int  bench_column_step(void* arg)
+{
+    BENCH* bench = arg;
+
+    bench->columns[bench->filled] = bench->values + bench->filled * BENCH_ROWS;
+    ++bench->filled;
+
+    return bench->filled >= SYMBOL_COUNT;
+}
+
+/********************************************
+* Evaluates all the rows once
+* Returns 1 when it is done enough times
+********************************************/
+int  bench_evaluate_step(void* arg)
+{
+    BENCH* bench = arg;
+
+    evaluators[bench->evaluator](&bench->program, bench->columns, BENCH_ROWS, bench->results);
+
+    --bench->left;
+
+    return bench->left <= 0;
+}
@@ -0,0 +1,373 @@
+/*============================================================================================
+* Cache of the results of repeated expressions
+*
+* The cache sits in front of convert(): an expression seen before is not converted again,
+* its output is copied from the cache. The cache is keyed on the bytes of the expression
+* and bounded by the memory given to init_cache(), it is made of sets of CACHE_WAYS
+* entries, an expression can only be kept in the set its hash selects.
+*
+* The hashes and the lengths of the expressions of a set share the first cache line of
+* the set, so a miss reads a single line.
+*
+* Entries are replaced by the CLOCK algorithm within the set: a hit marks the entry as
+* referenced, the hand of the set goes over the referenced entries clearing the marks and
+* stops at the first one that is not referenced, so the expressions seen only once are
+* replaced first.
+*
+* Copyright 2006-2016 Mikhail Durnev (mdurnev@gmail.com). Released under the GPLv3
+============================================================================================*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "acyclomatic.h"
+
+
+/* data types */
+typedef struct ENTRY ENTRY;
+typedef struct LOOKUP LOOKUP;
+typedef struct HASH HASH;
+
+/* function prototypes */
+static int  convert_uncached(LOOKUP* lookup);
+static int  convert_lookup(LOOKUP* lookup);
+static int  cache_hit(LOOKUP* lookup);
+static int  cache_miss(LOOKUP* lookup);
+static void store_entry(LOOKUP* lookup, const OUTPUT* result);
+static void store_nothing(LOOKUP* lookup, const OUTPUT* result);
+static unsigned match(const CACHE_SET* set, int way, const LOOKUP* lookup);
+static int  hash_step(void* arg);
+
+/* data types */
+typedef int (*LOOKUP_ACTION)(LOOKUP* lookup);
+typedef void (*STORE_ACTION)(LOOKUP* lookup, const OUTPUT* result);
+
+
+/* constants */
+
+/* number of entries in a set */
+#define CACHE_WAYS 4
+
+/* bytes of an entry for the expression and its output together */
+#define CACHE_DATA 232
+
+/* size of a cache line, every set starts at a line */
+#define CACHE_LINE 64
+
+/* the bits of the entries of a set */
+#define WAYS_MASK ((1u << CACHE_WAYS) - 1)
+
+/* initial size of the output of the conversions on misses, it grows as needed */
+#define SCRATCH_SIZE 1024
+
+
+/* cached expression with its output */
+struct ENTRY
+{
+    size_t value_length;    /* length of the output */
+    size_t error_offset;    /* ctx->error_offset of the conversion */
+    int status;             /* status of the conversion */
+    char data[CACHE_DATA];  /* the expression followed by the output */
+};
+
+/* set of entries an expression can be kept in, the fields before the entries */
+/* are all a lookup reads unless the expression is found                    */
+struct CACHE_SET
+{
+    uint64_t hashes[CACHE_WAYS];        /* hashes of the expressions, 0 for an empty entry */
+    uint32_t key_lengths[CACHE_WAYS];   /* lengths of the expressions */
+    unsigned references;                /* bit per entry, set by a hit */
+    unsigned hand;                      /* entry the CLOCK hand points to */
+    ENTRY ways[CACHE_WAYS] __attribute__((aligned(CACHE_LINE)));
+};
+
+/* state of a conversion through the cache */
+struct LOOKUP
+{
+    CACHE* cache;
+    CONTEXT* ctx;
+    const char* in;         /* the expression */
+    size_t len;
+    OUTPUT* out;
+    uint64_t hash;          /* hash of the expression */
+    CACHE_SET* set;         /* set selected by the hash */
+    int way;                /* entry of the expression in the set if it is there */
+};
+
+/* state of hashing the expression by words */
+struct HASH
+{
+    const char* position;   /* next byte to hash */
+    size_t left;            /* number of bytes left */
+    uint64_t hash;
+};
+
+
+/* function arrays */
+
+/* conversion call table, indexed by the cache being enabled */
+static const LOOKUP_ACTION cached_call_table[] =
+{
+    convert_uncached,
+    convert_lookup
+};
+
+/* lookup call table, indexed by finding the expression in the set */
+static const LOOKUP_ACTION lookup_call_table[] =
+{
+    cache_miss,
+    cache_hit
+};
+
+/* store call table, indexed by the expression and its output fitting into an entry */
+static const STORE_ACTION store_call_table[] =
+{
+    store_nothing,
+    store_entry
+};
+
+
+
+/********************************************
+* Initializes the cache with the number of
+* sets that fit into memory bytes, rounded
+* down to a power of 2, memory 0 disables
+* the cache, and so does failure to allocate
+* the sets
+********************************************/
+void init_cache(CACHE* cache, size_t memory)
+{
+    uint64_t sets = memory / sizeof(CACHE_SET);
+
+    /* round down to a power of 2, 0 stays 0 */
+    sets |= sets >> 1;
+    sets |= sets >> 2;
+    sets |= sets >> 4;
+    sets |= sets >> 8;
+    sets |= sets >> 16;
+    sets |= sets >> 32;
+    sets -= sets >> 1;
+
+    /* the entries are empty with the hash 0, the references and the hands are 0, */
+    /* one more set leaves room to align the sets to cache lines                  */
+    cache->memory = calloc(sets + (sets != 0), sizeof(CACHE_SET));
+    cache->sets = (CACHE_SET*)(((uintptr_t)cache->memory + CACHE_LINE - 1) & -(uintptr_t)CACHE_LINE);
+    cache->set_count = sets * (cache->memory != 0);
+    cache->hits = 0;
+    cache->misses = 0;
+
+    init_memory_output(&cache->scratch, SCRATCH_SIZE);
+}
+
+/********************************************
+* Deallocates the cache
+********************************************/
+void free_cache(CACHE* cache)
+{
+    free(cache->memory);
+    free_memory_output(&cache->scratch);
+
+    cache->memory = 0;
+    cache->sets = 0;
+    cache->set_count = 0;
+}
+
+/********************************************
+* Converts the expression like convert(), or
+* copies its output from the cache if the
+* expression is found there
+********************************************/
+int  convert_cached(CACHE* cache, CONTEXT* ctx, const char* in, size_t len, OUTPUT* out)
+{
+    LOOKUP lookup;
+
+    lookup.cache = cache;
+    lookup.ctx = ctx;
+    lookup.in = in;
+    lookup.len = len;
+    lookup.out = out;
+
+    return cached_call_table[cache->set_count != 0](&lookup);
+}
+
+/********************************************
+* Hashes the expression 8 bytes at a time
+* The hash is never 0, so it never matches
+* an empty entry
+********************************************/
+uint64_t hash_bytes(const char* in, size_t len)
+{
+    HASH hash;
+
+    hash.position = in;
+    hash.left = len;
+    hash.hash = 0x9E3779B97F4A7C15ull ^ len;
+
+    iterate(hash_step, &hash);
+
+    return hash.hash | 1;
+}
+
+/********************************************
+* Converts the expression, the cache is
+* disabled
+********************************************/
+static int  convert_uncached(LOOKUP* lookup)
+{
+    return convert(lookup->ctx, lookup->in, lookup->len, lookup->out);
+}
+
+/********************************************
+* Looks for the expression in its set
+********************************************/
+static int  convert_lookup(LOOKUP* lookup)
+{
+    unsigned found;
+
+    lookup->hash = hash_bytes(lookup->in, lookup->len);
+    lookup->set = lookup->cache->sets + (lookup->hash & (lookup->cache->set_count - 1));
+
+    /* an expression is never stored twice, so at most one entry matches */
+    found = match(lookup->set, 0, lookup) |
+            match(lookup->set, 1, lookup) << 1 |
+            match(lookup->set, 2, lookup) << 2 |
+            match(lookup->set, 3, lookup) << 3;
+
+    /* the bit after the ways keeps the count of trailing zeros defined */
+    lookup->way = __builtin_ctz(found | (1u << CACHE_WAYS));
+
+    return lookup_call_table[found != 0](lookup);
+}
+
+/********************************************
+* Copies the output of the expression from
+* its entry and marks the entry referenced
+********************************************/
+static int  cache_hit(LOOKUP* lookup)
+{
+    const ENTRY* entry = &lookup->set->ways[lookup->way];
+    CONTEXT* ctx = lookup->ctx;
+
+    output_string(lookup->out, entry->data + lookup->len, entry->value_length);
+
+    /* the conversion leaves the same state as the one the entry is made of, */
+    /* except that there is no tree                                         */
+    ctx->status = entry->status;
+    ctx->error_offset = entry->error_offset;
+    ctx->errors += (entry->status != STATUS_OK);
+    ctx->root = 0;
+
+    lookup->set->references |= 1u << lookup->way;
+    ++lookup->cache->hits;
+
+    return entry->status;
+}
+
+/********************************************
+* Converts the expression into the scratch
+* output, copies it to the output and keeps
+* it in the set if it fits into an entry
+********************************************/
+static int  cache_miss(LOOKUP* lookup)
+{
+    OUTPUT* scratch = &lookup->cache->scratch;
+    int status;
+
+    /* the scratch output only grows, so the whole output of the expression stays there */
+    scratch->length = 0;
+    scratch->mark = 0;
+
+    status = convert(lookup->ctx, lookup->in, lookup->len, scratch);
+
+    output_string(lookup->out, scratch->buffer, scratch->length);
+
+    store_call_table[lookup->len + scratch->length <= CACHE_DATA](lookup, scratch);
+    ++lookup->cache->misses;
+
+    return status;
+}
+
+/********************************************
+* Keeps the expression and its output in the
+* entry the CLOCK hand of the set stops at
+********************************************/
+static void store_entry(LOOKUP* lookup, const OUTPUT* result)
+{
+    CACHE_SET* set = lookup->set;
+    ENTRY* entry;
+    unsigned hand = set->hand;
+
+    /* the entries that are not referenced, rotated so that the hand is at bit 0 */
+    unsigned free_ways = ~set->references & WAYS_MASK;
+    unsigned rotated = ((free_ways >> hand) | (free_ways << (CACHE_WAYS - hand))) & WAYS_MASK;
+
+    /* the hand passes the referenced entries up to the first free one, */
+    /* or all of them coming back to where it is if every one is        */
+    unsigned passed = __builtin_ctz(rotated | (1u << CACHE_WAYS));
+    unsigned way = (hand + passed) & (CACHE_WAYS - 1);
+
+    /* the entries passed lose their references, the new one has none */
+    unsigned cleared = (1u << passed) - 1;
+
+    cleared = ((cleared << hand) | (cleared >> (CACHE_WAYS - hand))) & WAYS_MASK;
+    set->references &= ~(cleared | 1u << way);
+    set->hand = (way + 1) & (CACHE_WAYS - 1);
+
+    set->hashes[way] = lookup->hash;
+    set->key_lengths[way] = lookup->len;
+
+    entry = &set->ways[way];
+    entry->value_length = result->length;
+    entry->error_offset = lookup->ctx->error_offset;
+    entry->status = lookup->ctx->status;
+
+    memcpy(entry->data, lookup->in, lookup->len);
+    memcpy(entry->data + lookup->len, result->buffer, result->length);
+}
+
+/********************************************
+* Keeps nothing, the expression and its
+* output are too long for an entry
+********************************************/
+static void store_nothing(LOOKUP* lookup, const OUTPUT* result)
+{
+}
+
+/********************************************
+* Returns 1 if the entry of the set holds
+* the expression
+* The bytes are compared only if the hash
+* and the length are the same, as memcmp()
+* of 0 bytes compares nothing
+********************************************/
+static unsigned match(const CACHE_SET* set, int way, const LOOKUP* lookup)
+{
+    int tagged = (set->hashes[way] == lookup->hash) & (set->key_lengths[way] == lookup->len);
+
+    return tagged & (memcmp(set->ways[way].data, lookup->in, lookup->len * tagged) == 0);
+}
+
+/********************************************
+* Mixes the next word of the expression into
+* the hash, the last word may be shorter
+* Returns 1 after the last word
+********************************************/
+static int  hash_step(void* arg)
+{
+    HASH* hash = arg;
+    size_t word = sizeof(uint64_t);
+    uint64_t value = 0;
+
+    /* take the minimum of left and word */
+    size_t count = hash->left ^ ((hash->left ^ word) & -(size_t)(word < hash->left));
+
+    memcpy(&value, hash->position, count);
+
+    hash->hash = (hash->hash ^ value) * 0xFF51AFD7ED558CCDull;
+    hash->hash ^= hash->hash >> 32;
+
+    hash->position += count;
+    hash->left -= count;
+
+    return hash->left == 0;
+}
@@ -0,0 +1,65 @@
+/*============================================================================================
+* Checks of acyclomatic.hpp at compile time
+*
+* The postfix forms, statuses and error offsets of the formulas below and the values of
+* the ones without '%' and '^' are checked by static_assert, so the file builds only if
+* the constexpr converter is right; the program then evaluates the formulas with '%' and
+* '^', which are not constant expressions, and exits with 1 if any value is wrong.
+*
+* Usage:
+*   make check-hpp
+*
+* Copyright 2006-2016 Mikhail Durnev (mdurnev@gmail.com). Released under the GPLv3
+============================================================================================*/
+#include <string_view>
+
+#include "acyclomatic.hpp"
+
+/* the values of the symbols a-z: a is 1, b is 2, ... */
+static constexpr double values[26] =
+{
+    1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26
+};
+
+/* formulas converted at compile time */
+static constexpr auto nested = acyclomatic::convert("a+(b+c*d)*e");
+static constexpr auto negated = acyclomatic::convert("-e+f");
+static constexpr auto powers = acyclomatic::convert("a^b^c");
+static constexpr auto modulo = acyclomatic::convert("(g+c)%d");
+static constexpr auto invalid = acyclomatic::convert("a+1");
+static constexpr auto unmatched = acyclomatic::convert("a+b)");
+static constexpr auto unclosed = acyclomatic::convert("a*(b+(c)");
+
+/* postfix forms */
+static_assert(std::string_view(nested.c_str()) == "abcd*+e*+", "a+(b+c*d)*e");
+static_assert(std::string_view(negated.c_str()) == "e~f+", "-e+f");
+static_assert(std::string_view(powers.c_str()) == "abc^^", "a^b^c");
+static_assert(std::string_view(modulo.c_str()) == "gc+d%", "(g+c)%d");
+static_assert(nested.length == 9, "length of a+(b+c*d)*e");
+
+/* statuses and error offsets, the postfix form of an error is empty */
+static_assert(nested.status == STATUS_OK, "status of a+(b+c*d)*e");
+static_assert(invalid.status == STATUS_ERROR, "status of a+1");
+static_assert(invalid.error_offset == 2, "error offset of a+1");
+static_assert(unmatched.status == STATUS_UNMATCHED_CLOSE, "status of a+b)");
+static_assert(unmatched.error_offset == 3, "error offset of a+b)");
+static_assert(unclosed.status == STATUS_UNCLOSED_OPEN, "status of a*(b+(c)");
+static_assert(unclosed.error_offset == 2, "error offset of a*(b+(c)");
+static_assert(invalid.length == 0, "length of a+1");
+static_assert(*invalid.c_str() == 0, "output of a+1");
+
+/* values of the formulas that are constant expressions */
+static_assert(acyclomatic::formula<nested>::evaluate(values) == 71, "value of a+(b+c*d)*e");
+static_assert(acyclomatic::formula<negated>::evaluate(values) == 1, "value of -e+f");
+
+/********************************************
+* Evaluates the formulas with '%' and '^'
+* Returns 1 if any value is wrong
+********************************************/
+int main()
+{
+    int wrong = (acyclomatic::formula<powers>::evaluate(values) != 1) |
+                (acyclomatic::formula<modulo>::evaluate(values) != 2);
+
+    return wrong;
+}
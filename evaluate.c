@@ -0,0 +1,1597 @@
+/*============================================================================================
+* Evaluation of the postfix form
+*
+* The postfix form is compiled once into a program with one opcode per token, then the
+* program is evaluated many times against bindings of the symbols 'a'-'z' to values,
+* either one set of bindings at a time or a batch of rows given as columns of values.
+*
+* Example:
+*   abc*+   ->   LOAD a, LOAD b, LOAD c, MUL, ADD, END
+*   ab^~    ->   LOAD a, LOAD b, POW, NEG, END
+*
+* The constants 0 and 1 left in the postfix form by the simplify mode have opcodes of their
+* own, they push the constant.
+*
+* The tree of the DAG mode is compiled with the subtrees used more than once computed
+* once: the value is saved in a slot the first time and pushed from there later.
+*
+*   (b+c)*(b+c)   ->   LOAD b, LOAD c, ADD, SAVE 1, REUSE 1, MUL, END
+*
+* A record of the packed mode has the opcodes already, packed in 5 bits each, they are
+* unpacked into the program with no tokens to read.
+*
+* The columnar evaluator runs every opcode over a block of COLUMN_ROWS rows at once: the
+* evaluation stack holds vectors of values, so the arithmetic of an opcode is a single
+* vector operation the compiler turns into SSE2, AVX2 or NEON instructions.
+*
+* Copyright 2006-2016 Mikhail Durnev (mdurnev@gmail.com). Released under the GPLv3
+============================================================================================*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "acyclomatic.h"
+
+
+/* data types */
+typedef struct COMPILER COMPILER;
+typedef struct MACHINE MACHINE;
+typedef struct BATCH BATCH;
+typedef struct LANES LANES;
+typedef struct POWER POWER;
+typedef struct RECORDS RECORDS;
+
+/* function prototypes */
+static int  compile_finish(COMPILER* compiler);
+static void compile_code(COMPILER* compiler);
+static void compile_nothing(COMPILER* compiler);
+static int  compile_step(void* arg);
+static void compile_codes(COMPILER* compiler);
+static int  record_step(void* arg);
+static int  record_complete(const COMPILER* compiler);
+static unsigned record_code(const COMPILER* compiler, size_t bit);
+static int  index_step(void* arg);
+static void compile_opcode(COMPILER* compiler, unsigned char opcode);
+static void compile_slot(COMPILER* compiler, unsigned char opcode, size_t slot);
+static void compile_nodes(COMPILER* compiler);
+static int  node_step(void* arg);
+static void node_operand(COMPILER* compiler, const NODE* node);
+static void node_operation(COMPILER* compiler, const NODE* node);
+static void node_computed(COMPILER* compiler, const NODE* node);
+static void node_reuse(COMPILER* compiler, const NODE* node);
+static void node_save(COMPILER* compiler, const NODE* node);
+static void node_unsaved(COMPILER* compiler, const NODE* node);
+static void code_grow(PROGRAM* program, size_t size);
+static void code_keep(PROGRAM* program, size_t size);
+
+static void run_program(MACHINE* machine);
+static int  run_step(void* arg);
+static void run_opcode(MACHINE* machine);
+static int  row_step(void* arg);
+
+static void op_load(MACHINE* machine);
+static void op_add(MACHINE* machine);
+static void op_sub(MACHINE* machine);
+static void op_mul(MACHINE* machine);
+static void op_div(MACHINE* machine);
+static void op_mod(MACHINE* machine);
+static void op_pow(MACHINE* machine);
+static void op_neg(MACHINE* machine);
+static void op_save(MACHINE* machine);
+static void op_reuse(MACHINE* machine);
+static void op_constant(MACHINE* machine);
+static void op_end(MACHINE* machine);
+static void rows_run(MACHINE* machine);
+static void rows_nothing(MACHINE* machine);
+static void* memory_local(void* local, size_t size, size_t alignment);
+static void* memory_heap(void* local, size_t size, size_t alignment);
+static void memory_kept(void* memory);
+
+static void evaluate_batch(BATCH* batch, const void* const* columns, size_t rows, void* results);
+static int  block_step(void* arg);
+static int  batch_step(void* arg);
+static void batch_opcode(BATCH* batch);
+
+static void batch_load(BATCH* batch);
+static void batch_save(BATCH* batch);
+static void batch_reuse(BATCH* batch);
+static void batch_constant(BATCH* batch);
+static void batch_constant_int(BATCH* batch);
+static void batch_end(BATCH* batch);
+static void batch_add(BATCH* batch);
+static void batch_sub(BATCH* batch);
+static void batch_mul(BATCH* batch);
+static void batch_div(BATCH* batch);
+static void batch_mod(BATCH* batch);
+static void batch_pow(BATCH* batch);
+static void batch_neg(BATCH* batch);
+static void batch_add_int(BATCH* batch);
+static void batch_sub_int(BATCH* batch);
+static void batch_mul_int(BATCH* batch);
+static void batch_div_int(BATCH* batch);
+static void batch_mod_int(BATCH* batch);
+static void batch_pow_int(BATCH* batch);
+static void batch_neg_int(BATCH* batch);
+static void batch_lanes(BATCH* batch, double (*function)(double x, double y));
+static int  lane_step(void* arg);
+static int  power_step(void* arg);
+
+/* data types */
+typedef void (*COMPILER_ACTION)(COMPILER* compiler);
+typedef void (*NODE_ACTION)(COMPILER* compiler, const NODE* node);
+typedef void (*CODE_ACTION)(PROGRAM* program, size_t size);
+typedef void (*OPCODE_ACTION)(MACHINE* machine);
+typedef void (*BATCH_ACTION)(BATCH* batch);
+typedef void* (*MEMORY_ACTION)(void* local, size_t size, size_t alignment);
+typedef void (*RELEASE_ACTION)(void* memory);
+
+/* state of the compilation */
+struct COMPILER
+{
+    PROGRAM* program;
+    const char* position;   /* next token of the postfix form */
+    const char* end;        /* end of the postfix form */
+    size_t index;           /* index of the next opcode */
+    long depth;             /* depth of the evaluation stack after the tokens so far */
+    long max_depth;
+    int valid;              /* 0 once a token is invalid or has too few operands */
+    const NODE* root;       /* tree compiled, or 0 */
+    const NODE** pending;   /* nodes left to compile, the last one is compiled next */
+    size_t count;           /* number of pending nodes */
+    unsigned char* saved;   /* 1 for the slots saved so far */
+    size_t bit;             /* next bit of the codes of a record */
+};
+
+/* state of the evaluation */
+struct MACHINE
+{
+    const unsigned char* pc;            /* next opcode */
+    double* top;                        /* top of the evaluation stack */
+    const double* const* columns;       /* values of the symbols by columns */
+    size_t row;                         /* row of the values */
+    size_t rows;                        /* number of rows */
+    double* results;                    /* results by rows */
+    const PROGRAM* program;
+    double* stack;                      /* bottom of the evaluation stack */
+    double* saved;                      /* values saved for reuse by slots */
+    int done;                           /* 1 when the end of the program is reached */
+};
+
+
+/* constants */
+
+/* number of rows the columnar evaluator runs every opcode over */
+#define COLUMN_ROWS 32
+
+/* values of the evaluation stack and of the slots kept in the C stack, a deeper */
+/* program has them in the heap, so the C stack does not grow with the program   */
+#define MACHINE_LOCAL 64
+
+/* the same for the columnar evaluation, a slot holds COLUMN_ROWS values */
+#define BATCH_LOCAL 16
+
+/* the machine runs opcodes by blocks of this size, see run_step() */
+#define RUN_UNROLL 8
+
+/* number of bits of the integer exponents */
+#define POWER_BITS 64
+
+/* bytes of code compiled for a node of the tree at most, an operation saved */
+/* and both of its operands pushed again from their slots, as a simplified  */
+/* tree may use a subtree more times than there are nodes built for it      */
+#define NODE_CODE (1 + 1 + OPCODE_SLOT_BYTES + 2 * (1 + OPCODE_SLOT_BYTES))
+
+/* index in node call table for the operation below when its operands are done, */
+/* and for a shared subtree saved before                                         */
+#define NODE_COMPUTED 3
+#define NODE_REUSE 4
+
+/* the pending operation below it is computed next, see node_operation() */
+static const NODE operation_mark = { .token = "", .arity = NODE_COMPUTED };
+
+
+/* data types */
+typedef double DOUBLES __attribute__((vector_size(COLUMN_ROWS * sizeof(double))));
+typedef int64_t INTEGERS __attribute__((vector_size(COLUMN_ROWS * sizeof(int64_t))));
+typedef uint64_t UNSIGNEDS __attribute__((vector_size(COLUMN_ROWS * sizeof(uint64_t))));
+
+/* slot of the columnar evaluation stack, a value for every row of the block */
+typedef union SLOT
+{
+    DOUBLES doubles;
+    INTEGERS integers;
+    UNSIGNEDS unsigneds;
+} SLOT;
+
+/* state of the columnar evaluation */
+struct BATCH
+{
+    const unsigned char* pc;            /* next opcode */
+    SLOT* top;                          /* top of the evaluation stack */
+    const char* const* columns;         /* values of the symbols by columns */
+    size_t row;                         /* first row of the block */
+    size_t rows;                        /* number of rows */
+    size_t count;                       /* number of rows in the block */
+    char* results;                      /* results by rows */
+    const PROGRAM* program;
+    const BATCH_ACTION* actions;        /* opcode call table for the type of the values */
+    SLOT* stack;                        /* bottom of the evaluation stack */
+    SLOT* saved;                        /* values saved for reuse by slots */
+    int done;                           /* 1 when the end of the program is reached */
+};
+
+
+/* state of applying a scalar function to every row of two columns */
+struct LANES
+{
+    SLOT* x;                            /* first arguments, replaced with the results */
+    const SLOT* y;                      /* second arguments */
+    double (*function)(double x, double y);
+    size_t lane;                        /* next row of the block */
+};
+
+/* state of the integer exponentiation by squaring */
+struct POWER
+{
+    UNSIGNEDS result;
+    UNSIGNEDS base;
+    UNSIGNEDS exponent;                 /* bits of the exponents left */
+    int bits;                           /* number of bits done */
+};
+
+/* state of indexing the records */
+struct RECORDS
+{
+    const char* records;
+    size_t length;                      /* bytes of the records */
+    uint64_t offset;                    /* offset of the next record */
+    OUTPUT* index;
+    size_t count;                       /* number of records indexed */
+};
+
+
+/* function arrays */
+
+/* compilation call table, indexed by the postfix form being empty */
+static const COMPILER_ACTION compile_call_table[] =
+{
+    compile_code,
+    compile_nothing
+};
+
+/* record compilation call table, indexed by the record having tokens */
+static const COMPILER_ACTION record_call_table[] =
+{
+    compile_nothing,
+    compile_codes
+};
+
+/* tree compilation call table, indexed by having no tree */
+static const COMPILER_ACTION tree_call_table[] =
+{
+    compile_nodes,
+    compile_nothing
+};
+
+/* node call table, indexed by the arity of the node, or NODE_COMPUTED, or NODE_REUSE */
+static const NODE_ACTION node_call_table[] =
+{
+    node_operand,
+    node_operation,
+    node_operation,
+    node_computed,
+    node_reuse
+};
+
+/* save call table, indexed by the operation being shared */
+static const NODE_ACTION save_call_table[] =
+{
+    node_unsaved,
+    node_save
+};
+
+/* code reserve call table, indexed by the code buffer being too small */
+static const CODE_ACTION code_call_table[] =
+{
+    code_keep,
+    code_grow
+};
+
+/* opcode call table, indexed by opcodes */
+static const OPCODE_ACTION opcode_call_table[] =
+{
+    op_load, op_load, op_load, op_load, op_load, op_load, op_load, op_load, op_load,
+    op_load, op_load, op_load, op_load, op_load, op_load, op_load, op_load, op_load,
+    op_load, op_load, op_load, op_load, op_load, op_load, op_load, op_load,
+    op_add,
+    op_sub,
+    op_mul,
+    op_div,
+    op_mod,
+    op_pow,
+    op_neg,
+    op_save,
+    op_reuse,
+    op_constant,
+    op_constant,
+    op_end
+};
+
+/* columnar opcode call tables for doubles and for integers, indexed by opcodes */
+static const BATCH_ACTION batch_call_table[] =
+{
+    batch_load, batch_load, batch_load, batch_load, batch_load, batch_load, batch_load,
+    batch_load, batch_load, batch_load, batch_load, batch_load, batch_load, batch_load,
+    batch_load, batch_load, batch_load, batch_load, batch_load, batch_load, batch_load,
+    batch_load, batch_load, batch_load, batch_load, batch_load,
+    batch_add,
+    batch_sub,
+    batch_mul,
+    batch_div,
+    batch_mod,
+    batch_pow,
+    batch_neg,
+    batch_save,
+    batch_reuse,
+    batch_constant,
+    batch_constant,
+    batch_end
+};
+
+static const BATCH_ACTION batch_int_call_table[] =
+{
+    batch_load, batch_load, batch_load, batch_load, batch_load, batch_load, batch_load,
+    batch_load, batch_load, batch_load, batch_load, batch_load, batch_load, batch_load,
+    batch_load, batch_load, batch_load, batch_load, batch_load, batch_load, batch_load,
+    batch_load, batch_load, batch_load, batch_load, batch_load,
+    batch_add_int,
+    batch_sub_int,
+    batch_mul_int,
+    batch_div_int,
+    batch_mod_int,
+    batch_pow_int,
+    batch_neg_int,
+    batch_save,
+    batch_reuse,
+    batch_constant_int,
+    batch_constant_int,
+    batch_end
+};
+
+/* row evaluation call table, indexed by having no rows */
+static const OPCODE_ACTION rows_call_table[] =
+{
+    rows_run,
+    rows_nothing
+};
+
+/* evaluation memory call table, indexed by the memory being too large for the C stack */
+static const MEMORY_ACTION memory_call_table[] =
+{
+    memory_local,
+    memory_heap
+};
+
+/* evaluation memory release call table, indexed by the memory being in the heap */
+static const RELEASE_ACTION release_call_table[] =
+{
+    memory_kept,
+    free
+};
+
+/* opcodes of the postfix tokens, OPCODE_INVALID for anything else */
+static const unsigned char opcode_table[256] =
+{
+    38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38,  /* 00-0F */
+    38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38,  /* 10-1F */
+    38, 38, 38, 38, 38, 30, 38, 38, 38, 38, 28, 26, 38, 27, 38, 29,  /* 20-2F */
+    35, 36, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38,  /* 30-3F */
+    38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38,  /* 40-4F */
+    38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 31, 38,  /* 50-5F */
+    38,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,  /* 60-6F */
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 38, 38, 38, 32, 38,  /* 70-7F */
+    38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38,  /* 80-8F */
+    38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38,  /* 90-9F */
+    38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38,  /* A0-AF */
+    38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38,  /* B0-BF */
+    38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38,  /* C0-CF */
+    38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38,  /* D0-DF */
+    38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38,  /* E0-EF */
+    38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38, 38   /* F0-FF */
+};
+
+/* change of the stack depth made by every opcode, indexed by opcodes */
+static const signed char effect_table[] =
+{
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    -1, -1, -1, -1,     /* + - * / */
+    -1, -1,             /* % ^ */
+    0,                  /* ~ */
+    0,                  /* save */
+    1,                  /* reuse */
+    1, 1,               /* 0 1 */
+    0,                  /* end */
+    0                   /* invalid */
+};
+
+
+/********************************************
+* Compiles the postfix form into the program
+* Returns the compilation status
+********************************************/
+int  compile_program(PROGRAM* program, const char* postfix, size_t length)
+{
+    COMPILER compiler;
+
+    /* one more opcode for the end of the program */
+    code_call_table[length >= program->capacity](program, length + 1);
+
+    compiler.program = program;
+    compiler.position = postfix;
+    compiler.end = postfix + length;
+    compiler.index = 0;
+    compiler.depth = 0;
+    compiler.max_depth = 0;
+    compiler.valid = 1;
+
+    compile_call_table[length == 0](&compiler);
+
+    program->slots = 0;
+
+    return compile_finish(&compiler);
+}
+
+/********************************************
+* Unpacks the opcodes of the record into the
+* program, they are checked as the ones of
+* the postfix form
+* Returns the compilation status
+********************************************/
+int  compile_record(PROGRAM* program, const char* record, size_t length)
+{
+    COMPILER compiler;
+    uint32_t header = 0;
+    int whole = (length >= RECORD_HEADER);
+    size_t size;
+    size_t tokens;
+
+    memcpy(&header, record, RECORD_HEADER * whole);
+
+    /* the codes are in the record, the record of an error has none */
+    size = header >> RECORD_STATUS_BITS;
+    size *= whole & (size <= length - RECORD_HEADER) & ((header & ((1u << RECORD_STATUS_BITS) - 1)) == STATUS_OK);
+
+    compiler.program = program;
+    compiler.position = record + RECORD_HEADER * whole;
+    compiler.end = compiler.position + size;
+    compiler.index = 0;
+    compiler.depth = 0;
+    compiler.max_depth = 0;
+    compiler.valid = 1;
+    compiler.bit = 0;
+
+    /* a token takes one code at least, one more opcode for the end of the program */
+    tokens = size * 8 / RECORD_CODE_BITS;
+    code_call_table[tokens >= program->capacity](program, tokens + 1);
+
+    record_call_table[record_complete(&compiler)](&compiler);
+
+    program->slots = 0;
+
+    return compile_finish(&compiler);
+}
+
+/********************************************
+* Writes the offset of every complete record
+* to the index
+* Returns the number of records
+********************************************/
+size_t index_records(const char* records, size_t length, OUTPUT* index)
+{
+    RECORDS indexing;
+
+    indexing.records = records;
+    indexing.length = length;
+    indexing.offset = 0;
+    indexing.index = index;
+    indexing.count = 0;
+
+    iterate(index_step, &indexing);
+
+    return indexing.count;
+}
+
+/********************************************
+* Compiles the tree of the last conversion
+* into the program, the subtrees shared in
+* the DAG mode are computed once
+* Returns the compilation status
+********************************************/
+int  compile_tree(PROGRAM* program, const CONTEXT* ctx)
+{
+    COMPILER compiler;
+    int status;
+
+    /* every node of the arena is compiled once at most, the arena is stale */
+    /* or not there if there is no tree                                      */
+    size_t count = (size_t)(ctx->node_next - ctx->nodes) * (ctx->root != 0);
+
+    /* one more opcode for the end of the program */
+    code_call_table[count * NODE_CODE >= program->capacity](program, count * NODE_CODE + 1);
+
+    compiler.program = program;
+    compiler.index = 0;
+    compiler.depth = 0;
+    compiler.max_depth = 0;
+    compiler.valid = 1;
+    compiler.root = ctx->root;
+
+    /* an operation leaves 4 nodes pending for 1 compiled */
+    compiler.pending = malloc((count * 3 + 1) * sizeof(const NODE*));
+    compiler.saved = calloc(ctx->slots + 1, 1);
+    check_allocation(compiler.pending);
+    check_allocation(compiler.saved);
+
+    tree_call_table[ctx->root == 0](&compiler);
+
+    program->slots = ctx->slots;
+    status = compile_finish(&compiler);
+
+    free(compiler.pending);
+    free(compiler.saved);
+
+    return status;
+}
+
+/********************************************
+* Ends the program, an invalid one is made
+* to end at once
+* Returns the compilation status
+********************************************/
+static int  compile_finish(COMPILER* compiler)
+{
+    PROGRAM* program = compiler->program;
+    unsigned char first[2];
+    size_t lengths[2];
+    size_t depths[2];
+
+    program->code[compiler->index] = OPCODE_END;
+    program->length = compiler->index + 1;
+    program->depth = compiler->max_depth;
+
+    /* a valid program leaves exactly one value in the stack */
+    compiler->valid &= (compiler->depth == 1);
+
+    /* an invalid program is replaced with one that just ends, so it is safe to run */
+    first[0] = OPCODE_END;
+    first[1] = program->code[0];
+    program->code[0] = first[compiler->valid];
+
+    lengths[0] = 1;
+    lengths[1] = program->length;
+    program->length = lengths[compiler->valid];
+
+    depths[0] = 0;
+    depths[1] = program->depth;
+    program->depth = depths[compiler->valid];
+
+    return STATUS_ERROR * (compiler->valid ^ 1);
+}
+
+/********************************************
+* Deallocates the program
+********************************************/
+void free_program(PROGRAM* program)
+{
+    free(program->code);
+
+    program->code = 0;
+    program->capacity = 0;
+    program->length = 0;
+    program->depth = 0;
+    program->slots = 0;
+}
+
+/********************************************
+* Evaluates the program with the values of
+* the symbols 'a'-'z' given by bindings
+********************************************/
+double evaluate(const PROGRAM* program, const double* bindings)
+{
+    const double* columns[SYMBOL_COUNT] =
+    {
+        bindings + 0,  bindings + 1,  bindings + 2,  bindings + 3,  bindings + 4,
+        bindings + 5,  bindings + 6,  bindings + 7,  bindings + 8,  bindings + 9,
+        bindings + 10, bindings + 11, bindings + 12, bindings + 13, bindings + 14,
+        bindings + 15, bindings + 16, bindings + 17, bindings + 18, bindings + 19,
+        bindings + 20, bindings + 21, bindings + 22, bindings + 23, bindings + 24,
+        bindings + 25
+    };
+    double result;
+
+    evaluate_rows(program, columns, 1, &result);
+
+    return result;
+}
+
+/********************************************
+* Evaluates the program for rows of values
+* of the symbols 'a'-'z' given by columns,
+* columns[i][row] is the value of 'a' + i
+********************************************/
+void evaluate_rows(const PROGRAM* program, const double* const* columns, size_t rows, double* results)
+{
+    MACHINE machine;
+    double local[MACHINE_LOCAL];
+    size_t count = program->depth + 1 + program->slots + 1;
+    int heap = (count > MACHINE_LOCAL);
+    double* stack = memory_call_table[heap](local, count * sizeof(double), _Alignof(double));
+
+    machine.saved = stack + program->depth + 1;
+    machine.columns = columns;
+    machine.row = 0;
+    machine.rows = rows;
+    machine.results = results;
+    machine.program = program;
+    machine.stack = stack;
+
+    rows_call_table[rows == 0](&machine);
+
+    release_call_table[heap](stack);
+}
+
+/********************************************
+* Evaluates the program for rows of values
+* of the symbols 'a'-'z' given by columns,
+* COLUMN_ROWS rows at once
+********************************************/
+void evaluate_columns(const PROGRAM* program, const double* const* columns, size_t rows, double* results)
+{
+    BATCH batch;
+    SLOT local[BATCH_LOCAL];
+    size_t count = program->depth + 1 + program->slots + 1;
+    int heap = (count > BATCH_LOCAL);
+    SLOT* stack = memory_call_table[heap](local, count * sizeof(SLOT), _Alignof(SLOT));
+
+    batch.program = program;
+    batch.actions = batch_call_table;
+    batch.stack = stack;
+    batch.saved = stack + program->depth + 1;
+
+    evaluate_batch(&batch, (const void* const*)columns, rows, results);
+
+    release_call_table[heap](stack);
+}
+
+/********************************************
+* Evaluates the program for rows of integer
+* values of the symbols 'a'-'z' given by
+* columns, COLUMN_ROWS rows at once
+* Arithmetic wraps around, division by zero
+* gives 0
+********************************************/
+void evaluate_columns_int64(const PROGRAM* program, const int64_t* const* columns, size_t rows, int64_t* results)
+{
+    BATCH batch;
+    SLOT local[BATCH_LOCAL];
+    size_t count = program->depth + 1 + program->slots + 1;
+    int heap = (count > BATCH_LOCAL);
+    SLOT* stack = memory_call_table[heap](local, count * sizeof(SLOT), _Alignof(SLOT));
+
+    batch.program = program;
+    batch.actions = batch_int_call_table;
+    batch.stack = stack;
+    batch.saved = stack + program->depth + 1;
+
+    evaluate_batch(&batch, (const void* const*)columns, rows, results);
+
+    release_call_table[heap](stack);
+}
+
+/********************************************
+* Compiles all the tokens
+********************************************/
+static void compile_code(COMPILER* compiler)
+{
+    iterate(compile_step, compiler);
+}
+
+/********************************************
+* Compiles nothing, the program is invalid
+********************************************/
+static void compile_nothing(COMPILER* compiler)
+{
+}
+
+/********************************************
+* Compiles the next token
+* Returns 1 at the end of the postfix form
+********************************************/
+static int  compile_step(void* arg)
+{
+    COMPILER* compiler = arg;
+
+    compile_opcode(compiler, opcode_table[(unsigned char)*compiler->position]);
+
+    ++compiler->position;
+
+    return compiler->position == compiler->end;
+}
+
+/********************************************
+* Compiles the codes of the record
+********************************************/
+static void compile_codes(COMPILER* compiler)
+{
+    iterate(record_step, compiler);
+}
+
+/********************************************
+* Compiles the next token of the record, the
+* escape code takes the next code too
+* Returns 1 after the last token
+********************************************/
+static int  record_step(void* arg)
+{
+    COMPILER* compiler = arg;
+    unsigned code = record_code(compiler, compiler->bit);
+    int escaped = (code == RECORD_ESCAPE);
+    unsigned opcode = code + record_code(compiler, compiler->bit + RECORD_CODE_BITS) * escaped;
+
+    /* the escape code only goes with the opcodes up to OPCODE_NEG */
+    opcode ^= (opcode ^ OPCODE_INVALID) & -(unsigned)(opcode > OPCODE_NEG);
+
+    compiler->bit += RECORD_CODE_BITS << escaped;
+
+    compile_opcode(compiler, opcode);
+
+    return record_complete(compiler) ^ 1;
+}
+
+/********************************************
+* Returns 1 if the token at the next bit has
+* all its codes in the record, the bits after
+* the last token are less than a code or an
+* escape code alone
+********************************************/
+static int  record_complete(const COMPILER* compiler)
+{
+    size_t bits = (size_t)(compiler->end - compiler->position) * 8;
+    int escaped = (record_code(compiler, compiler->bit) == RECORD_ESCAPE);
+
+    return compiler->bit + (RECORD_CODE_BITS << escaped) <= bits;
+}
+
+/********************************************
+* Returns the code at the bit of the codes,
+* the bits past the end of the record are 0
+********************************************/
+static unsigned record_code(const COMPILER* compiler, size_t bit)
+{
+    size_t size = compiler->end - compiler->position;
+    size_t byte = bit / 8;
+    size_t left = (size - byte) * (byte < size);
+    unsigned char bytes[2] = { 0, 0 };
+
+    /* a code spans two bytes at most, take the minimum of left and 2 */
+    memcpy(bytes, compiler->position + byte * (left != 0), left ^ ((left ^ 2) & -(size_t)(2 < left)));
+
+    return ((bytes[0] | bytes[1] << 8) >> (bit % 8)) & ((1u << RECORD_CODE_BITS) - 1);
+}
+
+/********************************************
+* Indexes the next record if it is complete
+* Returns 1 after the last complete record
+********************************************/
+static int  index_step(void* arg)
+{
+    RECORDS* indexing = arg;
+    size_t left = indexing->length - indexing->offset;
+    uint32_t length = 0;
+    int whole = (left >= RECORD_HEADER);
+
+    memcpy(&length, indexing->records + indexing->offset, sizeof(length) * whole);
+    length >>= RECORD_STATUS_BITS;
+    whole &= (length <= left - RECORD_HEADER);
+
+    output_string(indexing->index, (const char*)&indexing->offset, sizeof(indexing->offset) * whole);
+    indexing->count += whole;
+    indexing->offset += (RECORD_HEADER + (uint64_t)length) * whole;
+
+    return (whole ^ 1) | (indexing->offset == indexing->length);
+}
+
+/********************************************
+* Adds the opcode to the program and checks
+* that it has its operands
+********************************************/
+static void compile_opcode(COMPILER* compiler, unsigned char opcode)
+{
+    long more;
+
+    compiler->program->code[compiler->index++] = opcode;
+
+    compiler->depth += effect_table[opcode];
+    compiler->valid &= (compiler->depth >= 1) & (opcode != OPCODE_INVALID);
+
+    /* take the maximum of depths */
+    more = (compiler->depth > compiler->max_depth);
+    compiler->max_depth += (compiler->depth - compiler->max_depth) * more;
+}
+
+/********************************************
+* Adds the opcode with its slot
+********************************************/
+static void compile_slot(COMPILER* compiler, unsigned char opcode, size_t slot)
+{
+    uint32_t bytes = (uint32_t)slot;
+
+    compile_opcode(compiler, opcode);
+
+    memcpy(compiler->program->code + compiler->index, &bytes, OPCODE_SLOT_BYTES);
+    compiler->index += OPCODE_SLOT_BYTES;
+}
+
+/********************************************
+* Compiles all the nodes of the tree, the
+* pending nodes are kept in a stack of their
+* own, so the depth of the tree does not
+* matter
+********************************************/
+static void compile_nodes(COMPILER* compiler)
+{
+    compiler->pending[0] = compiler->root;
+    compiler->count = 1;
+
+    iterate(node_step, compiler);
+}
+
+/********************************************
+* Compiles the next pending node
+* Returns 1 when there is nothing to compile
+********************************************/
+static int  node_step(void* arg)
+{
+    COMPILER* compiler = arg;
+    const NODE* node = compiler->pending[--compiler->count];
+    int reused = compiler->saved[node->slot];
+
+    node_call_table[node->arity + (NODE_REUSE - node->arity) * reused](compiler, node);
+
+    return compiler->count == 0;
+}
+
+/********************************************
+* Compiles an operand, only the symbols a-z
+* and the constants 0 and 1 are valid ones
+********************************************/
+static void node_operand(COMPILER* compiler, const NODE* node)
+{
+    unsigned char opcodes[2] = { OPCODE_INVALID, opcode_table[(unsigned char)node->token[0]] };
+    unsigned char opcode = opcodes[node->length == 1];
+
+    compiler->valid &= (opcode < SYMBOL_COUNT) | check_interval(opcode, OPCODE_ZERO, OPCODE_ONE);
+
+    compile_opcode(compiler, opcode);
+}
+
+/********************************************
+* Leaves the operation pending until its
+* operands are compiled, the left one first
+********************************************/
+static void node_operation(COMPILER* compiler, const NODE* node)
+{
+    int binary = node->arity - 1;
+
+    /* the left operand is compiled first, so it is pushed last, and the */
+    /* right one of the unary minus is overwritten by the left one       */
+    compiler->pending[compiler->count++] = node;
+    compiler->pending[compiler->count++] = &operation_mark;
+    compiler->pending[compiler->count] = node->right;
+    compiler->count += binary;
+    compiler->pending[compiler->count++] = node->left;
+}
+
+/********************************************
+* Compiles the operation below the mark, its
+* operands are done, and saves its value if
+* it is shared
+********************************************/
+static void node_computed(COMPILER* compiler, const NODE* mark)
+{
+    const NODE* node = compiler->pending[--compiler->count];
+
+    compile_opcode(compiler, opcode_table[(unsigned char)node->operation]);
+
+    save_call_table[node->slot != 0](compiler, node);
+}
+
+/********************************************
+* Pushes the value of a shared subtree saved
+* before
+********************************************/
+static void node_reuse(COMPILER* compiler, const NODE* node)
+{
+    compile_slot(compiler, OPCODE_REUSE, node->slot);
+}
+
+/********************************************
+* Saves the value of a shared subtree
+********************************************/
+static void node_save(COMPILER* compiler, const NODE* node)
+{
+    compile_slot(compiler, OPCODE_SAVE, node->slot);
+
+    compiler->saved[node->slot] = 1;
+}
+
+/********************************************
+* Saves nothing, the subtree is used once
+********************************************/
+static void node_unsaved(COMPILER* compiler, const NODE* node)
+{
+}
+
+/********************************************
+* Grows the code buffer to hold at least
+* size opcodes
+********************************************/
+static void code_grow(PROGRAM* program, size_t size)
+{
+    size_t doubled = program->capacity * 2;
+
+    /* take the maximum of doubled and size */
+    program->capacity = doubled ^ ((doubled ^ size) & -(size_t)(doubled < size));
+
+    free(program->code);
+    program->code = malloc(program->capacity);
+    check_allocation(program->code);
+}
+
+/********************************************
+* Keeps the code buffer as is
+********************************************/
+static void code_keep(PROGRAM* program, size_t size)
+{
+}
+
+/********************************************
+* Evaluates the program for all the rows
+********************************************/
+static void rows_run(MACHINE* machine)
+{
+    iterate(row_step, machine);
+}
+
+/********************************************
+* Evaluates nothing, there are no rows
+********************************************/
+static void rows_nothing(MACHINE* machine)
+{
+}
+
+/********************************************
+* Takes the evaluation memory from the C
+* stack
+* Returns the memory
+********************************************/
+static void* memory_local(void* local, size_t size, size_t alignment)
+{
+    return local;
+}
+
+/********************************************
+* Allocates the evaluation memory too large
+* for the C stack
+* Returns the memory
+********************************************/
+static void* memory_heap(void* local, size_t size, size_t alignment)
+{
+    void* memory = aligned_alloc(alignment, size);
+
+    check_allocation(memory);
+
+    return memory;
+}
+
+/********************************************
+* Keeps the evaluation memory of the C stack
+********************************************/
+static void memory_kept(void* memory)
+{
+}
+
+/********************************************
+* Evaluates the program for the next row
+* Returns 1 when all the rows are done
+********************************************/
+static int  row_step(void* arg)
+{
+    MACHINE* machine = arg;
+
+    run_program(machine);
+
+    machine->results[machine->row] = *machine->top;
+    ++machine->row;
+
+    return machine->row >= machine->rows;
+}
+
+/********************************************
+* Runs the program from the beginning
+********************************************/
+static void run_program(MACHINE* machine)
+{
+    machine->pc = machine->program->code;
+    machine->top = machine->stack;
+    machine->done = 0;
+
+    /* the result of a program that just ends */
+    machine->stack[0] = 0;
+
+    iterate(run_step, machine);
+}
+
+/********************************************
+* Runs RUN_UNROLL opcodes, the end opcode
+* stays in place, so running past the end of
+* the program does nothing
+* Returns 1 at the end of the program
+********************************************/
+static int  run_step(void* arg)
+{
+    MACHINE* machine = arg;
+
+    run_opcode(machine);
+    run_opcode(machine);
+    run_opcode(machine);
+    run_opcode(machine);
+    run_opcode(machine);
+    run_opcode(machine);
+    run_opcode(machine);
+    run_opcode(machine);
+
+    return machine->done;
+}
+
+/********************************************
+* Runs the next opcode
+********************************************/
+static void run_opcode(MACHINE* machine)
+{
+    opcode_call_table[*machine->pc](machine);
+}
+
+/********************************************
+* Pushes the value of a symbol
+********************************************/
+static void op_load(MACHINE* machine)
+{
+    *++machine->top = machine->columns[*machine->pc][machine->row];
+
+    ++machine->pc;
+}
+
+/********************************************
+* Adds two values at the top of the stack
+********************************************/
+static void op_add(MACHINE* machine)
+{
+    machine->top[-1] += machine->top[0];
+    --machine->top;
+
+    ++machine->pc;
+}
+
+/********************************************
+* Subtracts the top of the stack from the
+* value below it
+********************************************/
+static void op_sub(MACHINE* machine)
+{
+    machine->top[-1] -= machine->top[0];
+    --machine->top;
+
+    ++machine->pc;
+}
+
+/********************************************
+* Multiplies two values at the top of the
+* stack
+********************************************/
+static void op_mul(MACHINE* machine)
+{
+    machine->top[-1] *= machine->top[0];
+    --machine->top;
+
+    ++machine->pc;
+}
+
+/********************************************
+* Divides the value below the top of the
+* stack by the top
+********************************************/
+static void op_div(MACHINE* machine)
+{
+    machine->top[-1] /= machine->top[0];
+    --machine->top;
+
+    ++machine->pc;
+}
+
+/********************************************
+* Takes the remainder of the value below the
+* top of the stack divided by the top, with
+* the sign of the dividend
+********************************************/
+static void op_mod(MACHINE* machine)
+{
+    machine->top[-1] = fmod(machine->top[-1], machine->top[0]);
+    --machine->top;
+
+    ++machine->pc;
+}
+
+/********************************************
+* Raises the value below the top of the
+* stack to the power of the top
+********************************************/
+static void op_pow(MACHINE* machine)
+{
+    machine->top[-1] = pow(machine->top[-1], machine->top[0]);
+    --machine->top;
+
+    ++machine->pc;
+}
+
+/********************************************
+* Negates the value at the top of the stack
+********************************************/
+static void op_neg(MACHINE* machine)
+{
+    machine->top[0] = -machine->top[0];
+
+    ++machine->pc;
+}
+
+/********************************************
+* Saves the value at the top of the stack in
+* the slot following the opcode
+********************************************/
+static void op_save(MACHINE* machine)
+{
+    uint32_t slot;
+
+    memcpy(&slot, machine->pc + 1, OPCODE_SLOT_BYTES);
+    machine->saved[slot] = *machine->top;
+
+    machine->pc += 1 + OPCODE_SLOT_BYTES;
+}
+
+/********************************************
+* Pushes the value saved in the slot
+* following the opcode
+********************************************/
+static void op_reuse(MACHINE* machine)
+{
+    uint32_t slot;
+
+    memcpy(&slot, machine->pc + 1, OPCODE_SLOT_BYTES);
+    *++machine->top = machine->saved[slot];
+
+    machine->pc += 1 + OPCODE_SLOT_BYTES;
+}
+
+/********************************************
+* Pushes the constant 0 or 1 of the opcode
+********************************************/
+static void op_constant(MACHINE* machine)
+{
+    *++machine->top = *machine->pc - OPCODE_ZERO;
+
+    ++machine->pc;
+}
+
+/********************************************
+* Ends the program, the program counter
+* stays here
+********************************************/
+static void op_end(MACHINE* machine)
+{
+    machine->done = 1;
+}
+
+/********************************************
+* Evaluates the program for all the rows,
+* block by block
+********************************************/
+static void evaluate_batch(BATCH* batch, const void* const* columns, size_t rows, void* results)
+{
+    batch->columns = (const char* const*)columns;
+    batch->rows = rows;
+    batch->results = results;
+    batch->row = 0;
+
+    /* the rows past the end of the last block are never loaded, keep them defined */
+    memset(batch->stack, 0, (batch->program->depth + 1) * sizeof(SLOT));
+
+    iterate(block_step, batch);
+}
+
+/********************************************
+* Evaluates the program for the next block
+* of rows
+* Returns 1 when all the rows are done
+********************************************/
+static int  block_step(void* arg)
+{
+    BATCH* batch = arg;
+    size_t left = batch->rows - batch->row;
+    size_t block = COLUMN_ROWS;
+
+    /* take the minimum of left and block, the last block may be shorter */
+    batch->count = left ^ ((left ^ block) & -(size_t)(block < left));
+
+    batch->pc = batch->program->code;
+    batch->top = batch->stack;
+    batch->done = 0;
+
+    iterate(batch_step, batch);
+
+    memcpy(batch->results + batch->row * sizeof(double), batch->top, batch->count * sizeof(double));
+    batch->row += batch->count;
+
+    return batch->row >= batch->rows;
+}
+
+/********************************************
+* Runs RUN_UNROLL opcodes over the block
+* Returns 1 at the end of the program
+********************************************/
+static int  batch_step(void* arg)
+{
+    BATCH* batch = arg;
+
+    batch_opcode(batch);
+    batch_opcode(batch);
+    batch_opcode(batch);
+    batch_opcode(batch);
+    batch_opcode(batch);
+    batch_opcode(batch);
+    batch_opcode(batch);
+    batch_opcode(batch);
+
+    return batch->done;
+}
+
+/********************************************
+* Runs the next opcode over the block
+********************************************/
+static void batch_opcode(BATCH* batch)
+{
+    batch->actions[*batch->pc](batch);
+}
+
+/********************************************
+* Pushes the values of a symbol for the block
+* (doubles and integers are both 8 bytes)
+********************************************/
+static void batch_load(BATCH* batch)
+{
+    ++batch->top;
+    memcpy(batch->top, batch->columns[*batch->pc] + batch->row * sizeof(double),
+           batch->count * sizeof(double));
+
+    ++batch->pc;
+}
+
+/********************************************
+* Saves the column at the top of the stack in
+* the slot following the opcode
+********************************************/
+static void batch_save(BATCH* batch)
+{
+    uint32_t slot;
+
+    memcpy(&slot, batch->pc + 1, OPCODE_SLOT_BYTES);
+    batch->saved[slot] = *batch->top;
+
+    batch->pc += 1 + OPCODE_SLOT_BYTES;
+}
+
+/********************************************
+* Pushes the column saved in the slot
+* following the opcode
+********************************************/
+static void batch_reuse(BATCH* batch)
+{
+    uint32_t slot;
+
+    memcpy(&slot, batch->pc + 1, OPCODE_SLOT_BYTES);
+    *++batch->top = batch->saved[slot];
+
+    batch->pc += 1 + OPCODE_SLOT_BYTES;
+}
+
+/********************************************
+* Pushes the constant 0 or 1 of the opcode
+* for the block, as doubles
+********************************************/
+static void batch_constant(BATCH* batch)
+{
+    ++batch->top;
+    batch->top->doubles = (DOUBLES){ 0 } + (double)(*batch->pc - OPCODE_ZERO);
+
+    ++batch->pc;
+}
+
+/********************************************
+* The same as integers
+********************************************/
+static void batch_constant_int(BATCH* batch)
+{
+    ++batch->top;
+    batch->top->integers = (INTEGERS){ 0 } + (int64_t)(*batch->pc - OPCODE_ZERO);
+
+    ++batch->pc;
+}
+
+/********************************************
+* Ends the program, the program counter
+* stays here
+********************************************/
+static void batch_end(BATCH* batch)
+{
+    batch->done = 1;
+}
+
+/********************************************
+* Adds two columns at the top of the stack
+********************************************/
+static void batch_add(BATCH* batch)
+{
+    batch->top[-1].doubles += batch->top[0].doubles;
+    --batch->top;
+
+    ++batch->pc;
+}
+
+/********************************************
+* Subtracts the top column from the one below
+********************************************/
+static void batch_sub(BATCH* batch)
+{
+    batch->top[-1].doubles -= batch->top[0].doubles;
+    --batch->top;
+
+    ++batch->pc;
+}
+
+/********************************************
+* Multiplies two columns at the top of the
+* stack
+********************************************/
+static void batch_mul(BATCH* batch)
+{
+    batch->top[-1].doubles *= batch->top[0].doubles;
+    --batch->top;
+
+    ++batch->pc;
+}
+
+/********************************************
+* Divides the column below the top by the top
+********************************************/
+static void batch_div(BATCH* batch)
+{
+    batch->top[-1].doubles /= batch->top[0].doubles;
+    --batch->top;
+
+    ++batch->pc;
+}
+
+/********************************************
+* Takes the remainders of the column below
+* the top divided by the top
+********************************************/
+static void batch_mod(BATCH* batch)
+{
+    batch_lanes(batch, fmod);
+}
+
+/********************************************
+* Raises the column below the top to the
+* powers of the top
+********************************************/
+static void batch_pow(BATCH* batch)
+{
+    batch_lanes(batch, pow);
+}
+
+/********************************************
+* Negates the column at the top of the stack
+********************************************/
+static void batch_neg(BATCH* batch)
+{
+    batch->top[0].doubles = -batch->top[0].doubles;
+
+    ++batch->pc;
+}
+
+/********************************************
+* Applies the function to the rows of two
+* columns at the top of the stack, one row
+* at a time, as there is no vector form of
+* the function
+********************************************/
+static void batch_lanes(BATCH* batch, double (*function)(double x, double y))
+{
+    LANES lanes;
+
+    lanes.x = batch->top - 1;
+    lanes.y = batch->top;
+    lanes.function = function;
+    lanes.lane = 0;
+
+    iterate(lane_step, &lanes);
+
+    --batch->top;
+
+    ++batch->pc;
+}
+
+/********************************************
+* Applies the function to the next row, the
+* rows past the end of the block are defined
+* too, so the whole block is done
+* Returns 1 after the last row
+********************************************/
+static int  lane_step(void* arg)
+{
+    LANES* lanes = arg;
+
+    lanes->x->doubles[lanes->lane] = lanes->function(lanes->x->doubles[lanes->lane],
+                                                     lanes->y->doubles[lanes->lane]);
+    ++lanes->lane;
+
+    return lanes->lane >= COLUMN_ROWS;
+}
+
+/********************************************
+* Adds two integer columns, wrapping around
+********************************************/
+static void batch_add_int(BATCH* batch)
+{
+    batch->top[-1].unsigneds += batch->top[0].unsigneds;
+    --batch->top;
+
+    ++batch->pc;
+}
+
+/********************************************
+* Subtracts the top integer column from the
+* one below, wrapping around
+********************************************/
+static void batch_sub_int(BATCH* batch)
+{
+    batch->top[-1].unsigneds -= batch->top[0].unsigneds;
+    --batch->top;
+
+    ++batch->pc;
+}
+
+/********************************************
+* Multiplies two integer columns, wrapping
+* around
+********************************************/
+static void batch_mul_int(BATCH* batch)
+{
+    batch->top[-1].unsigneds *= batch->top[0].unsigneds;
+    --batch->top;
+
+    ++batch->pc;
+}
+
+/********************************************
+* Divides the integer column below the top by
+* the top, division by zero gives 0 and
+* INT64_MIN / -1 wraps around to INT64_MIN
+********************************************/
+static void batch_div_int(BATCH* batch)
+{
+    INTEGERS dividend = batch->top[-1].integers;
+    INTEGERS divisor = batch->top[0].integers;
+
+    /* the comparisons give -1 in the rows where they hold */
+    INTEGERS zero = (divisor == 0);
+    INTEGERS overflow = (dividend == INT64_MIN) & (divisor == -1);
+    INTEGERS bad = zero | overflow;
+
+    /* divide by 1 in the bad rows, it cannot trap */
+    divisor = (divisor & ~bad) | (bad & 1);
+
+    batch->top[-1].integers = (dividend / divisor) & ~zero;
+    --batch->top;
+
+    ++batch->pc;
+}
+
+/********************************************
+* Takes the remainders of the integer column
+* below the top divided by the top, division
+* by zero and INT64_MIN % -1 give 0
+********************************************/
+static void batch_mod_int(BATCH* batch)
+{
+    INTEGERS dividend = batch->top[-1].integers;
+    INTEGERS divisor = batch->top[0].integers;
+
+    /* the comparisons give -1 in the rows where they hold */
+    INTEGERS zero = (divisor == 0);
+    INTEGERS overflow = (dividend == INT64_MIN) & (divisor == -1);
+    INTEGERS bad = zero | overflow;
+
+    /* divide by 1 in the bad rows, it cannot trap and leaves no remainder */
+    divisor = (divisor & ~bad) | (bad & 1);
+
+    batch->top[-1].integers = dividend % divisor;
+    --batch->top;
+
+    ++batch->pc;
+}
+
+/********************************************
+* Raises the integer column below the top to
+* the powers of the top by squaring, wrapping
+* around, a negative exponent gives 0
+********************************************/
+static void batch_pow_int(BATCH* batch)
+{
+    POWER power;
+    INTEGERS negative = (batch->top[0].integers < 0);
+
+    power.result = (UNSIGNEDS){ 0 } + 1;
+    power.base = batch->top[-1].unsigneds;
+    power.exponent = batch->top[0].unsigneds;
+    power.bits = 0;
+
+    iterate(power_step, &power);
+
+    batch->top[-1].unsigneds = power.result & ~(UNSIGNEDS)negative;
+    --batch->top;
+
+    ++batch->pc;
+}
+
+/********************************************
+* Multiplies the results by the bases where
+* the lowest bit of the exponents is set and
+* squares the bases
+* Returns 1 after the last bit
+********************************************/
+static int  power_step(void* arg)
+{
+    POWER* power = arg;
+
+    /* all ones in the rows where the bit is set */
+    UNSIGNEDS set = -(power->exponent & 1);
+
+    power->result *= (power->base & set) | (~set & 1);
+    power->base *= power->base;
+    power->exponent >>= 1;
+    ++power->bits;
+
+    return power->bits >= POWER_BITS;
+}
+
+/********************************************
+* Negates the integer column at the top of
+* the stack, wrapping around
+********************************************/
+static void batch_neg_int(BATCH* batch)
+{
+    batch->top[0].unsigneds = -batch->top[0].unsigneds;
+
+    ++batch->pc;
+}
@@ -0,0 +1,1032 @@
+/*============================================================================================
+* Differential fuzzing of the conversion engines
+*
+* Every input is converted by the recursive engine, which is the reference, and by each
+* other engine in the symbol, tokenizer, tree, DAG, simplify and packed modes, and split
+* between threads by convert_split() with every engine in turn; their outputs, statuses
+* and error offsets must be the same byte for byte. The conversions
+* through the cache (twice, so the second one is a hit) and the incremental one must give
+* the output of the reference as well. An expression converted without an error is
+* compiled and evaluated by evaluate(), by rows, by columns, as native code, from its
+* packed record and from its DAG, all with the same result. Its simplified postfix form
+* is compiled and evaluated too, it must have the same value up to the rounding, unless
+* either evaluation makes an infinity or a NaN on the way, e.g. 1/-(a-a) is -inf and
+* simplified 1/0 is inf. The first input that gives something else is written to
+* fuzz-mismatch.txt and the program aborts.
+*
+* Built with -DFUZZ_LIBFUZZER it is a libFuzzer target, see LLVMFuzzerTestOneInput().
+* Otherwise it has a driver of its own, which AFL can run too:
+*
+* Usage:
+*   fuzz [count [length [seed [reference [history]]]]]
+*   fuzz -f file
+*
+*   count      number of random expressions (default 100000), about a third of them
+*              are edits of the one before with a byte replaced
+*   length     approximate length of an expression (default 48)
+*   seed       seed of the generator (default 2006)
+*   reference  file the outputs of the reference are written to, so the builds with
+*              both classifiers can be compared, see the fuzz target of Makefile
+*   history    file a line of JSON with the throughput of every engine on the random
+*              expressions is appended to, so it can be followed from run to run
+*   -f file    checks the whole file as a single input, e.g. afl-fuzz ... ./fuzz -f @@
+*
+* The classifier is chosen at build time, see Makefile.
+*
+* Copyright 2006-2016 Mikhail Durnev (mdurnev@gmail.com). Released under the GPLv3
+============================================================================================*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include <fenv.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "acyclomatic.h"
+
+
+/* data types */
+typedef struct MODE MODE;
+typedef struct FUZZ FUZZ;
+typedef struct GENERATOR GENERATOR;
+
+/* function prototypes */
+int  LLVMFuzzerInitialize(int* argc, char*** argv);
+int  LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+int  fuzz_context_step(void* arg);
+int  fuzz_binding_step(void* arg);
+
+char* fuzz_arg(int argc, char* argv[], int index, char* value);
+void fuzz_random(int argc, char* argv[]);
+void fuzz_file(int argc, char* argv[]);
+int  fuzz_line_step(void* arg);
+
+void fuzz_input(FUZZ* fuzz, const char* in, size_t len);
+void fuzz_set_mode(CONTEXT* ctx, const MODE* mode);
+int  fuzz_mode_step(void* arg);
+int  fuzz_engine_step(void* arg);
+void fuzz_split(FUZZ* fuzz);
+void fuzz_cached(FUZZ* fuzz);
+void fuzz_incremental(FUZZ* fuzz);
+void fuzz_evaluate(FUZZ* fuzz);
+void fuzz_evaluators(FUZZ* fuzz);
+void fuzz_skip(FUZZ* fuzz);
+
+void fuzz_compare(FUZZ* fuzz, const char* variant, const OUTPUT* output, int status, size_t offset);
+void fuzz_compare_code(FUZZ* fuzz, const char* variant, const PROGRAM* program);
+void fuzz_compare_value(FUZZ* fuzz, const char* variant, double value);
+void fuzz_compare_close(FUZZ* fuzz, const char* variant, double value, int exceptions);
+void fuzz_mismatch(FUZZ* fuzz, const char* variant);
+void fuzz_nothing(FUZZ* fuzz, const char* variant);
+size_t fuzz_min(size_t a, size_t b);
+
+int  generate_step(void* arg);
+void generate_term(GENERATOR* gen);
+void generate_operator(GENERATOR* gen);
+void generate_end(GENERATOR* gen);
+void generate_edit(GENERATOR* gen);
+void generate_nothing(GENERATOR* gen);
+uint32_t generate_random(GENERATOR* gen);
+
+void fuzz_throughput(FUZZ* fuzz, const char* history);
+int  fuzz_speed_step(void* arg);
+int  fuzz_repeat_step(void* arg);
+int  fuzz_convert_step(void* arg);
+double fuzz_time(void);
+
+/* data types */
+typedef void (*MAIN_ACTION)(int argc, char* argv[]);
+typedef void (*FUZZ_ACTION)(FUZZ* fuzz);
+typedef void (*REPORT_ACTION)(FUZZ* fuzz, const char* variant);
+typedef void (*GENERATOR_ACTION)(GENERATOR* gen);
+
+/* mode of the contexts in a round of conversions */
+struct MODE
+{
+    const char* name;
+    int tokens;
+    int tree;
+    int dag;
+    int simplify;
+    int packed;
+};
+
+/* state of the fuzzing */
+struct FUZZ
+{
+    CONTEXT contexts[ENGINE_COUNT]; /* one per engine, the first one is the reference */
+    CONTEXT other;          /* context of the packed record and of the DAG evaluated */
+    CONTEXT splitter;       /* context of convert_split() */
+    CACHE cache;
+    INCREMENTAL inc;
+    NATIVE_CACHE natives;
+    OUTPUT reference;       /* output of the reference in the current mode */
+    OUTPUT output;          /* output of the variant compared with it */
+    OUTPUT outputs;         /* outputs of the reference in all the modes, see reference */
+    char outputs_buffer[1 << 16];
+    const char* in;         /* current input */
+    size_t len;
+    const MODE* mode;       /* current mode */
+    int engine;             /* engine being compared */
+    int status;             /* status and error offset of the reference */
+    size_t error_offset;
+    const OUTPUT* got;      /* what the variant compared gave */
+    int got_status;
+    size_t got_offset;
+    double got_value;
+    PROGRAM program;        /* the postfix form of the reference compiled */
+    PROGRAM record;         /* the packed record compiled */
+    PROGRAM tree;           /* the DAG compiled */
+    PROGRAM simplified;     /* the postfix form of the simplify mode compiled */
+    NATIVE native;
+    double bindings[SYMBOL_COUNT];
+    const double* columns[SYMBOL_COUNT]; /* the bindings as columns of a single row */
+    double value;           /* value of the program of the reference */
+    size_t inputs;          /* number of inputs checked */
+    const char* lines;      /* random expressions, one per line */
+    size_t length;
+    const char* position;   /* next line of the random expressions */
+    int left;               /* times left to convert the random expressions */
+    double speeds[ENGINE_COUNT]; /* MB/s of every engine */
+};
+
+/* state of the expression generator */
+struct GENERATOR
+{
+    char* buffer;           /* generated expressions, one per line */
+    size_t length;          /* number of bytes generated so far */
+    size_t line_start;      /* offset of the current expression */
+    size_t target;          /* approximate length of an expression */
+    int depth;              /* current nesting depth */
+    size_t operand_count;   /* operands of the current expression to choose from */
+    size_t count;           /* number of expressions left to generate */
+    uint32_t seed;          /* state of the random number generator */
+};
+
+
+/* function arrays */
+
+/* main call table, indexed by the input being a file */
+MAIN_ACTION main_call_table[] =
+{
+    fuzz_random,
+    fuzz_file
+};
+
+/* report call table, indexed by the variant differing from the reference */
+REPORT_ACTION report_call_table[] =
+{
+    fuzz_nothing,
+    fuzz_mismatch
+};
+
+/* evaluation call table, indexed by the reference converting without an error */
+FUZZ_ACTION evaluate_call_table[] =
+{
+    fuzz_skip,
+    fuzz_evaluate
+};
+
+/* evaluators call table, indexed by the postfix form compiling into a valid program */
+FUZZ_ACTION evaluators_call_table[] =
+{
+    fuzz_skip,
+    fuzz_evaluators
+};
+
+/* generator call table, indexed by the expression being long enough */
+GENERATOR_ACTION generator_call_table[] =
+{
+    generate_operator,
+    generate_end
+};
+
+/* edit call table, indexed by the expression being followed by its edit */
+GENERATOR_ACTION edit_call_table[] =
+{
+    generate_nothing,
+    generate_edit
+};
+
+/* modes of the rounds, the symbol mode is the last one: the cache, the */
+/* incremental conversion and the evaluation compare with its output   */
+const MODE modes[] =
+{
+    { "tokenizer", 1, 0, 0, 0, 0 },
+    { "tree", 0, 1, 0, 0, 0 },
+    { "tokenizer tree", 1, 1, 0, 0, 0 },
+    { "DAG", 0, 1, 1, 0, 0 },
+    { "tokenizer DAG", 1, 1, 1, 0, 0 },
+    { "simplify", 0, 1, 0, 1, 0 },
+    { "tokenizer simplify", 1, 1, 0, 1, 0 },
+    { "packed", 0, 0, 0, 0, 1 },
+    { "symbol", 0, 0, 0, 0, 0 }
+};
+
+/* engine names, indexed by ENGINE_* constants */
+const char* engine_names[] =
+{
+    "recursive",
+    "trampoline",
+    "simd"
+};
+
+/* operands of the random expressions, the symbols first; the identifiers and */
+/* the literals are operands in the tokenizer mode only, where the symbols   */
+/* next to each other are an error too                                       */
+const char* operands[] =
+{
+    "a", "b", "c", "d", "x", "y", "z", "a", "b", "m",
+    "ab", "x1", "_t", "7", "12", "2.5", "3."
+};
+
+/* the state, libFuzzer gives the target nothing but the input */
+FUZZ fuzz_state;
+
+
+/* constants */
+#ifdef TABLE_CLASSIFIER
+#define CLASSIFIER_NAME "table"
+#else
+#define CLASSIFIER_NAME "arithmetic"
+#endif
+
+/* numbers of the modes and of the operands */
+#define MODE_COUNT (sizeof(modes) / sizeof(modes[0]))
+#define OPERAND_COUNT (sizeof(operands) / sizeof(operands[0]))
+
+/* number of the symbols, every other expression has only them */
+#define OPERAND_SYMBOLS 10
+
+/* operators of the random expressions, repeated to make them more frequent */
+#define FUZZ_OPERATORS "++--**//%^"
+#define FUZZ_OPERATOR_COUNT (sizeof(FUZZ_OPERATORS) - 1)
+
+/* bytes an edit puts into an expression */
+#define FUZZ_BYTES "abz_09.+-*/%^()  ~#"
+#define FUZZ_BYTE_COUNT (sizeof(FUZZ_BYTES) - 1)
+
+/* maximal nesting depth of the random expressions */
+#define FUZZ_DEPTH 6
+
+/* bytes of an expression over its length: a term adds '-', '(', an operand of */
+/* 3 bytes at most and ')' after the length is reached, the end closes the    */
+/* brackets and adds the newline                                              */
+#define FUZZ_LINE_EXTRA (6 + FUZZ_DEPTH + 1)
+
+/* initial size of the outputs, they grow as needed */
+#define FUZZ_OUTPUT_SIZE 256
+
+/* memory of the cache and entries of the native code cache */
+#define FUZZ_CACHE_SIZE (1 << 20)
+#define FUZZ_NATIVE_ENTRIES 256
+
+/* file the input giving a mismatch is written to */
+#define FUZZ_MISMATCH_FILE "fuzz-mismatch.txt"
+
+/* largest difference of the value of the simplified expression, relative to the */
+/* value of the expression or absolute below 1                                  */
+#define FUZZ_TOLERANCE 1e-6
+
+/* exceptions of the operations making infinities or NaNs */
+#define FUZZ_EXCEPTIONS (FE_DIVBYZERO | FE_INVALID | FE_OVERFLOW)
+
+/* threads of convert_split(), the parts of the short expressions are a few bytes */
+#define FUZZ_SPLIT 4
+
+/* number of times the random expressions are converted by every engine */
+#define FUZZ_REPEAT 4
+
+/* size of the buffer of the line of the history */
+#define FUZZ_HISTORY_SIZE 512
+
+
+
+#ifndef FUZZ_LIBFUZZER
+/********************************************
+* Program entry point
+********************************************/
+int  main(int argc, char* argv[])
+{
+    int file = (argc > 2) & (strcmp(fuzz_arg(argc, argv, 1, ""), "-f") == 0);
+
+    LLVMFuzzerInitialize(&argc, &argv);
+
+    main_call_table[file](argc, argv);
+
+    printf("%zu inputs in %zu modes, classifier %s: no mismatches\n",
+           fuzz_state.inputs, (size_t)MODE_COUNT, CLASSIFIER_NAME);
+
+    return 0;
+}
+#endif
+
+/********************************************
+* Initializes the state, libFuzzer calls it
+* once before the first input
+********************************************/
+int  LLVMFuzzerInitialize(int* argc, char*** argv)
+{
+    FUZZ* fuzz = &fuzz_state;
+
+    fuzz->engine = 0;
+    iterate(fuzz_context_step, fuzz);
+    fuzz->engine = 0;
+    iterate(fuzz_binding_step, fuzz);
+
+    init_context(&fuzz->other);
+    init_context(&fuzz->splitter);
+    fuzz->splitter.split = FUZZ_SPLIT;
+    init_cache(&fuzz->cache, FUZZ_CACHE_SIZE);
+    init_incremental(&fuzz->inc);
+    init_native_cache(&fuzz->natives, FUZZ_NATIVE_ENTRIES);
+    init_memory_output(&fuzz->reference, FUZZ_OUTPUT_SIZE);
+    init_memory_output(&fuzz->output, FUZZ_OUTPUT_SIZE);
+
+    /* the outputs of the reference are kept only if the driver is given a file */
+    init_output(&fuzz->outputs, fuzz->outputs_buffer, sizeof(fuzz->outputs_buffer), open("/dev/null", O_WRONLY));
+
+    memset(&fuzz->program, 0, sizeof(fuzz->program));
+    memset(&fuzz->record, 0, sizeof(fuzz->record));
+    memset(&fuzz->tree, 0, sizeof(fuzz->tree));
+    memset(&fuzz->simplified, 0, sizeof(fuzz->simplified));
+
+    fuzz->inputs = 0;
+
+    return 0;
+}
+
+/********************************************
+* Checks an input, the libFuzzer target
+********************************************/
+int  LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    fuzz_input(&fuzz_state, (const char*)data, size);
+
+    return 0;
+}
+
+/********************************************
+* Initializes the context of the next engine
+* Returns 1 after the last engine
+********************************************/
+int  fuzz_context_step(void* arg)
+{
+    FUZZ* fuzz = arg;
+
+    init_context(fuzz->contexts + fuzz->engine);
+    fuzz->contexts[fuzz->engine].engine = fuzz->engine;
+
+    ++fuzz->engine;
+
+    return fuzz->engine >= ENGINE_COUNT;
+}
+
+/********************************************
+* Sets the value of the next symbol, they go
+* from -9 to 9.75, 'm' is 0 so there are
+* divisions by zero
+* Returns 1 after the last symbol
+********************************************/
+int  fuzz_binding_step(void* arg)
+{
+    FUZZ* fuzz = arg;
+
+    fuzz->bindings[fuzz->engine] = (fuzz->engine - 12) * 0.75;
+    fuzz->columns[fuzz->engine] = fuzz->bindings + fuzz->engine;
+
+    ++fuzz->engine;
+
+    return fuzz->engine >= SYMBOL_COUNT;
+}
+
+/********************************************
+* Returns the argument or the default value
+* if there are not so many arguments
+********************************************/
+char* fuzz_arg(int argc, char* argv[], int index, char* value)
+{
+    int present = (index < argc);
+    char* values[2] = { value, argv[index * present] };
+
+    return values[present];
+}
+
+/********************************************
+* Checks the random expressions, then
+* measures the throughput of the engines on
+* them
+********************************************/
+void fuzz_random(int argc, char* argv[])
+{
+    FUZZ* fuzz = &fuzz_state;
+    GENERATOR gen;
+    size_t count = atol(fuzz_arg(argc, argv, 1, "100000"));
+
+    /* at least one expression */
+    count += (count == 0);
+
+    gen.count = count;
+    gen.target = atol(fuzz_arg(argc, argv, 2, "48"));
+    gen.seed = atol(fuzz_arg(argc, argv, 3, "2006"));
+    gen.seed += (gen.seed == 0);
+    gen.depth = 0;
+    gen.operand_count = OPERAND_SYMBOLS;
+    gen.length = 0;
+    gen.line_start = 0;
+
+    /* an edit is as long as the expression before it */
+    gen.buffer = malloc(count * (gen.target + FUZZ_LINE_EXTRA));
+
+    iterate(generate_step, &gen);
+
+    close(fuzz->outputs.fd);
+    fuzz->outputs.fd = open(fuzz_arg(argc, argv, 4, "/dev/null"), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    fuzz->lines = gen.buffer;
+    fuzz->length = gen.length;
+    fuzz->position = gen.buffer;
+
+    iterate(fuzz_line_step, fuzz);
+    flush_output(&fuzz->outputs);
+
+    fuzz_throughput(fuzz, fuzz_arg(argc, argv, 5, "/dev/null"));
+
+    free(gen.buffer);
+}
+
+/********************************************
+* Checks the whole file as an input
+********************************************/
+void fuzz_file(int argc, char* argv[])
+{
+    int fd = open(argv[2], O_RDONLY);
+    off_t end = lseek(fd, 0, SEEK_END);
+    size_t size = end * (end > 0);
+    char* buffer = malloc(size + 1);
+    ssize_t length;
+
+    lseek(fd, 0, SEEK_SET);
+    length = read(fd, buffer, size);
+    close(fd);
+
+    fuzz_input(&fuzz_state, buffer, length * (length > 0));
+
+    free(buffer);
+}
+
+/********************************************
+* Checks the next line of the random
+* expressions
+* Returns 1 at the end of them
+********************************************/
+int  fuzz_line_step(void* arg)
+{
+    FUZZ* fuzz = arg;
+    const char* end = fuzz->lines + fuzz->length;
+    const char* line_end = memchr(fuzz->position, '\n', end - fuzz->position);
+
+    fuzz_input(fuzz, fuzz->position, line_end - fuzz->position);
+
+    fuzz->position = line_end + 1;
+
+    return fuzz->position >= end;
+}
+
+/********************************************
+* Compares every variant with the reference
+* on the input
+********************************************/
+void fuzz_input(FUZZ* fuzz, const char* in, size_t len)
+{
+    fuzz->in = in;
+    fuzz->len = len;
+
+    fuzz->mode = modes;
+    iterate(fuzz_mode_step, fuzz);
+
+    /* the reference output left is the one of the symbol mode */
+    fuzz->mode = modes + MODE_COUNT - 1;
+
+    fuzz_cached(fuzz);
+    fuzz_incremental(fuzz);
+    evaluate_call_table[fuzz->status == STATUS_OK](fuzz);
+
+    ++fuzz->inputs;
+}
+
+/********************************************
+* Sets the mode of the context
+********************************************/
+void fuzz_set_mode(CONTEXT* ctx, const MODE* mode)
+{
+    ctx->tokens = mode->tokens;
+    ctx->tree = mode->tree;
+    ctx->dag = mode->dag;
+    ctx->simplify = mode->simplify;
+    ctx->packed = mode->packed;
+}
+
+/********************************************
+* Converts the input by the reference in the
+* next mode and compares the other engines
+* with it
+* Returns 1 after the last mode
+********************************************/
+int  fuzz_mode_step(void* arg)
+{
+    FUZZ* fuzz = arg;
+    CONTEXT* ctx = fuzz->contexts;
+
+    fuzz_set_mode(ctx, fuzz->mode);
+
+    fuzz->reference.length = 0;
+    fuzz->status = convert(ctx, fuzz->in, fuzz->len, &fuzz->reference);
+    fuzz->error_offset = ctx->error_offset;
+
+    output_string(&fuzz->outputs, fuzz->reference.buffer, fuzz->reference.length);
+
+    fuzz->engine = ENGINE_RECURSIVE + 1;
+    iterate(fuzz_engine_step, fuzz);
+
+    fuzz_split(fuzz);
+
+    ++fuzz->mode;
+
+    return fuzz->mode == modes + MODE_COUNT;
+}
+
+/********************************************
+* Converts the input by the next engine and
+* compares it with the reference
+* Returns 1 after the last engine
+********************************************/
+int  fuzz_engine_step(void* arg)
+{
+    FUZZ* fuzz = arg;
+    CONTEXT* ctx = fuzz->contexts + fuzz->engine;
+    int status;
+
+    fuzz_set_mode(ctx, fuzz->mode);
+
+    fuzz->output.length = 0;
+    status = convert(ctx, fuzz->in, fuzz->len, &fuzz->output);
+
+    fuzz_compare(fuzz, engine_names[fuzz->engine], &fuzz->output, status, ctx->error_offset);
+
+    ++fuzz->engine;
+
+    return fuzz->engine >= ENGINE_COUNT;
+}
+
+/********************************************
+* Converts the input split between threads,
+* the engine is the next one for every input,
+* and compares it with the reference
+********************************************/
+void fuzz_split(FUZZ* fuzz)
+{
+    CONTEXT* ctx = &fuzz->splitter;
+    int status;
+
+    fuzz_set_mode(ctx, fuzz->mode);
+    ctx->engine = fuzz->inputs % ENGINE_COUNT;
+
+    fuzz->output.length = 0;
+    status = convert_split(ctx, fuzz->in, fuzz->len, &fuzz->output);
+
+    fuzz_compare(fuzz, "convert_split()", &fuzz->output, status, ctx->error_offset);
+}
+
+/********************************************
+* Converts the input through the cache twice
+* and compares both with the reference
+********************************************/
+void fuzz_cached(FUZZ* fuzz)
+{
+    CONTEXT* ctx = fuzz->contexts;
+    int status;
+
+    fuzz->output.length = 0;
+    status = convert_cached(&fuzz->cache, ctx, fuzz->in, fuzz->len, &fuzz->output);
+    fuzz_compare(fuzz, "convert_cached()", &fuzz->output, status, ctx->error_offset);
+
+    fuzz->output.length = 0;
+    status = convert_cached(&fuzz->cache, ctx, fuzz->in, fuzz->len, &fuzz->output);
+    fuzz_compare(fuzz, "convert_cached() hit", &fuzz->output, status, ctx->error_offset);
+}
+
+/********************************************
+* Converts the input as an edit of the input
+* before it and compares the whole output
+* with the reference
+********************************************/
+void fuzz_incremental(FUZZ* fuzz)
+{
+    int status;
+
+    fuzz->output.length = 0;
+    status = convert_incremental(&fuzz->inc, fuzz->in, fuzz->len, &fuzz->output);
+
+    fuzz_compare(fuzz, "convert_incremental()", &fuzz->inc.postfix, status, fuzz->inc.ctx.error_offset);
+}
+
+/********************************************
+* Compiles the postfix form of the reference
+* and evaluates it if it is a valid program
+********************************************/
+void fuzz_evaluate(FUZZ* fuzz)
+{
+    /* the conversion ends the postfix form with a newline; operands with no */
+    /* operation between them (ab) are converted, but they leave more than  */
+    /* one value and the program is not valid                               */
+    int status = compile_program(&fuzz->program, fuzz->reference.buffer, fuzz->reference.length - 1);
+
+    evaluators_call_table[status == STATUS_OK](fuzz);
+}
+
+/********************************************
+* Evaluates the program of the reference and
+* compares every evaluator with it
+********************************************/
+void fuzz_evaluators(FUZZ* fuzz)
+{
+    CONTEXT* other = &fuzz->other;
+    double value;
+
+    fuzz->value = evaluate(&fuzz->program, fuzz->bindings);
+
+    evaluate_rows(&fuzz->program, fuzz->columns, 1, &value);
+    fuzz_compare_value(fuzz, "evaluate_rows()", value);
+
+    evaluate_columns(&fuzz->program, fuzz->columns, 1, &value);
+    fuzz_compare_value(fuzz, "evaluate_columns()", value);
+
+    compile_native(&fuzz->native, &fuzz->program);
+    fuzz_compare_value(fuzz, "evaluate_native()", evaluate_native(&fuzz->native, fuzz->bindings));
+    free_native(&fuzz->native);
+
+    fuzz_compare_value(fuzz, "native_cached()",
+                       evaluate_native(native_cached(&fuzz->natives, fuzz->in, fuzz->len), fuzz->bindings));
+
+    /* the record has the opcodes of the postfix form */
+    fuzz_set_mode(other, &modes[MODE_COUNT - 2]);
+    fuzz->output.length = 0;
+    convert(other, fuzz->in, fuzz->len, &fuzz->output);
+    compile_record(&fuzz->record, fuzz->output.buffer, fuzz->output.length);
+    fuzz_compare_code(fuzz, "compile_record()", &fuzz->record);
+
+    /* the shared subtrees are computed once, in the same order */
+    fuzz_set_mode(other, &modes[3]);
+    fuzz->output.length = 0;
+    convert(other, fuzz->in, fuzz->len, &fuzz->output);
+    compile_tree(&fuzz->tree, other);
+    fuzz_compare_value(fuzz, "compile_tree()", evaluate(&fuzz->tree, fuzz->bindings));
+
+    /* the other engines simplify with the same code, only the value can check it, */
+    /* both evaluations are watched for the operations making infinities or NaNs   */
+    fuzz_set_mode(other, &modes[5]);
+    fuzz->output.length = 0;
+    convert(other, fuzz->in, fuzz->len, &fuzz->output);
+    compile_program(&fuzz->simplified, fuzz->output.buffer, fuzz->output.length - 1);
+    feclearexcept(FE_ALL_EXCEPT);
+    evaluate(&fuzz->program, fuzz->bindings);
+    value = evaluate(&fuzz->simplified, fuzz->bindings);
+    fuzz_compare_close(fuzz, "the simplify mode", value, fetestexcept(FUZZ_EXCEPTIONS));
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+void fuzz_skip(FUZZ* fuzz)
+{
+}
+
+/********************************************
+* Compares the output, the status and the
+* error offset with the ones of the reference
+********************************************/
+void fuzz_compare(FUZZ* fuzz, const char* variant, const OUTPUT* output, int status, size_t offset)
+{
+    const OUTPUT* reference = &fuzz->reference;
+    size_t length = fuzz_min(output->length, reference->length);
+    int differ = (output->length != reference->length) | (memcmp(output->buffer, reference->buffer, length) != 0) |
+                 (status != fuzz->status) | (offset != fuzz->error_offset);
+
+    fuzz->got = output;
+    fuzz->got_status = status;
+    fuzz->got_offset = offset;
+    fuzz->got_value = fuzz->value;
+
+    report_call_table[differ](fuzz, variant);
+}
+
+/********************************************
+* Compares the opcodes of the program with
+* the ones of the postfix form of the
+* reference
+********************************************/
+void fuzz_compare_code(FUZZ* fuzz, const char* variant, const PROGRAM* program)
+{
+    const PROGRAM* reference = &fuzz->program;
+    size_t length = fuzz_min(program->length, reference->length);
+    int differ = (program->length != reference->length) | (memcmp(program->code, reference->code, length) != 0);
+
+    fuzz->got = &fuzz->reference;
+    fuzz->got_status = fuzz->status;
+    fuzz->got_offset = fuzz->error_offset;
+    fuzz->got_value = evaluate(program, fuzz->bindings);
+
+    report_call_table[differ](fuzz, variant);
+}
+
+/********************************************
+* Compares the value with the one of the
+* reference, NaNs are the same as each other
+********************************************/
+void fuzz_compare_value(FUZZ* fuzz, const char* variant, double value)
+{
+    double reference = fuzz->value;
+    int same = (value == reference) | ((value != value) & (reference != reference));
+
+    fuzz->got = &fuzz->reference;
+    fuzz->got_status = fuzz->status;
+    fuzz->got_offset = fuzz->error_offset;
+    fuzz->got_value = value;
+
+    report_call_table[same ^ 1](fuzz, variant);
+}
+
+/********************************************
+* Compares the value with the one of the
+* reference within FUZZ_TOLERANCE, the
+* values that are not finite, or made with
+* exceptions, are not compared
+********************************************/
+void fuzz_compare_close(FUZZ* fuzz, const char* variant, double value, int exceptions)
+{
+    double reference = fuzz->value;
+    int finite = (isfinite(value) != 0) & (isfinite(reference) != 0) & (exceptions == 0);
+    int close = (fabs(value - reference) <= FUZZ_TOLERANCE * fmax(fabs(reference), 1.0));
+
+    fuzz->got = &fuzz->output;
+    fuzz->got_status = fuzz->status;
+    fuzz->got_offset = fuzz->error_offset;
+    fuzz->got_value = value;
+
+    report_call_table[finite & (close ^ 1)](fuzz, variant);
+}
+
+/********************************************
+* Reports the variant differing from the
+* reference, writes the input to the file
+* and aborts
+********************************************/
+void fuzz_mismatch(FUZZ* fuzz, const char* variant)
+{
+    int fd = open(FUZZ_MISMATCH_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    write(fd, fuzz->in, fuzz->len);
+    close(fd);
+
+    fprintf(stderr, "fuzz: %s differs from the recursive engine in the %s mode, classifier %s\n"
+            "input (%zu bytes, written to %s): %.*s\n"
+            "reference: status %d at offset %zu, value %.17g, output %.*s\n"
+            "%s: status %d at offset %zu, value %.17g, output %.*s\n",
+            variant, fuzz->mode->name, CLASSIFIER_NAME,
+            fuzz->len, FUZZ_MISMATCH_FILE, (int)fuzz->len, fuzz->in,
+            fuzz->status, fuzz->error_offset, fuzz->value,
+            (int)fuzz->reference.length, fuzz->reference.buffer,
+            variant, fuzz->got_status, fuzz->got_offset, fuzz->got_value,
+            (int)fuzz->got->length, fuzz->got->buffer);
+
+    abort();
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+void fuzz_nothing(FUZZ* fuzz, const char* variant)
+{
+}
+
+/********************************************
+* Returns the minimum of the sizes
+********************************************/
+size_t fuzz_min(size_t a, size_t b)
+{
+    return a ^ ((a ^ b) & -(size_t)(b < a));
+}
+
+/********************************************
+* Generates the next term of the expression
+* and either an operator or the end of line
+* Returns 1 when all expressions are done
+********************************************/
+int  generate_step(void* arg)
+{
+    GENERATOR* gen = arg;
+
+    generate_term(gen);
+
+    generator_call_table[gen->length - gen->line_start >= gen->target](gen);
+
+    return gen->count == 0;
+}
+
+/********************************************
+* Generates an operand, maybe with the unary
+* minus, maybe opening a bracket before it
+* and closing one after it
+********************************************/
+void generate_term(GENERATOR* gen)
+{
+    int negate = (generate_random(gen) % 6 == 0);
+    int open = (generate_random(gen) % 3 == 0) & (gen->depth < FUZZ_DEPTH);
+    const char* operand = operands[generate_random(gen) % gen->operand_count];
+    size_t length = strlen(operand);
+    int close;
+
+    gen->buffer[gen->length] = '-';
+    gen->length += negate;
+
+    gen->buffer[gen->length] = '(';
+    gen->length += open;
+    gen->depth += open;
+
+    memcpy(gen->buffer + gen->length, operand, length);
+    gen->length += length;
+
+    close = (generate_random(gen) % 3 == 0) & (gen->depth > 0) & (open ^ 1);
+
+    gen->buffer[gen->length] = ')';
+    gen->length += close;
+    gen->depth -= close;
+}
+
+/********************************************
+* Generates an operator from the mix
+********************************************/
+void generate_operator(GENERATOR* gen)
+{
+    gen->buffer[gen->length++] = FUZZ_OPERATORS[generate_random(gen) % FUZZ_OPERATOR_COUNT];
+}
+
+/********************************************
+* Closes all open brackets and ends the line,
+* half of the lines are followed by an edit,
+* half of them have all the operands to
+* choose from
+********************************************/
+void generate_end(GENERATOR* gen)
+{
+    memset(gen->buffer + gen->length, ')', gen->depth);
+    gen->length += gen->depth;
+    gen->depth = 0;
+
+    gen->buffer[gen->length++] = '\n';
+
+    --gen->count;
+
+    edit_call_table[(generate_random(gen) % 2) & (gen->count > 0)](gen);
+
+    gen->line_start = gen->length;
+    gen->operand_count = OPERAND_SYMBOLS + (OPERAND_COUNT - OPERAND_SYMBOLS) * (generate_random(gen) % 2);
+}
+
+/********************************************
+* Copies the line just generated with a byte
+* replaced, the newline stays
+********************************************/
+void generate_edit(GENERATOR* gen)
+{
+    size_t length = gen->length - gen->line_start;
+    size_t position = gen->length + generate_random(gen) % (length - 1);
+
+    memcpy(gen->buffer + gen->length, gen->buffer + gen->line_start, length);
+    gen->buffer[position] = FUZZ_BYTES[generate_random(gen) % FUZZ_BYTE_COUNT];
+
+    gen->length += length;
+
+    --gen->count;
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+void generate_nothing(GENERATOR* gen)
+{
+}
+
+/********************************************
+* Returns the next pseudo-random number
+********************************************/
+uint32_t generate_random(GENERATOR* gen)
+{
+    /* xorshift32 */
+    gen->seed ^= gen->seed << 13;
+    gen->seed ^= gen->seed >> 17;
+    gen->seed ^= gen->seed << 5;
+
+    return gen->seed >> 8;
+}
+
+/********************************************
+* Measures the throughput of every engine on
+* the random expressions in the symbol mode
+* and appends it to the history as a line of
+* JSON
+********************************************/
+void fuzz_throughput(FUZZ* fuzz, const char* history)
+{
+    char line[FUZZ_HISTORY_SIZE];
+    int fd = open(history, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    int length;
+
+    fuzz->engine = 0;
+    iterate(fuzz_speed_step, fuzz);
+
+    length = snprintf(line, sizeof(line),
+                      "{\"time\": %lld, \"classifier\": \"%s\", \"expressions\": %zu, \"bytes\": %zu, "
+                      "\"mb_per_s\": {\"%s\": %.1f, \"%s\": %.1f, \"%s\": %.1f}}\n",
+                      (long long)time(0), CLASSIFIER_NAME, fuzz->inputs, fuzz->length,
+                      engine_names[0], fuzz->speeds[0], engine_names[1], fuzz->speeds[1],
+                      engine_names[2], fuzz->speeds[2]);
+
+    write(fd, line, length);
+    close(fd);
+}
+
+/********************************************
+* Measures the throughput of the next engine
+* Returns 1 after the last engine
+********************************************/
+int  fuzz_speed_step(void* arg)
+{
+    FUZZ* fuzz = arg;
+    double start;
+    double seconds;
+
+    fuzz->left = FUZZ_REPEAT;
+
+    start = fuzz_time();
+    iterate(fuzz_repeat_step, fuzz);
+    seconds = fuzz_time() - start;
+
+    fuzz->speeds[fuzz->engine] = fuzz->length * (double)FUZZ_REPEAT / seconds / 1e6;
+
+    printf("%-10s  %-10s  %10.1f MB/s\n", CLASSIFIER_NAME, engine_names[fuzz->engine], fuzz->speeds[fuzz->engine]);
+
+    ++fuzz->engine;
+
+    return fuzz->engine >= ENGINE_COUNT;
+}
+
+/********************************************
+* Converts all the random expressions once
+* Returns 1 when it is done enough times
+********************************************/
+int  fuzz_repeat_step(void* arg)
+{
+    FUZZ* fuzz = arg;
+
+    fuzz->position = fuzz->lines;
+    iterate(fuzz_convert_step, fuzz);
+
+    --fuzz->left;
+
+    return fuzz->left <= 0;
+}
+
+/********************************************
+* Converts the next random expression
+* Returns 1 at the end of them
+********************************************/
+int  fuzz_convert_step(void* arg)
+{
+    FUZZ* fuzz = arg;
+    const char* end = fuzz->lines + fuzz->length;
+    const char* line_end = memchr(fuzz->position, '\n', end - fuzz->position);
+
+    fuzz->output.length = 0;
+    convert(fuzz->contexts + fuzz->engine, fuzz->position, line_end - fuzz->position, &fuzz->output);
+
+    fuzz->position = line_end + 1;
+
+    return fuzz->position >= end;
+}
+
+/********************************************
+* Returns monotonic time in seconds
+********************************************/
+double fuzz_time(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
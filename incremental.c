@@ -0,0 +1,288 @@
+/*============================================================================================
+* Incremental conversion of an edited expression
+*
+* The conversion of every version of the expression keeps a checkpoint at each bracket:
+* the operator stack, where the delimiter 0 of a bracket is pushed or popped, with the
+* flags of the conversion and the length of the output so far. The next version is
+* compared with the last one, and the conversion resumes at the last checkpoint before
+* the first byte that changed, so the state and the output before it are not made again.
+*
+* A checkpoint is taken before the bracket is handled and depends on the bytes before it
+* only, and a token never goes on past a bracket, so a checkpoint is valid as long as the
+* bytes up to the bracket itself are the same.
+*
+* Copyright 2006-2016 Mikhail Durnev (mdurnev@gmail.com). Released under the GPLv3
+============================================================================================*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "acyclomatic.h"
+
+
+/* data types */
+typedef struct MARK MARK;
+typedef struct PREFIX PREFIX;
+typedef struct SEARCH SEARCH;
+
+/* function prototypes */
+static void record_checkpoint(CONTEXT* ctx, const CHECKPOINT* at);
+static size_t common_prefix(const char* a, const char* b, size_t length);
+static int  prefix_block_step(void* arg);
+static int  prefix_step(void* arg);
+static size_t find_mark(const MARK* marks, size_t count, size_t offset);
+static int  search_step(void* arg);
+
+/* checkpoint kept with the offset of its stack in inc->stacks */
+struct MARK
+{
+    CHECKPOINT at;
+    size_t stack_offset;
+};
+
+/* state of comparing two strings by blocks, then by words */
+struct PREFIX
+{
+    const char* a;
+    const char* b;
+    size_t position;        /* bytes found the same so far */
+    size_t length;          /* bytes to compare */
+    int done;               /* 1 when a byte differs or all are compared */
+};
+
+/* state of the binary search for the last checkpoint before an offset */
+struct SEARCH
+{
+    const MARK* marks;
+    size_t offset;
+    size_t low;             /* the checkpoint at low is before the offset */
+    size_t high;            /* the ones from high on are not */
+};
+
+
+/* constants */
+
+/* initial sizes of the buffers, they grow as needed */
+#define EXPRESSION_SIZE 256
+#define MARKS_COUNT 16
+#define STACKS_SIZE 256
+
+/* bytes compared at once before the first one that differs is looked for by words */
+#define PREFIX_BLOCK 256
+
+
+
+/********************************************
+* Initializes the state with no expression
+* converted, the first checkpoint is the
+* beginning of the expression
+********************************************/
+void init_incremental(INCREMENTAL* inc)
+{
+    MARK start = { { 0, 0, "", 0, 0, 0, 0, 0 }, 0 };
+
+    init_context(&inc->ctx);
+    inc->ctx.checkpoint = record_checkpoint;
+
+    init_memory_output(&inc->expression, EXPRESSION_SIZE);
+    init_memory_output(&inc->postfix, EXPRESSION_SIZE);
+    init_memory_output(&inc->marks, MARKS_COUNT * sizeof(MARK));
+    init_memory_output(&inc->stacks, STACKS_SIZE);
+
+    output_string(&inc->marks, (const char*)&start, sizeof(start));
+
+    inc->kept = 0;
+    inc->resumed = 0;
+}
+
+/********************************************
+* Deallocates the state
+********************************************/
+void free_incremental(INCREMENTAL* inc)
+{
+    free_context(&inc->ctx);
+    free_memory_output(&inc->expression);
+    free_memory_output(&inc->postfix);
+    free_memory_output(&inc->marks);
+    free_memory_output(&inc->stacks);
+}
+
+/********************************************
+* Converts the expression from the last
+* checkpoint before its first byte that is
+* not the same as in the last expression
+* Writes the output after the kept bytes
+********************************************/
+int  convert_incremental(INCREMENTAL* inc, const char* in, size_t len, OUTPUT* out)
+{
+    const MARK* marks = (const MARK*)inc->marks.buffer;
+    size_t last = inc->expression.length;
+
+    /* take the minimum of the lengths */
+    size_t length = len ^ ((len ^ last) & -(size_t)(last < len));
+    size_t common = common_prefix(inc->expression.buffer, in, length);
+
+    size_t index = find_mark(marks, inc->marks.length / sizeof(MARK), common);
+    CHECKPOINT at = marks[index].at;
+    int status;
+    int ok;
+
+    /* the stack is copied by convert_resume() before the first new checkpoint */
+    /* takes its place; the checkpoint resumed at is taken again, the first    */
+    /* one stays                                                               */
+    at.stack = inc->stacks.buffer + marks[index].stack_offset;
+    inc->stacks.length = marks[index].stack_offset;
+    inc->marks.length = (index + (index == 0)) * sizeof(MARK);
+
+    inc->postfix.length = at.output_length;
+    inc->postfix.mark = 0;
+
+    status = convert_resume(&inc->ctx, in, len, &at, &inc->postfix);
+    ok = (status == STATUS_OK);
+
+    /* on error the output is replaced, and it is not the output before the */
+    /* checkpoints any more, so only the first one is left                   */
+    inc->marks.length = inc->marks.length * ok + sizeof(MARK) * (ok ^ 1);
+    inc->kept = at.output_length * ok;
+    inc->resumed = at.offset;
+
+    /* the bytes before the first one that differs are there already */
+    inc->expression.length = common;
+    output_string(&inc->expression, in + common, len - common);
+
+    output_string(out, inc->postfix.buffer + inc->kept, inc->postfix.length - inc->kept);
+
+    return status;
+}
+
+/********************************************
+* Keeps the checkpoint and a copy of its
+* stack, the hook of the context
+********************************************/
+static void record_checkpoint(CONTEXT* ctx, const CHECKPOINT* at)
+{
+    /* the context is the first field of the state */
+    INCREMENTAL* inc = (INCREMENTAL*)ctx;
+    MARK mark;
+
+    mark.at = *at;
+    mark.stack_offset = inc->stacks.length;
+
+    output_string(&inc->stacks, at->stack, at->stack_length);
+    output_string(&inc->marks, (const char*)&mark, sizeof(mark));
+}
+
+/********************************************
+* Returns the number of the first bytes that
+* are the same in both strings, up to length
+********************************************/
+static size_t common_prefix(const char* a, const char* b, size_t length)
+{
+    PREFIX prefix;
+    size_t end;
+
+    prefix.a = a;
+    prefix.b = b;
+    prefix.position = 0;
+    prefix.length = length;
+    prefix.done = (length == 0);
+
+    /* skip the blocks that are the same, then look for the byte in the block */
+    /* that is not, or in the rest shorter than a block                      */
+    iterate(prefix_block_step, &prefix);
+
+    end = prefix.position + PREFIX_BLOCK;
+    prefix.length = length ^ ((length ^ end) & -(size_t)(end < length));
+    prefix.done = (prefix.position == prefix.length);
+
+    iterate(prefix_step, &prefix);
+
+    return prefix.position;
+}
+
+/********************************************
+* Compares the next block of both strings
+* Returns 1 when the block is not the same or
+* less than a block is left
+********************************************/
+static int  prefix_block_step(void* arg)
+{
+    PREFIX* prefix = arg;
+    int whole = (prefix->length - prefix->position >= PREFIX_BLOCK);
+    int same = (memcmp(prefix->a + prefix->position, prefix->b + prefix->position, PREFIX_BLOCK * whole) == 0);
+
+    prefix->position += PREFIX_BLOCK * whole * same;
+
+    return (whole & same) ^ 1;
+}
+
+/********************************************
+* Compares the next word of both strings, the
+* last word may be shorter
+* Returns 1 when a byte differs or all the
+* bytes are compared
+********************************************/
+static int  prefix_step(void* arg)
+{
+    PREFIX* prefix = arg;
+    size_t word = sizeof(uint64_t);
+    size_t left = prefix->length - prefix->position;
+    uint64_t a = 0;
+    uint64_t b = 0;
+    uint64_t differ;
+
+    /* take the minimum of left and word, nothing is left if it is done */
+    size_t count = (left ^ ((left ^ word) & -(size_t)(word < left))) * (prefix->done ^ 1);
+
+    memcpy(&a, prefix->a + prefix->position, count);
+    memcpy(&b, prefix->b + prefix->position, count);
+
+    /* the first byte that differs, in the byte order of the CPU, the bit */
+    /* after the word keeps the count of trailing zeros defined          */
+    differ = a ^ b;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    differ = __builtin_bswap64(differ);
+#endif
+    prefix->position += __builtin_ctzll(differ | (differ == 0)) / 8 * (differ != 0) + count * (differ == 0);
+    prefix->done |= (differ != 0) | (prefix->position == prefix->length);
+
+    return prefix->done;
+}
+
+/********************************************
+* Returns the index of the last checkpoint
+* before the offset, the first one is the
+* beginning and is always taken
+********************************************/
+static size_t find_mark(const MARK* marks, size_t count, size_t offset)
+{
+    SEARCH search;
+
+    search.marks = marks;
+    search.offset = offset;
+    search.low = 0;
+    search.high = count;
+
+    iterate(search_step, &search);
+
+    return search.low;
+}
+
+/********************************************
+* Halves the range of the search
+* Returns 1 when a single checkpoint is left
+********************************************/
+static int  search_step(void* arg)
+{
+    SEARCH* search = arg;
+    size_t middle = search->low + (search->high - search->low) / 2;
+
+    /* with a single checkpoint left the middle is the low one, which is */
+    /* before the offset either way                                      */
+    int before = (search->marks[middle].at.offset < search->offset) | (middle == search->low);
+
+    search->low += (middle - search->low) * before;
+    search->high -= (search->high - middle) * (before ^ 1);
+
+    return search->high - search->low <= 1;
+}
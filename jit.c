@@ -0,0 +1,741 @@
+/*============================================================================================
+* Compilation of programs into native code
+*
+* A program is lowered into straight-line x86-64 machine code, one short sequence of
+* SSE2 instructions per opcode, so evaluating it dispatches no opcodes at all. The code
+* is a function taking the values of the symbols 'a'-'z', the way evaluate() does:
+*
+*   abc*+   ->   sub rsp, N
+*                mov [rsp + R], rdi          the bindings kept over calls of fmod() and pow()
+*                xorpd xmm0, xmm0            the result of a program that just ends
+*                movsd [rsp + 0], xmm0       every load spills the top of the stack first
+*                movsd xmm0, [rdi + 0]       LOAD a
+*                movsd [rsp + 8], xmm0
+*                movsd xmm0, [rdi + 8]       LOAD b
+*                movsd [rsp + 16], xmm0
+*                movsd xmm0, [rdi + 16]      LOAD c
+*                movsd xmm1, [rsp + 16]
+*                mulsd xmm1, xmm0            MUL
+*                movapd xmm0, xmm1
+*                movsd xmm1, [rsp + 8]
+*                addsd xmm1, xmm0            ADD
+*                movapd xmm0, xmm1
+*                add rsp, N
+*                ret
+*
+* The top of the evaluation stack is kept in xmm0 and the rest of it in the frame, the
+* depth of the stack is known at every opcode, so the places of the values are fixed
+* when the code is emitted. The values saved by OPCODE_SAVE have their places in the
+* frame too.
+*
+* On other CPUs, where no executable memory can be mapped, and for the programs whose
+* frame is larger than NATIVE_FRAME, the program is interpreted by evaluate() instead.
+*
+* Copyright 2006-2016 Mikhail Durnev (mdurnev@gmail.com). Released under the GPLv3
+============================================================================================*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <sys/mman.h>
+
+#include "acyclomatic.h"
+
+
+/* data types */
+typedef struct EMITTER EMITTER;
+typedef struct RELEASE RELEASE;
+
+/* function prototypes */
+static double native_interpret(const NATIVE* native, const double* bindings);
+static double native_run(const NATIVE* native, const double* bindings);
+static void native_unmap(NATIVE* native);
+static void native_nothing(NATIVE* native);
+
+#if defined(__x86_64__)
+static void native_emit(NATIVE* native, const PROGRAM* program, size_t frame);
+static void native_refused(NATIVE* native, const PROGRAM* program, size_t frame);
+static int  emit_step(void* arg);
+static void emit_bytes(EMITTER* emitter, const unsigned char* bytes, size_t length);
+static void emit_u32(EMITTER* emitter, uint32_t value);
+static void emit_u64(EMITTER* emitter, uint64_t value);
+static void emit_spill(EMITTER* emitter);
+static void emit_load(EMITTER* emitter);
+static void emit_arithmetic(EMITTER* emitter);
+static void emit_call(EMITTER* emitter);
+static void emit_neg(EMITTER* emitter);
+static void emit_save(EMITTER* emitter);
+static void emit_reuse(EMITTER* emitter);
+static void emit_constant(EMITTER* emitter);
+static void emit_end(EMITTER* emitter);
+static void native_install(NATIVE* native, unsigned char* memory, const unsigned char* code, size_t size);
+static void native_unmapped(NATIVE* native, unsigned char* memory, const unsigned char* code, size_t size);
+static void native_ready(NATIVE* native);
+#endif
+
+static void native_hit(NATIVE_ENTRY* entry, NATIVE_CACHE* cache, const char* expression, size_t len);
+static void native_miss(NATIVE_ENTRY* entry, NATIVE_CACHE* cache, const char* expression, size_t len);
+static int  release_step(void* arg);
+
+/* data types */
+typedef double (*NATIVE_ACTION)(const NATIVE* native, const double* bindings);
+typedef void (*UNMAP_ACTION)(NATIVE* native);
+typedef void (*EMIT_ACTION)(EMITTER* emitter);
+typedef void (*INSTALL_ACTION)(NATIVE* native, unsigned char* memory, const unsigned char* code, size_t size);
+typedef void (*ENTRY_ACTION)(NATIVE_ENTRY* entry, NATIVE_CACHE* cache, const char* expression, size_t len);
+typedef double (*NATIVE_FUNCTION)(const double* bindings);
+typedef void (*FRAME_ACTION)(NATIVE* native, const PROGRAM* program, size_t frame);
+
+/* state of the emission of the machine code */
+struct EMITTER
+{
+    const unsigned char* pc;    /* next opcode */
+    unsigned char* position;    /* next byte of the machine code */
+    uint32_t depth;             /* number of values in the stack before the opcode */
+    uint32_t slots;             /* offset of the saved values in the frame */
+    uint32_t bindings;          /* offset of the bindings kept in the frame */
+    uint32_t frame;             /* size of the frame */
+    int done;                   /* 1 after the end of the program */
+};
+
+/* expression compiled into native code, kept by its hash */
+struct NATIVE_ENTRY
+{
+    uint64_t hash;              /* hash of the expression, 0 for an empty entry */
+    char* key;                  /* the expression */
+    size_t length;
+    PROGRAM program;
+    NATIVE native;
+};
+
+/* state of releasing the entries of the cache */
+struct RELEASE
+{
+    NATIVE_ENTRY* entry;        /* next entry */
+    NATIVE_ENTRY* end;
+};
+
+
+/* function arrays */
+
+/* evaluation call table, indexed by having native code */
+static const NATIVE_ACTION native_call_table[] =
+{
+    native_interpret,
+    native_run
+};
+
+/* release call table, indexed by having native code */
+static const UNMAP_ACTION unmap_call_table[] =
+{
+    native_nothing,
+    native_unmap
+};
+
+/* lookup call table, indexed by finding the expression in its entry */
+static const ENTRY_ACTION entry_call_table[] =
+{
+    native_miss,
+    native_hit
+};
+
+#if defined(__x86_64__)
+/* emission call table, indexed by opcodes */
+static const EMIT_ACTION emit_call_table[] =
+{
+    emit_load, emit_load, emit_load, emit_load, emit_load, emit_load, emit_load, emit_load,
+    emit_load, emit_load, emit_load, emit_load, emit_load, emit_load, emit_load, emit_load,
+    emit_load, emit_load, emit_load, emit_load, emit_load, emit_load, emit_load, emit_load,
+    emit_load, emit_load,
+    emit_arithmetic,
+    emit_arithmetic,
+    emit_arithmetic,
+    emit_arithmetic,
+    emit_call,
+    emit_call,
+    emit_neg,
+    emit_save,
+    emit_reuse,
+    emit_constant,
+    emit_constant,
+    emit_end
+};
+
+/* emission call table, indexed by the frame fitting into NATIVE_FRAME */
+static const FRAME_ACTION frame_call_table[] =
+{
+    native_refused,
+    native_emit
+};
+
+/* installation call table, indexed by failure to map executable memory */
+static const INSTALL_ACTION install_call_table[] =
+{
+    native_install,
+    native_unmapped
+};
+
+/* protection call table, indexed by failure to make the memory executable */
+static const UNMAP_ACTION protect_call_table[] =
+{
+    native_ready,
+    native_unmap
+};
+
+/* functions called for the opcodes with no SSE2 instruction, from OPCODE_MOD */
+static double (* const call_functions[])(double x, double y) =
+{
+    fmod,
+    pow
+};
+
+/* values of the constants, from OPCODE_ZERO */
+static const double constant_values[] =
+{
+    0.0,
+    1.0
+};
+
+/* last byte of the opcode of the SSE2 instructions, from OPCODE_ADD */
+static const unsigned char arithmetic_opcodes[] =
+{
+    0x58,   /* addsd */
+    0x5C,   /* subsd */
+    0x59,   /* mulsd */
+    0x5E    /* divsd */
+};
+#endif
+
+
+/* constants */
+
+#if defined(__x86_64__)
+/* bytes of machine code emitted for an opcode at most, and around the opcodes */
+#define OPCODE_CODE 48
+#define FRAME_CODE 64
+
+/* largest frame, the frame is reserved by a single sub rsp and is not probed */
+/* page by page, so it must not be larger than the guard page of the stack    */
+/* to fault there; the deeper programs are interpreted                        */
+#define NATIVE_FRAME 4096
+
+/* movsd [rsp + disp32], xmm0 */
+static const unsigned char spill_code[] = { 0xF2, 0x0F, 0x11, 0x84, 0x24 };
+
+/* movsd xmm0, [rdi + disp32] */
+static const unsigned char load_code[] = { 0xF2, 0x0F, 0x10, 0x87 };
+
+/* movsd xmm0, [rsp + disp32] */
+static const unsigned char fetch_code[] = { 0xF2, 0x0F, 0x10, 0x84, 0x24 };
+
+/* movsd xmm1, [rsp + disp32] */
+static const unsigned char operand_code[] = { 0xF2, 0x0F, 0x10, 0x8C, 0x24 };
+
+/* <op>sd xmm1, xmm0 with the opcode byte in the middle, then movapd xmm0, xmm1 */
+static const unsigned char arithmetic_code[] = { 0xF2, 0x0F };
+static const unsigned char result_code[] = { 0xC8, 0x66, 0x0F, 0x28, 0xC1 };
+
+/* movapd xmm1, xmm0 */
+static const unsigned char argument_code[] = { 0x66, 0x0F, 0x28, 0xC8 };
+
+/* mov rax, imm64 */
+static const unsigned char address_code[] = { 0x48, 0xB8 };
+
+/* call rax, then mov rdi, [rsp + disp32] */
+static const unsigned char call_code[] = { 0xFF, 0xD0, 0x48, 0x8B, 0xBC, 0x24 };
+
+/* movq xmm0, rax */
+static const unsigned char constant_code[] = { 0x66, 0x48, 0x0F, 0x6E, 0xC0 };
+
+/* movq xmm1, rax; xorpd xmm0, xmm1 */
+static const unsigned char sign_code[] = { 0x66, 0x48, 0x0F, 0x6E, 0xC8, 0x66, 0x0F, 0x57, 0xC1 };
+
+/* sub rsp, imm32 */
+static const unsigned char enter_code[] = { 0x48, 0x81, 0xEC };
+
+/* mov [rsp + disp32], rdi */
+static const unsigned char keep_code[] = { 0x48, 0x89, 0xBC, 0x24 };
+
+/* xorpd xmm0, xmm0 */
+static const unsigned char zero_code[] = { 0x66, 0x0F, 0x57, 0xC0 };
+
+/* add rsp, imm32 */
+static const unsigned char leave_code[] = { 0x48, 0x81, 0xC4 };
+
+/* ret */
+static const unsigned char return_code[] = { 0xC3 };
+
+/* the sign bit of a double */
+#define SIGN_BIT 0x8000000000000000ull
+#endif
+
+
+
+#if defined(__x86_64__)
+/********************************************
+* Compiles the program into machine code,
+* the frame holds the stack below its top,
+* the saved values and the bindings
+* Returns STATUS_OK for native code
+********************************************/
+int  compile_native(NATIVE* native, const PROGRAM* program)
+{
+    /* the frame is an odd number of words, so the calls are 16-byte aligned */
+    size_t words = program->depth + 1 + program->slots + 1 + 1;
+    size_t frame = (words | 1) * sizeof(double);
+
+    native->program = program;
+    native->code = 0;
+    native->size = 0;
+    native->function = 0;
+
+    frame_call_table[frame <= NATIVE_FRAME](native, program, frame);
+
+    return STATUS_ERROR * (native->function == 0);
+}
+
+/********************************************
+* Emits the machine code of the program with
+* the frame of the given size and installs
+* it in executable memory
+********************************************/
+static void native_emit(NATIVE* native, const PROGRAM* program, size_t frame)
+{
+    EMITTER emitter;
+    size_t size = program->length * OPCODE_CODE + FRAME_CODE;
+    unsigned char* code = malloc(size);
+    unsigned char* memory;
+
+    check_allocation(code);
+
+    emitter.pc = program->code;
+    emitter.position = code;
+    emitter.depth = 0;
+    emitter.slots = (program->depth + 1) * sizeof(double);
+    emitter.bindings = emitter.slots + (program->slots + 1) * sizeof(double);
+    emitter.frame = frame;
+    emitter.done = 0;
+
+    emit_bytes(&emitter, enter_code, sizeof(enter_code));
+    emit_u32(&emitter, emitter.frame);
+    emit_bytes(&emitter, keep_code, sizeof(keep_code));
+    emit_u32(&emitter, emitter.bindings);
+    emit_bytes(&emitter, zero_code, sizeof(zero_code));
+
+    iterate(emit_step, &emitter);
+
+    size = emitter.position - code;
+    memory = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    install_call_table[memory == MAP_FAILED](native, memory, code, size);
+
+    free(code);
+}
+
+/********************************************
+* Leaves the program to the interpreter, its
+* frame is too large
+********************************************/
+static void native_refused(NATIVE* native, const PROGRAM* program, size_t frame)
+{
+}
+#else
+/********************************************
+* Keeps the program to interpret it, there
+* is no native code for this CPU
+* Returns STATUS_ERROR
+********************************************/
+int  compile_native(NATIVE* native, const PROGRAM* program)
+{
+    native->program = program;
+    native->code = 0;
+    native->size = 0;
+    native->function = 0;
+
+    return STATUS_ERROR;
+}
+#endif
+
+/********************************************
+* Deallocates the native code
+********************************************/
+void free_native(NATIVE* native)
+{
+    unmap_call_table[native->code != 0](native);
+}
+
+/********************************************
+* Evaluates the program with the values of
+* the symbols 'a'-'z' given by bindings
+********************************************/
+double evaluate_native(const NATIVE* native, const double* bindings)
+{
+    return native_call_table[native->function != 0](native, bindings);
+}
+
+/********************************************
+* Initializes the cache with the number of
+* entries rounded down to a power of 2, at
+* least 1
+********************************************/
+void init_native_cache(NATIVE_CACHE* cache, size_t entries)
+{
+    uint64_t count = entries | 1;
+
+    /* round down to a power of 2 */
+    count |= count >> 1;
+    count |= count >> 2;
+    count |= count >> 4;
+    count |= count >> 8;
+    count |= count >> 16;
+    count |= count >> 32;
+    count -= count >> 1;
+
+    /* the entries are empty with the hash 0 and have no code or program */
+    cache->entries = calloc(count, sizeof(NATIVE_ENTRY));
+    check_allocation(cache->entries);
+    cache->mask = count - 1;
+    cache->hits = 0;
+    cache->misses = 0;
+
+    init_context(&cache->ctx);
+    cache->ctx.tree = 1;
+    cache->ctx.dag = 1;
+    init_memory_output(&cache->output, 1024);
+}
+
+/********************************************
+* Deallocates the cache with all the code
+********************************************/
+void free_native_cache(NATIVE_CACHE* cache)
+{
+    RELEASE release;
+
+    release.entry = cache->entries;
+    release.end = cache->entries + cache->mask + 1;
+
+    iterate(release_step, &release);
+
+    free(cache->entries);
+    free_context(&cache->ctx);
+    free_memory_output(&cache->output);
+
+    cache->entries = 0;
+    cache->mask = 0;
+}
+
+/********************************************
+* Returns the native code of the expression,
+* compiling it unless it is in its entry
+* An expression with an error evaluates to 0
+********************************************/
+const NATIVE* native_cached(NATIVE_CACHE* cache, const char* expression, size_t len)
+{
+    uint64_t hash = hash_bytes(expression, len);
+    NATIVE_ENTRY* entry = cache->entries + (hash & cache->mask);
+
+    /* the bytes are compared only if the hash and the length are the same, */
+    /* an empty entry has no key, the expression is compared with itself    */
+    int tagged = (entry->hash == hash) & (entry->length == len);
+    const char* keys[2] = { expression, entry->key };
+    int found = tagged & (memcmp(keys[tagged], expression, len * tagged) == 0);
+
+    entry->hash = hash;
+    entry_call_table[found](entry, cache, expression, len);
+
+    return &entry->native;
+}
+
+/********************************************
+* Counts the expression found compiled
+********************************************/
+static void native_hit(NATIVE_ENTRY* entry, NATIVE_CACHE* cache, const char* expression, size_t len)
+{
+    ++cache->hits;
+}
+
+/********************************************
+* Replaces the expression in the entry with
+* the one given and compiles it
+********************************************/
+static void native_miss(NATIVE_ENTRY* entry, NATIVE_CACHE* cache, const char* expression, size_t len)
+{
+    free(entry->key);
+    free_native(&entry->native);
+
+    entry->key = malloc(len + 1);
+    check_allocation(entry->key);
+    entry->length = len;
+    memcpy(entry->key, expression, len);
+
+    cache->output.length = 0;
+    cache->output.mark = 0;
+    convert(&cache->ctx, expression, len, &cache->output);
+
+    compile_tree(&entry->program, &cache->ctx);
+    compile_native(&entry->native, &entry->program);
+
+    ++cache->misses;
+}
+
+/********************************************
+* Releases the next entry of the cache
+* Returns 1 after the last entry
+********************************************/
+static int  release_step(void* arg)
+{
+    RELEASE* release = arg;
+
+    free(release->entry->key);
+    free_native(&release->entry->native);
+    free_program(&release->entry->program);
+
+    ++release->entry;
+
+    return release->entry == release->end;
+}
+
+/********************************************
+* Evaluates the program by the interpreter
+********************************************/
+static double native_interpret(const NATIVE* native, const double* bindings)
+{
+    return evaluate(native->program, bindings);
+}
+
+/********************************************
+* Evaluates the program by its native code
+********************************************/
+static double native_run(const NATIVE* native, const double* bindings)
+{
+    return native->function(bindings);
+}
+
+/********************************************
+* Unmaps the native code, the program is
+* interpreted from now on
+********************************************/
+static void native_unmap(NATIVE* native)
+{
+    munmap(native->code, native->size);
+
+    native->code = 0;
+    native->size = 0;
+    native->function = 0;
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+static void native_nothing(NATIVE* native)
+{
+}
+
+#if defined(__x86_64__)
+/********************************************
+* Emits the code of the next opcode
+* Returns 1 after the end of the program
+********************************************/
+static int  emit_step(void* arg)
+{
+    EMITTER* emitter = arg;
+
+    emit_call_table[*emitter->pc](emitter);
+
+    return emitter->done;
+}
+
+/********************************************
+* Emits the bytes
+********************************************/
+static void emit_bytes(EMITTER* emitter, const unsigned char* bytes, size_t length)
+{
+    memcpy(emitter->position, bytes, length);
+    emitter->position += length;
+}
+
+/********************************************
+* Emits a 32-bit displacement or immediate
+********************************************/
+static void emit_u32(EMITTER* emitter, uint32_t value)
+{
+    memcpy(emitter->position, &value, sizeof(value));
+    emitter->position += sizeof(value);
+}
+
+/********************************************
+* Emits a 64-bit immediate
+********************************************/
+static void emit_u64(EMITTER* emitter, uint64_t value)
+{
+    memcpy(emitter->position, &value, sizeof(value));
+    emitter->position += sizeof(value);
+}
+
+/********************************************
+* Emits storing the top of the stack below
+* the value pushed next, with no values the
+* first word of the frame takes it
+********************************************/
+static void emit_spill(EMITTER* emitter)
+{
+    emit_bytes(emitter, spill_code, sizeof(spill_code));
+    emit_u32(emitter, emitter->depth * sizeof(double));
+}
+
+/********************************************
+* Emits pushing the value of a symbol
+********************************************/
+static void emit_load(EMITTER* emitter)
+{
+    emit_spill(emitter);
+    emit_bytes(emitter, load_code, sizeof(load_code));
+    emit_u32(emitter, *emitter->pc * sizeof(double));
+
+    ++emitter->depth;
+    ++emitter->pc;
+}
+
+/********************************************
+* Emits an operation having an instruction,
+* the value below the top is the first
+* operand and takes the result
+********************************************/
+static void emit_arithmetic(EMITTER* emitter)
+{
+    emit_bytes(emitter, operand_code, sizeof(operand_code));
+    emit_u32(emitter, (emitter->depth - 1) * sizeof(double));
+    emit_bytes(emitter, arithmetic_code, sizeof(arithmetic_code));
+    emit_bytes(emitter, &arithmetic_opcodes[*emitter->pc - OPCODE_ADD], 1);
+    emit_bytes(emitter, result_code, sizeof(result_code));
+
+    --emitter->depth;
+    ++emitter->pc;
+}
+
+/********************************************
+* Emits calling the function of an operation,
+* the bindings are taken back from the frame
+* after the call
+********************************************/
+static void emit_call(EMITTER* emitter)
+{
+    emit_bytes(emitter, argument_code, sizeof(argument_code));
+    emit_bytes(emitter, fetch_code, sizeof(fetch_code));
+    emit_u32(emitter, (emitter->depth - 1) * sizeof(double));
+    emit_bytes(emitter, address_code, sizeof(address_code));
+    emit_u64(emitter, (uintptr_t)call_functions[*emitter->pc - OPCODE_MOD]);
+    emit_bytes(emitter, call_code, sizeof(call_code));
+    emit_u32(emitter, emitter->bindings);
+
+    --emitter->depth;
+    ++emitter->pc;
+}
+
+/********************************************
+* Emits negating the top of the stack by its
+* sign bit
+********************************************/
+static void emit_neg(EMITTER* emitter)
+{
+    emit_bytes(emitter, address_code, sizeof(address_code));
+    emit_u64(emitter, SIGN_BIT);
+    emit_bytes(emitter, sign_code, sizeof(sign_code));
+
+    ++emitter->pc;
+}
+
+/********************************************
+* Emits saving the top of the stack in the
+* place of its slot
+********************************************/
+static void emit_save(EMITTER* emitter)
+{
+    uint32_t slot;
+
+    memcpy(&slot, emitter->pc + 1, OPCODE_SLOT_BYTES);
+
+    emit_bytes(emitter, spill_code, sizeof(spill_code));
+    emit_u32(emitter, emitter->slots + slot * sizeof(double));
+
+    emitter->pc += 1 + OPCODE_SLOT_BYTES;
+}
+
+/********************************************
+* Emits pushing the value saved in the place
+* of its slot
+********************************************/
+static void emit_reuse(EMITTER* emitter)
+{
+    uint32_t slot;
+
+    memcpy(&slot, emitter->pc + 1, OPCODE_SLOT_BYTES);
+
+    emit_spill(emitter);
+    emit_bytes(emitter, fetch_code, sizeof(fetch_code));
+    emit_u32(emitter, emitter->slots + slot * sizeof(double));
+
+    ++emitter->depth;
+    emitter->pc += 1 + OPCODE_SLOT_BYTES;
+}
+
+/********************************************
+* Emits pushing a constant, its bits are an
+* immediate
+********************************************/
+static void emit_constant(EMITTER* emitter)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &constant_values[*emitter->pc - OPCODE_ZERO], sizeof(bits));
+
+    emit_spill(emitter);
+    emit_bytes(emitter, address_code, sizeof(address_code));
+    emit_u64(emitter, bits);
+    emit_bytes(emitter, constant_code, sizeof(constant_code));
+
+    ++emitter->depth;
+    ++emitter->pc;
+}
+
+/********************************************
+* Emits returning the top of the stack
+********************************************/
+static void emit_end(EMITTER* emitter)
+{
+    emit_bytes(emitter, leave_code, sizeof(leave_code));
+    emit_u32(emitter, emitter->frame);
+    emit_bytes(emitter, return_code, sizeof(return_code));
+
+    emitter->done = 1;
+}
+
+/********************************************
+* Copies the code into the mapped memory and
+* makes it executable
+********************************************/
+static void native_install(NATIVE* native, unsigned char* memory, const unsigned char* code, size_t size)
+{
+    memcpy(memory, code, size);
+
+    native->code = memory;
+    native->size = size;
+
+    protect_call_table[mprotect(memory, size, PROT_READ | PROT_EXEC) != 0](native);
+}
+
+/********************************************
+* Leaves the program interpreted, there is no
+* memory for the code
+********************************************/
+static void native_unmapped(NATIVE* native, unsigned char* memory, const unsigned char* code, size_t size)
+{
+}
+
+/********************************************
+* Takes the executable code as the function
+********************************************/
+static void native_ready(NATIVE* native)
+{
+    native->function = (NATIVE_FUNCTION)native->code;
+}
+#endif
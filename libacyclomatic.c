@@ -0,0 +1,3277 @@
+/*============================================================================================
+* This is an example of a program where the cyclomatic complexity of each function equals 1:
+* - all loops are converted into recursive function calls,
+* - all branching statements are replaced with arithmetic and logical calculations
+*
+* This library converts an arithmetical expression into the postfix form
+*
+* Expression should be composed of following characters:
+*   alphabetical low-case characters 'a'-'z',
+*   additive low-priority operations '+' and '-',
+*   multiplicative high-priority operations '*', '/' and '%',
+*   right-associative power '^' binding tighter than all of them,
+*   unary minus '-' (written as '~' in the postfix form),
+*   round brackets '(' and ')'.
+*
+* Example:
+*   a+(b+c*d)*e+f/g+h   ->   abcd*+e*+fg/+h+
+*   -a^b^c%d            ->   abc^^~d%
+*
+* Copyright 2006-2016 Mikhail Durnev (mdurnev@gmail.com). Released under the GPLv3
+============================================================================================*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "acyclomatic.h"
+
+
+/* data types */
+typedef struct ITERATION ITERATION;
+typedef struct PREPASS PREPASS;
+typedef struct MASKS MASKS;
+typedef struct SKIP SKIP;
+typedef struct RUN RUN;
+typedef struct DRAIN DRAIN;
+typedef struct LETTERS LETTERS;
+typedef struct WALK WALK;
+typedef struct SHARE SHARE;
+
+/* function prototypes */
+static int  convert_whole(CONTEXT* ctx, const char* in, size_t len, OUTPUT* out);
+static int  resume_buffered(CONTEXT* ctx, const char* in, size_t len, const CHECKPOINT* at, OUTPUT* out);
+static int  resume_spilled(CONTEXT* ctx, const char* in, size_t len, const CHECKPOINT* at, OUTPUT* out);
+static void convert_recursive(CONTEXT* ctx, const char* str);
+static void convert_trampoline(CONTEXT* ctx, const char* str);
+static void convert_simd(CONTEXT* ctx, const char* str);
+static void convert_prepared(CONTEXT* ctx, const char* str);
+static void convert_rejected(CONTEXT* ctx, const char* str);
+static void convert_validated(CONTEXT* ctx, const char* str);
+static int  classify(CONTEXT* ctx, const char* str);
+static int  classify_char(char c, int tokens);
+static int  balance(CONTEXT* ctx, int call_index);
+static void handle_error(CONTEXT* ctx, const char* str);
+static void handle_end(CONTEXT* ctx, const char* str);
+static void handle_symbol(CONTEXT* ctx, const char* str);
+static void handle_operator(CONTEXT* ctx, const char* str);
+static void handle_open_bracket(CONTEXT* ctx, const char* str);
+static void handle_close_bracket(CONTEXT* ctx, const char* str);
+static void handle_number(CONTEXT* ctx, const char* str);
+
+static const char* step_error(CONTEXT* ctx, const char* str);
+static const char* step_end(CONTEXT* ctx, const char* str);
+static const char* step_symbol(CONTEXT* ctx, const char* str);
+static const char* step_operator(CONTEXT* ctx, const char* str);
+static const char* step_open_bracket(CONTEXT* ctx, const char* str);
+static const char* step_close_bracket(CONTEXT* ctx, const char* str);
+static const char* step_finished(CONTEXT* ctx, const char* str);
+static const char* step_classified(CONTEXT* ctx, const char* str);
+static const char* step_prepared(CONTEXT* ctx, const char* str);
+static const char* step_validated(CONTEXT* ctx, const char* str);
+static const char* symbols_marked(CONTEXT* ctx, const char* str);
+static void skip_nothing(SKIP* skip);
+static void skip_words(SKIP* skip);
+static int  skip_step(void* arg);
+static void take_checkpoint(CONTEXT* ctx, const char* str);
+static void skip_checkpoint(CONTEXT* ctx, const char* str);
+static const char* step_number(CONTEXT* ctx, const char* str);
+static const char* symbol_single(CONTEXT* ctx, const char* str);
+static const char* symbol_run(CONTEXT* ctx, const char* str);
+static const char* symbol_identifier(CONTEXT* ctx, const char* str);
+static const char* span(CONTEXT* ctx, const char* str, int (*member)(int c));
+static int  span_step(void* arg);
+static int  identifier_char(int c);
+static int  digit_char(int c);
+
+static int  run_step(void* arg);
+static void run_word(RUN* run);
+static void run_bytes(RUN* run);
+static void run_byte(RUN* run);
+
+static void trampoline(CONTEXT* ctx, int level);
+static void trampoline_block(CONTEXT* ctx, int level);
+static void trampoline_split(CONTEXT* ctx, int level);
+static void trampoline_steps(CONTEXT* ctx, int level);
+static void trampoline_step(CONTEXT* ctx);
+static void trampoline_nothing(CONTEXT* ctx, int level);
+
+static void print_nothing(CONTEXT* ctx, char c);
+static void print_char(CONTEXT* ctx, char c);
+static void emit_text(CONTEXT* ctx, const char* token, size_t length);
+static void emit_spaced(CONTEXT* ctx, const char* token, size_t length);
+static void emit_hook(CONTEXT* ctx, const char* token, size_t length);
+static void emit_tree(CONTEXT* ctx, const char* token, size_t length);
+static void emit_packed(CONTEXT* ctx, const char* token, size_t length);
+static int  packed_step(void* arg);
+static void pack_code(CONTEXT* ctx, char c);
+static void emit_char_text(CONTEXT* ctx, const char* c);
+static void emit_char(CONTEXT* ctx, const char* c);
+static void record_end(CONTEXT* ctx);
+static void record_nothing(CONTEXT* ctx);
+static void record_rejected(CONTEXT* ctx);
+
+static void tree_start(CONTEXT* ctx);
+static void tree_nothing(CONTEXT* ctx);
+static void tree_letters(CONTEXT* ctx, const char* token, size_t length);
+static int  letters_step(void* arg);
+static void tree_operand(CONTEXT* ctx, const char* token, size_t length);
+static void tree_operation(CONTEXT* ctx, const char* token, size_t length);
+static void tree_end(CONTEXT* ctx);
+static void print_tree(CONTEXT* ctx);
+static int  walk_step(void* arg);
+static void walk_operand(WALK* walk, const NODE* node);
+static void walk_operation(WALK* walk, const NODE* node);
+static void walk_close(WALK* walk, const NODE* node);
+static void walk_reference(WALK* walk, const NODE* node);
+static void walk_label(WALK* walk, const NODE* node);
+static void walk_unlabeled(WALK* walk, const NODE* node);
+
+static void tree_distinct(CONTEXT* ctx, NODE* node);
+static void tree_share(CONTEXT* ctx, NODE* node);
+static int  share_step(void* arg);
+static void share_new(SHARE* share);
+static void share_found(SHARE* share);
+static void share_use(CONTEXT* ctx, NODE* node);
+static uint64_t node_hash(const NODE* node);
+static int  node_equal(const NODE* a, const NODE* b);
+static void shared_reset(CONTEXT* ctx, size_t count);
+static void shared_keep(CONTEXT* ctx, size_t count);
+static size_t power_of_2(size_t value);
+
+static void push(char c, char** stack_top);
+#ifdef ACYCLOMATIC_STATS
+static void stats_stack(CONTEXT* ctx);
+#endif
+static void pop0(char** stack_top);
+static void pop_operators(CONTEXT* ctx, int binding);
+static int  pop_operator(CONTEXT* ctx, int binding);
+static void drain_operators(CONTEXT* ctx, int binding);
+static void drain_nothing(CONTEXT* ctx, int binding);
+static int  drain_step(void* arg);
+
+static void reset_stack(CONTEXT* ctx, size_t length);
+static void stack_grow(CONTEXT* ctx, size_t depth);
+static void stack_keep(CONTEXT* ctx, size_t depth);
+static void classes_grow(CONTEXT* ctx, size_t size);
+static void classes_keep(CONTEXT* ctx, size_t size);
+static void nodes_grow(CONTEXT* ctx, size_t count);
+static void nodes_keep(CONTEXT* ctx, size_t count);
+static void allocated(void* memory);
+static void allocation_failed(void* memory);
+
+static void output_string_rest(OUTPUT* output, const char* str, size_t length);
+static void output_nothing(OUTPUT* output, const char* str, size_t length);
+static void output_flush_full(OUTPUT* output);
+static void output_keep(OUTPUT* output);
+static void output_write(OUTPUT* output);
+static void output_grow(OUTPUT* output);
+static void write_all(OUTPUT* output, const char* data, size_t length);
+static void write_rest(OUTPUT* output, const char* data, size_t length);
+static void write_nothing(OUTPUT* output, const char* data, size_t length);
+
+static int  prepass_step(void* arg);
+static void prepass_block(PREPASS* prepass);
+static void prepass_tail(PREPASS* prepass);
+static void prepass_masks(PREPASS* prepass, const MASKS* masks);
+static void brackets_counted(PREPASS* prepass);
+static void brackets_walked(PREPASS* prepass);
+static int  bracket_step(void* arg);
+static void classify_block(const char* bytes, unsigned char* classes, int tokens, MASKS* masks);
+#if defined(__ARM_NEON) && !defined(__AVX2__) && !defined(__SSE2__)
+static uint64_t neon_mask(uint8x16_t bytes);
+#endif
+#if !defined(__AVX2__) && !defined(__SSE2__) && !defined(__ARM_NEON)
+static void classify_bytes(const char* bytes, unsigned char* classes, int count, int tokens, MASKS* masks);
+static void classify_bytes_rest(const char* bytes, unsigned char* classes, int count, int tokens, MASKS* masks);
+static void classify_bytes_nothing(const char* bytes, unsigned char* classes, int count, int tokens, MASKS* masks);
+#endif
+
+static void iterate_blocks(ITERATION* it, int level);
+static void iterate_block(ITERATION* it, int level);
+static void iterate_split(ITERATION* it, int level);
+static void iterate_once(ITERATION* it, int level);
+static void iterate_nothing(ITERATION* it, int level);
+
+/* data types */
+typedef void (*ACTION)(CONTEXT* ctx, const char* str);
+typedef const char* (*STEP_ACTION)(CONTEXT* ctx, const char* str);
+typedef void (*LEVEL_ACTION)(CONTEXT* ctx, int level);
+typedef void (*DRAIN_ACTION)(CONTEXT* ctx, int binding);
+typedef void (*PRINT_ACTION)(CONTEXT* ctx, char str);
+typedef void (*CHAR_ACTION)(CONTEXT* ctx, const char* c);
+typedef void (*TREE_ACTION)(CONTEXT* ctx);
+typedef void (*WALK_ACTION)(WALK* walk, const NODE* node);
+typedef void (*NODE_ACTION)(CONTEXT* ctx, NODE* node);
+typedef void (*SHARE_ACTION)(SHARE* share);
+typedef void (*EMIT_ACTION)(CONTEXT* ctx, const char* token, size_t length);
+typedef void (*RESERVE_ACTION)(CONTEXT* ctx, size_t depth);
+typedef void (*CHECK_ACTION)(void* memory);
+typedef void (*FLUSH_ACTION)(OUTPUT* output);
+typedef void (*STRING_ACTION)(OUTPUT* output, const char* str, size_t length);
+typedef void (*WRITE_ACTION)(OUTPUT* output, const char* data, size_t length);
+typedef void (*ITERATE_ACTION)(ITERATION* it, int level);
+typedef void (*PREPASS_ACTION)(PREPASS* prepass);
+typedef void (*SKIP_ACTION)(SKIP* skip);
+typedef void (*RUN_ACTION)(RUN* run);
+typedef void (*BYTES_ACTION)(const char* bytes, unsigned char* classes, int count, int tokens, MASKS* masks);
+typedef int (*CONVERT_ACTION)(CONTEXT* ctx, const char* in, size_t len, OUTPUT* out);
+typedef int (*RESUME_ACTION)(CONTEXT* ctx, const char* in, size_t len, const CHECKPOINT* at, OUTPUT* out);
+
+/* state of a bounded-depth iteration */
+struct ITERATION
+{
+    int (*step)(void* arg); /* performs one step, returns 1 when there are no more steps */
+    void* arg;              /* argument of the step function */
+    int done;               /* 1 when the last step has been done */
+};
+
+/* state of the scan for a run of symbols a-z, or of the characters of a token */
+struct RUN
+{
+    const char* position;   /* first byte that is not scanned yet */
+    const char* end;        /* end of the input */
+    int done;               /* 1 when the end of the run is found */
+    int (*member)(int c);   /* returns 1 for the characters of the token */
+};
+
+/* state of popping the operations that bind at least as tightly as an operation */
+struct DRAIN
+{
+    CONTEXT* ctx;
+    int binding;            /* binding of the operation, see binding_table */
+};
+
+/* state of adding a run of symbols a-z to the tree, one operand per symbol */
+struct LETTERS
+{
+    CONTEXT* ctx;
+    const char* position;   /* next symbol of the run */
+    const char* end;        /* end of the run */
+};
+
+/* state of printing the tree */
+struct WALK
+{
+    OUTPUT* output;
+    const NODE** pending;   /* nodes left to print, the last one is printed next */
+    size_t count;           /* number of pending nodes */
+    int spaced;             /* 1 once anything is printed, so a space goes before the next */
+    size_t* labels;         /* labels of the shared subtrees by slots, 0 - not printed yet */
+    size_t label;           /* last label given */
+};
+
+/* state of looking a node up in the hash table of the distinct subtrees */
+struct SHARE
+{
+    CONTEXT* ctx;
+    NODE* node;
+    size_t position;        /* entry of the table looked at */
+};
+
+/* state of the vectorized classification of the input */
+struct PREPASS
+{
+    CONTEXT* ctx;
+    size_t position;        /* offset of the next block */
+    size_t length;          /* length of the input */
+    size_t stop;            /* offset of the first end or error */
+    int done;               /* 1 when the stop is found */
+    size_t depth;           /* depth of brackets after the blocks classified so far */
+    size_t open_offset;     /* offset of the outermost bracket that is open */
+    int imbalance;          /* STATUS_UNMATCHED_CLOSE once a ')' at depth 0 is found */
+    int dots;               /* 1 if a '.' is before the stop, see HANDLE_DOT */
+    uint64_t opens;         /* brackets of the block before the stop not counted yet */
+    uint64_t closes;
+    size_t base;            /* offset of the first byte of ctx->symbols */
+};
+
+/* masks of the bytes of a block, bit N stands for byte N */
+struct MASKS
+{
+    uint64_t stops;         /* ends and errors */
+    uint64_t opens;         /* '(' */
+    uint64_t closes;        /* ')' */
+    uint64_t dots;          /* '.' of the tokenizer mode */
+    uint64_t symbols;       /* a-z, and 0-9 and '_' of the tokenizer mode */
+};
+
+/* state of the scan for the end of a run of symbols in ctx->symbols */
+struct SKIP
+{
+    const uint64_t* words;
+    size_t word;            /* word looked at */
+    size_t base;            /* index of the bit others starts at */
+    uint64_t others;        /* bits of the bytes from base on that are not symbols */
+};
+
+
+/* function arrays */
+
+/* conversion call table, indexed by the expression being split between threads */
+static const CONVERT_ACTION convert_call_table[] =
+{
+    convert_whole,
+    convert_split
+};
+
+/* resume call table, indexed by a record being longer than the buffer written to a file */
+static const RESUME_ACTION resume_call_table[] =
+{
+    resume_buffered,
+    resume_spilled
+};
+
+/* global call table */
+static const ACTION call_table[] =
+{
+    handle_error,
+    handle_end,
+    handle_symbol,
+    handle_operator,
+    handle_open_bracket,
+    handle_close_bracket,
+    handle_number,
+    handle_error
+};
+
+/* step call table, used by the trampoline, indexed as global call table */
+static const STEP_ACTION step_table[] =
+{
+    step_error,
+    step_end,
+    step_symbol,
+    step_operator,
+    step_open_bracket,
+    step_close_bracket,
+    step_number,
+    step_error,
+    step_finished
+};
+
+/* checkpoint call table, indexed by the checkpoint hook being set */
+static const ACTION checkpoint_call_table[] =
+{
+    skip_checkpoint,
+    take_checkpoint
+};
+
+/* trampoline call table, see trampoline_block() */
+static const LEVEL_ACTION trampoline_call_table[] =
+{
+    trampoline_nothing,
+    trampoline_split,
+    trampoline_steps
+};
+
+/* continuation of the trampoline, indexed by the finished flag */
+static const LEVEL_ACTION trampoline_next_table[] =
+{
+    trampoline,
+    trampoline_nothing
+};
+
+/* conversion engines, indexed by ENGINE_* constants */
+static const ACTION engine_table[] =
+{
+    convert_recursive,
+    convert_trampoline,
+    convert_simd
+};
+
+/* symbol call table, indexed by the next character being a symbol too, */
+/* or 2 in the tokenizer mode                                             */
+static const STEP_ACTION symbol_call_table[] =
+{
+    symbol_single,
+    symbol_run,
+    symbol_identifier
+};
+
+/* run scan call table, indexed by a whole word being left in the input */
+static const RUN_ACTION run_call_table[] =
+{
+    run_bytes,
+    run_word
+};
+
+/* prepass call table, indexed by a whole block being left in the input */
+static const PREPASS_ACTION prepass_call_table[] =
+{
+    prepass_tail,
+    prepass_block
+};
+
+/* bracket call table, indexed by the depth reaching 0 in the block */
+static const PREPASS_ACTION brackets_call_table[] =
+{
+    brackets_counted,
+    brackets_walked
+};
+
+/* prepared conversion call table, indexed by the input being rejected, */
+/* or 2 for the input with dots                                          */
+static const ACTION prepared_call_table[] =
+{
+    convert_validated,
+    convert_rejected,
+    convert_prepared
+};
+
+/* step call table of the input the prepass found no error in, indexed as */
+/* global call table, a run of symbols and the token after it are a step  */
+static const STEP_ACTION validated_table[] =
+{
+    step_error,
+    step_end,
+    symbols_marked,
+    step_operator,
+    step_open_bracket,
+    step_close_bracket,
+    step_number,
+    step_error
+};
+
+/* run end call table, indexed by the run going on past the word */
+static const SKIP_ACTION skip_call_table[] =
+{
+    skip_nothing,
+    skip_words
+};
+
+#if !defined(__AVX2__) && !defined(__SSE2__) && !defined(__ARM_NEON)
+/* byte classification call table, indexed by having no bytes left */
+static const BYTES_ACTION bytes_call_table[] =
+{
+    classify_bytes_rest,
+    classify_bytes_nothing
+};
+#endif
+
+/* class buffer reserve call table, indexed by the buffer being too small */
+static const RESERVE_ACTION classes_call_table[] =
+{
+    classes_keep,
+    classes_grow
+};
+
+/* error reasons, indexed by STATUS_* constants */
+static const char* const error_reasons[] =
+{
+    "",
+    "invalid character",
+    "unmatched close bracket",
+    "unclosed bracket"
+};
+
+/* emitters, indexed by the tokenizer mode, 2 for the emit function of the caller, */
+/* 3 for the tree mode or 4 for the packed mode                                     */
+static const EMIT_ACTION emit_call_table[] =
+{
+    emit_text,
+    emit_spaced,
+    emit_hook,
+    emit_tree,
+    emit_packed
+};
+
+/* single character emitters, indexed as emitters */
+static const CHAR_ACTION emit_char_call_table[] =
+{
+    emit_char_text,
+    emit_char,
+    emit_char,
+    emit_char,
+    emit_char
+};
+
+/* record call table, indexed by the packed mode */
+static const TREE_ACTION record_call_table[] =
+{
+    record_nothing,
+    record_end
+};
+
+/* record length call table, indexed by the record being too long for its header */
+static const TREE_ACTION record_length_table[] =
+{
+    record_nothing,
+    record_rejected
+};
+
+/* tree call table, indexed by the tree mode */
+static const TREE_ACTION tree_start_table[] =
+{
+    tree_nothing,
+    tree_start
+};
+
+static const TREE_ACTION tree_end_table[] =
+{
+    tree_nothing,
+    tree_end
+};
+
+/* tree finishing call table, indexed by the simplify mode */
+static const TREE_ACTION finish_call_table[] =
+{
+    print_tree,
+    simplify_tree
+};
+
+/* tree building call table, indexed by the tokenizer mode, or 2 for operations */
+static const EMIT_ACTION tree_call_table[] =
+{
+    tree_letters,
+    tree_operand,
+    tree_operation
+};
+
+/* tree printing call table, indexed by the arity of the node, or TREE_CLOSE, */
+/* or WALK_REFERENCE for a shared subtree printed before                      */
+static const WALK_ACTION walk_call_table[] =
+{
+    walk_operand,
+    walk_operation,
+    walk_operation,
+    walk_close,
+    walk_reference
+};
+
+/* label call table, indexed by the operation being shared */
+static const WALK_ACTION label_call_table[] =
+{
+    walk_unlabeled,
+    walk_label
+};
+
+/* sharing call table, indexed by the DAG mode */
+static const NODE_ACTION share_call_table[] =
+{
+    tree_distinct,
+    tree_share
+};
+
+/* sharing call table, indexed by finding an identical subtree in the table */
+static const SHARE_ACTION found_call_table[] =
+{
+    share_new,
+    share_found
+};
+
+/* hash table reset call table, indexed by the DAG mode in the tree mode */
+static const RESERVE_ACTION shared_call_table[] =
+{
+    shared_keep,
+    shared_reset
+};
+
+/* node arena reserve call table, indexed by the arena being too small in the tree mode */
+static const RESERVE_ACTION nodes_call_table[] =
+{
+    nodes_keep,
+    nodes_grow
+};
+
+/* print call table, indexed by the operation being popped */
+static const PRINT_ACTION print_call_table[] =
+{
+    print_nothing,
+    print_char
+};
+
+/* popping the rest of operations, indexed by the first two being popped */
+static const DRAIN_ACTION drain_call_table[] =
+{
+    drain_nothing,
+    drain_operators
+};
+
+/* precedence of the operations in the stack, 0 for the delimiter of brackets */
+/* and the bottom of the stack, so they are never popped as operations;      */
+/* '~' is the unary minus, it binds tighter than '*' but not than '^':        */
+/*   + -  1,   * / %  2,   ~  3,   ^  4                                        */
+static const unsigned char precedence_table[256] =
+{
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 00-0F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 10-1F */
+    0, 0, 0, 0, 0, 2, 0, 0, 0, 0, 2, 1, 0, 1, 0, 2,  /* 20-2F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 30-3F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 40-4F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0,  /* 50-5F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 60-6F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 3, 0,  /* 70-7F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 80-8F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 90-9F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* A0-AF */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* B0-BF */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* C0-CF */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* D0-DF */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* E0-EF */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0   /* F0-FF */
+};
+
+/* binding of the operations coming from the input: the operations in the    */
+/* stack with precedence >= binding are popped before the operation is pushed */
+/* it is the precedence for the left-associative operations and 1 more for    */
+/* the right-associative '^', the prefix '~' pops nothing:                    */
+/*   + -  1,   * / %  2,   ~ ^  5                                              */
+static const unsigned char binding_table[256] =
+{
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 00-0F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 10-1F */
+    0, 0, 0, 0, 0, 2, 0, 0, 0, 0, 2, 1, 0, 1, 0, 2,  /* 20-2F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 30-3F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 40-4F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 5, 0,  /* 50-5F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 60-6F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 5, 0,  /* 70-7F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 80-8F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 90-9F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* A0-AF */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* B0-BF */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* C0-CF */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* D0-DF */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* E0-EF */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0   /* F0-FF */
+};
+
+/* stack reserve call table, indexed by the stack being too small */
+static const RESERVE_ACTION reserve_call_table[] =
+{
+    stack_keep,
+    stack_grow
+};
+
+/* allocation check call table, indexed by failure to allocate memory */
+static const CHECK_ACTION allocation_check_table[] =
+{
+    allocated,
+    allocation_failed
+};
+
+/* flush call table, indexed by the output buffer being full */
+static const FLUSH_ACTION flush_call_table[] =
+{
+    output_keep,
+    output_flush_full
+};
+
+/* output call table, indexed by having nothing left to output */
+static const STRING_ACTION output_call_table[] =
+{
+    output_string_rest,
+    output_nothing
+};
+
+/* write call table, indexed by having nothing left to write or a failed write */
+static const WRITE_ACTION write_call_table[] =
+{
+    write_rest,
+    write_nothing
+};
+
+#ifdef TABLE_CLASSIFIER
+/* classifier tables, map a character to an index in global call table, */
+/* the second one is used in the tokenizer mode                           */
+static const unsigned char class_table[2][256] =
+{
+    {
+        1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 00-0F */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 10-1F */
+        0, 0, 0, 0, 0, 3, 0, 0, 4, 5, 3, 3, 0, 3, 0, 3,  /* 20-2F */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 30-3F */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 40-4F */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 3, 0,  /* 50-5F */
+        0, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,  /* 60-6F */
+        2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 0, 0, 0, 0, 0,  /* 70-7F */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 80-8F */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 90-9F */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* A0-AF */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* B0-BF */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* C0-CF */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* D0-DF */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* E0-EF */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0   /* F0-FF */
+    },
+    {
+        1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 00-0F */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 10-1F */
+        0, 0, 0, 0, 0, 3, 0, 0, 4, 5, 3, 3, 0, 3, 7, 3,  /* 20-2F */
+        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 0, 0, 0, 0, 0, 0,  /* 30-3F */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 40-4F */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 3, 2,  /* 50-5F */
+        0, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,  /* 60-6F */
+        2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 0, 0, 0, 0, 0,  /* 70-7F */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 80-8F */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 90-9F */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* A0-AF */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* B0-BF */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* C0-CF */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* D0-DF */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* E0-EF */
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0   /* F0-FF */
+    }
+};
+#endif
+
+/* iteration call table, see iterate_block() */
+static const ITERATE_ACTION iterate_call_table[] =
+{
+    iterate_nothing,
+    iterate_split,
+    iterate_once
+};
+
+/* continuation of the iteration, indexed by the done flag */
+static const ITERATE_ACTION iterate_next_table[] =
+{
+    iterate_blocks,
+    iterate_nothing
+};
+
+
+/* constants */
+/* following constants are indexes in global call table for corresponding functions */
+#define HANDLE_ERROR 0
+#define HANDLE_END 1
+#define HANDLE_SYMBOL 2
+#define HANDLE_OPERATOR 3
+#define HANDLE_OPEN_BRKT 4
+#define HANDLE_CLOSE_BRKT 5
+#define HANDLE_NUMBER 6
+
+/* a dot outside of a decimal literal is an error too, but the SIMD prepass */
+/* goes on past it, as the literals have dots, and leaves the input with  */
+/* dots to the conversion                                                  */
+#define HANDLE_DOT 7
+
+/* index in step call table for the steps after the end of conversion */
+#define STEP_FINISHED 8
+
+/* the unary minus in the stack and in the postfix form */
+#define UNARY_MINUS '~'
+
+/* binding that pops all the operations down to the delimiter of brackets */
+#define BINDING_ALL 1
+
+/* index in emitter call tables for the tree mode */
+#define EMIT_TREE 3
+
+/* the same for the packed mode */
+#define EMIT_PACKED 4
+
+/* nodes made by the simplification for every node of the tree at most, see simplify.c */
+#define SIMPLIFY_NODES 2
+
+/* operations of the packed mode, ordered as their opcodes from OPCODE_ADD on */
+#define RECORD_OPERATIONS "+-*/%^~"
+
+/* arity of the pending node printing ')' after the operands of an operation */
+#define TREE_CLOSE 3
+
+/* the pending close bracket of the tree printing */
+static const NODE tree_close = { .token = "", .arity = TREE_CLOSE };
+
+/* index in tree printing call table for a shared subtree printed before */
+#define WALK_REFERENCE 4
+
+/* stands for a vacant entry of the hash table, equal to no node */
+static const NODE vacant_node = { .token = "", .arity = -1 };
+
+/* the trampoline does steps by blocks of this size, see trampoline_steps() */
+#define TRAMPOLINE_UNROLL 8
+
+/* initial depth of the stack, it grows twice each time it is too small */
+#define MAX_STACK_DEPTH 64
+
+/* number of bytes classified at once by the prepass */
+#if defined(__AVX2__)
+#define PREPASS_BLOCK 32
+#else
+#define PREPASS_BLOCK 16
+#endif
+
+/* hooks of the counters, they are compiled out without -DACYCLOMATIC_STATS */
+#ifdef ACYCLOMATIC_STATS
+#define STATS_INIT(ctx) init_stats(&(ctx)->stats)
+#define STATS_HANDLER(ctx, call_index) (++(ctx)->stats.handlers[call_index])
+#define STATS_PRINT(ctx, popped) (++(ctx)->stats.prints[popped])
+#define STATS_STACK(ctx) stats_stack(ctx)
+#define STATS_START(ctx) ((ctx)->stats.start = stats_clock())
+#define STATS_END(ctx) stats_expression(&(ctx)->stats, stats_clock() - (ctx)->stats.start)
+#else
+#define STATS_INIT(ctx) ((void)0)
+#define STATS_HANDLER(ctx, call_index) ((void)0)
+#define STATS_PRINT(ctx, popped) ((void)0)
+#define STATS_STACK(ctx) ((void)0)
+#define STATS_START(ctx) ((void)0)
+#define STATS_END(ctx) ((void)0)
+#endif
+
+
+/********************************************
+* Initializes the conversion context
+********************************************/
+void init_context(CONTEXT* ctx)
+{
+    ctx->stack_size = MAX_STACK_DEPTH;
+    ctx->stack_bottom = malloc(ctx->stack_size);
+    allocation_check_table[ctx->stack_bottom == 0](ctx->stack_bottom);
+
+    ctx->stack_top = ctx->stack_bottom;
+    *ctx->stack_top = 0;
+
+    ctx->output = 0;
+    ctx->end = 0;
+    ctx->cursor = 0;
+    ctx->finished = 0;
+    ctx->status = STATUS_OK;
+    ctx->engine = ENGINE_RECURSIVE;
+    ctx->begin = 0;
+    ctx->step = step_classified;
+    ctx->classes = 0;
+    ctx->classes_size = 0;
+    ctx->symbols = 0;
+    ctx->symbols_from = 0;
+    ctx->error_offset = 0;
+    ctx->errors = 0;
+    ctx->depth = 0;
+    ctx->open_offset = 0;
+    ctx->imbalance = STATUS_OK;
+    ctx->tokens = 0;
+    ctx->operand = 0;
+    ctx->emitted = 0;
+    ctx->emit = 0;
+    ctx->checkpoint = 0;
+    ctx->emitter = emit_text;
+    ctx->char_emitter = emit_char_text;
+    ctx->tree = 0;
+    ctx->root = 0;
+    ctx->nodes = 0;
+    ctx->nodes_size = 0;
+    ctx->node_next = 0;
+    ctx->tree_top = 0;
+    ctx->pending = 0;
+    ctx->dag = 0;
+    ctx->shared = 0;
+    ctx->shared_mask = 0;
+    ctx->slots = 0;
+    ctx->labels = 0;
+    ctx->packed = 0;
+    ctx->packing = 0;
+    ctx->bits = 0;
+    ctx->bit_count = 0;
+    ctx->simplify = 0;
+    ctx->terms = 0;
+    ctx->split = 0;
+
+    STATS_INIT(ctx);
+}
+
+/********************************************
+* Deallocates the conversion context
+********************************************/
+void free_context(CONTEXT* ctx)
+{
+    free(ctx->stack_bottom);
+    free(ctx->classes);
+    free(ctx->nodes);
+    free(ctx->pending);
+    free(ctx->shared);
+    free(ctx->labels);
+    free(ctx->terms);
+
+    ctx->stack_bottom = 0;
+    ctx->stack_top = 0;
+    ctx->stack_size = 0;
+    ctx->classes = 0;
+    ctx->classes_size = 0;
+    ctx->symbols = 0;
+    ctx->nodes = 0;
+    ctx->nodes_size = 0;
+    ctx->pending = 0;
+    ctx->shared = 0;
+    ctx->labels = 0;
+    ctx->terms = 0;
+}
+
+/********************************************
+* Converts the expression, splitting a long
+* one between the threads of the context
+********************************************/
+int  convert(CONTEXT* ctx, const char* in, size_t len, OUTPUT* out)
+{
+    return convert_call_table[(ctx->split > 1) & (len >= SPLIT_MINIMUM)](ctx, in, len, out);
+}
+
+/********************************************
+* Converts the whole expression from its
+* beginning
+********************************************/
+static int  convert_whole(CONTEXT* ctx, const char* in, size_t len, OUTPUT* out)
+{
+    /* the state at the beginning of the expression */
+    CHECKPOINT start = { 0, 0, "", 0, 0, 0, 0, 0 };
+
+    return convert_resume(ctx, in, len, &start, out);
+}
+
+/********************************************
+* Converts the expression from the bracket
+* the checkpoint is taken at, the state is
+* restored from the checkpoint
+********************************************/
+int  convert_resume(CONTEXT* ctx, const char* in, size_t len, const CHECKPOINT* at, OUTPUT* out)
+{
+    int packing = ctx->packed & (ctx->tokens ^ 1) & (ctx->tree ^ 1);
+
+    /* the header of a record is filled in at the end, so the record must stay */
+    /* in the buffer; a buffer written to a file does not grow, the records that */
+    /* may be longer than it are made in memory and written out whole         */
+    int spilled = packing & (out->full != output_grow) & (out->size <= len * 2 + 1 + RECORD_HEADER);
+
+    return resume_call_table[spilled](ctx, in, len, at, out);
+}
+
+/********************************************
+* Converts the expression into a record too
+* long for the output buffer, the record is
+* made in memory and then written out
+********************************************/
+static int  resume_spilled(CONTEXT* ctx, const char* in, size_t len, const CHECKPOINT* at, OUTPUT* out)
+{
+    OUTPUT spill;
+    int status;
+
+    init_memory_output(&spill, len * 2 + 2 + RECORD_HEADER);
+    status = resume_buffered(ctx, in, len, at, &spill);
+
+    output_string(out, spill.buffer, spill.length);
+    ctx->output = out;
+
+    free_memory_output(&spill);
+
+    return status;
+}
+
+/********************************************
+* Converts the expression with its output
+* made in the output buffer
+********************************************/
+static int  resume_buffered(CONTEXT* ctx, const char* in, size_t len, const CHECKPOINT* at, OUTPUT* out)
+{
+    int emitter;
+    char header[RECORD_HEADER] = { 0 };
+
+    /* every node of the tree consumes a character of the expression, so the  */
+    /* arena holds len + 1 nodes with the empty one and needs no checks; the  */
+    /* simplification makes 2 nodes at most for every one of them            */
+    size_t nodes = (len + 1) * (1 + SIMPLIFY_NODES * ctx->simplify);
+
+    ctx->output = out;
+    ctx->begin = in;
+    ctx->end = in + len;
+    ctx->step = step_classified;
+    ctx->finished = 0;
+    ctx->status = STATUS_OK;
+    ctx->error_offset = 0;
+    ctx->depth = at->depth;
+    ctx->open_offset = at->open_offset;
+    ctx->imbalance = STATUS_OK;
+    ctx->operand = at->operand;
+    ctx->emitted = at->emitted;
+    emitter = ctx->tokens + (ctx->emit != 0) * (2 - ctx->tokens);
+    emitter += (EMIT_TREE - emitter) * ctx->tree;
+    ctx->packing = ctx->packed & (ctx->tokens ^ 1) & (ctx->tree ^ 1);
+    emitter += (EMIT_PACKED - emitter) * ctx->packing;
+    ctx->emitter = emit_call_table[emitter];
+    ctx->char_emitter = emit_char_call_table[emitter];
+
+    /* reuse the stack left by the previous expression, with the operations */
+    /* of the checkpoint, the bottom stays 0                                 */
+    reset_stack(ctx, len);
+    memcpy(ctx->stack_bottom + 1, at->stack, at->stack_length);
+    ctx->stack_top += at->stack_length;
+
+    nodes_call_table[(nodes > ctx->nodes_size) & ctx->tree](ctx, nodes);
+    ctx->root = 0;
+    ctx->tree_top = 0;
+    ctx->slots = 0;
+    shared_call_table[(ctx->dag | ctx->simplify) & ctx->tree](ctx, nodes);
+    tree_start_table[ctx->tree](ctx);
+
+    /* the output of the expression is at most len + 1 bytes, or len * 2 + 1  */
+    /* with the spaces of the tokenizer mode or the codes of the packed mode */
+    /* and the header, make room for it in advance, so it stays in the buffer */
+    /* and can be discarded on error                                          */
+    flush_call_table[out->size - out->length <=
+                     len * (1 + ctx->tokens + ctx->packing) + 1 + RECORD_HEADER * ctx->packing](out);
+
+    /* the header of the record is before the output discarded on error */
+    output_string(out, header, RECORD_HEADER * ctx->packing);
+    out->mark = out->length - at->output_length;
+    ctx->bits = 0;
+    ctx->bit_count = 0;
+
+    STATS_START(ctx);
+    engine_table[ctx->engine](ctx, in + at->offset);
+    record_call_table[ctx->packing](ctx);
+    STATS_END(ctx);
+
+    return ctx->status;
+}
+
+/********************************************
+* Recursive conversion routine
+********************************************/
+static void convert_recursive(CONTEXT* ctx, const char* str)
+{
+    int call_index = balance(ctx, classify(ctx, str));
+
+    STATS_HANDLER(ctx, call_index);
+    call_table[call_index](ctx, str);
+}
+
+/********************************************
+* Trampoline conversion routine
+* Handlers return the next position instead
+* of calling convert_recursive(), steps are
+* done in blocks of TRAMPOLINE_UNROLL, 2 * ...,
+* 4 * ... steps, so the depth of recursion is
+* logarithmic in the length of the expression
+********************************************/
+static void convert_trampoline(CONTEXT* ctx, const char* str)
+{
+    ctx->cursor = str;
+
+    trampoline(ctx, 0);
+}
+
+/********************************************
+* Conversion routine with a vectorized
+* prepass that classifies the whole input
+* by blocks before the handlers are called
+* The prepass counts the brackets too and
+* stops at the end or at the first error,
+* the input with an error is rejected before
+* anything is output; the rest is converted
+* with no checks, a run of symbols and the
+* token after it in a step
+********************************************/
+static void convert_simd(CONTEXT* ctx, const char* str)
+{
+    PREPASS prepass;
+    int rejected;
+
+    /* the whole input, the conversion may resume after its beginning */
+    size_t length = ctx->end - ctx->begin;
+
+    /* one more class for the end of the input */
+    classes_call_table[length >= ctx->classes_size](ctx, length + 1);
+
+    /* the brackets are counted from where the conversion resumes */
+    prepass.ctx = ctx;
+    prepass.position = str - ctx->begin;
+    prepass.length = length;
+    prepass.stop = 0;
+    prepass.done = 0;
+    prepass.depth = ctx->depth;
+    prepass.open_offset = ctx->open_offset;
+    prepass.imbalance = STATUS_OK;
+    prepass.dots = 0;
+    prepass.base = prepass.position;
+    ctx->symbols_from = str;
+
+    iterate(prepass_step, &prepass);
+
+    /* the end with a bracket open is an error at the bracket */
+    prepass.imbalance += STATUS_UNCLOSED_OPEN * (ctx->classes[prepass.stop] == HANDLE_END) * (prepass.depth != 0);
+
+    /* a dot may be an error before the stop, the conversion finds it */
+    rejected = ((prepass.imbalance != STATUS_OK) | (ctx->classes[prepass.stop] == HANDLE_ERROR)) &
+               (prepass.dots ^ 1);
+
+    ctx->imbalance += (prepass.imbalance - ctx->imbalance) * rejected;
+    ctx->open_offset += (prepass.open_offset - ctx->open_offset) * rejected;
+    ctx->cursor = ctx->begin + prepass.stop;
+
+    prepared_call_table[rejected | (prepass.dots << 1)](ctx, str);
+}
+
+/********************************************
+* Converts the classified input, the brackets
+* are checked as by the trampoline
+********************************************/
+static void convert_prepared(CONTEXT* ctx, const char* str)
+{
+    ctx->step = step_prepared;
+
+    convert_trampoline(ctx, str);
+}
+
+/********************************************
+* Converts the classified input with no error
+* in it, the brackets are not checked again
+* and the runs of symbols are found in the
+* masks of the prepass
+********************************************/
+static void convert_validated(CONTEXT* ctx, const char* str)
+{
+    ctx->step = step_validated;
+
+    convert_trampoline(ctx, str);
+}
+
+/********************************************
+* Rejects the input with the error found by
+* the prepass at the cursor
+********************************************/
+static void convert_rejected(CONTEXT* ctx, const char* str)
+{
+    STATS_HANDLER(ctx, HANDLE_ERROR);
+    step_error(ctx, ctx->cursor);
+}
+
+/********************************************
+* Classifies the next block of the input
+* Returns 1 when an end or an error is found
+********************************************/
+static int  prepass_step(void* arg)
+{
+    PREPASS* prepass = arg;
+
+    prepass_call_table[prepass->length - prepass->position >= PREPASS_BLOCK](prepass);
+
+    return prepass->done;
+}
+
+/********************************************
+* Classifies a whole block of the input
+********************************************/
+static void prepass_block(PREPASS* prepass)
+{
+    CONTEXT* ctx = prepass->ctx;
+    MASKS masks;
+
+    classify_block(ctx->begin + prepass->position, ctx->classes + prepass->position, ctx->tokens, &masks);
+    prepass_masks(prepass, &masks);
+
+    prepass->position += PREPASS_BLOCK;
+}
+
+/********************************************
+* Classifies the rest of the input that is
+* shorter than a block
+* The rest is padded with zeros, so the end
+* of the input is always found here
+********************************************/
+static void prepass_tail(PREPASS* prepass)
+{
+    CONTEXT* ctx = prepass->ctx;
+    size_t rest = prepass->length - prepass->position;
+    char bytes[PREPASS_BLOCK] = { 0 };
+    unsigned char classes[PREPASS_BLOCK];
+    MASKS masks;
+
+    memcpy(bytes, ctx->begin + prepass->position, rest);
+    classify_block(bytes, classes, ctx->tokens, &masks);
+    memcpy(ctx->classes + prepass->position, classes, rest + 1);
+
+    prepass_masks(prepass, &masks);
+}
+
+/********************************************
+* Finds the stop in the masks of the block
+* at the position and counts the brackets
+* before it
+********************************************/
+static void prepass_masks(PREPASS* prepass, const MASKS* masks)
+{
+    /* the bit after the block keeps the count of trailing zeros defined */
+    int stop = __builtin_ctzll(masks->stops | ((uint64_t)1 << PREPASS_BLOCK));
+    uint64_t before = ((uint64_t)1 << stop) - 1;
+    uint64_t closes = masks->closes & before;
+    uint64_t* words = prepass->ctx->symbols;
+    size_t index = prepass->position - prepass->base;
+
+    /* the depth cannot reach 0 in the block if it is above the number of ')' */
+    int reaching = (closes != 0) & ((size_t)__builtin_popcountll(closes) >= prepass->depth);
+
+    prepass->stop = prepass->position + stop;
+    prepass->done = (masks->stops != 0);
+    prepass->dots |= ((masks->dots & before) != 0);
+    prepass->opens = masks->opens & before;
+    prepass->closes = closes;
+
+    /* the blocks are aligned to the words from the base on, the first block */
+    /* of a word clears it                                                    */
+    words[index >> 6] = (words[index >> 6] & (((uint64_t)1 << (index & 63)) - 1)) | (masks->symbols << (index & 63));
+
+    brackets_call_table[reaching](prepass);
+}
+
+/********************************************
+* Counts the brackets of the block at once,
+* the depth stays above 0 after the first '('
+********************************************/
+static void brackets_counted(PREPASS* prepass)
+{
+    int outermost = (prepass->depth == 0) & (prepass->opens != 0);
+
+    /* the extra bit keeps the count defined */
+    prepass->open_offset += (prepass->position + __builtin_ctzll(prepass->opens | ((uint64_t)1 << 63)) -
+                             prepass->open_offset) * outermost;
+    prepass->depth += __builtin_popcountll(prepass->opens);
+    prepass->depth -= __builtin_popcountll(prepass->closes);
+}
+
+/********************************************
+* Goes over the brackets of the block one by
+* one, as the depth may reach 0 in it
+********************************************/
+static void brackets_walked(PREPASS* prepass)
+{
+    iterate(bracket_step, prepass);
+}
+
+/********************************************
+* Counts the first bracket left in the block,
+* a ')' at the depth 0 is the first error
+* and the stop
+* Returns 1 when no bracket is left or at
+* the error
+********************************************/
+static int  bracket_step(void* arg)
+{
+    PREPASS* prepass = arg;
+    uint64_t bit = (prepass->opens | prepass->closes) & -(prepass->opens | prepass->closes);
+    int open = ((prepass->opens & bit) != 0);
+    int unmatched = (open ^ 1) & (prepass->depth == 0);
+    size_t offset = prepass->position + __builtin_ctzll(bit | ((uint64_t)1 << 63));
+
+    prepass->open_offset += (offset - prepass->open_offset) * (open & (prepass->depth == 0));
+    prepass->depth += (size_t)open - (size_t)((open | unmatched) ^ 1);
+    prepass->opens &= ~bit;
+    prepass->closes &= ~bit;
+
+    prepass->stop += (offset - prepass->stop) * unmatched;
+    prepass->imbalance += STATUS_UNMATCHED_CLOSE * unmatched;
+    prepass->done |= unmatched;
+
+    return unmatched | ((prepass->opens | prepass->closes) == 0);
+}
+
+#if defined(__AVX2__)
+/********************************************
+* Classifies PREPASS_BLOCK bytes with AVX2
+* and makes the masks of the block
+********************************************/
+static void classify_block(const char* bytes, unsigned char* classes, int tokens, MASKS* masks)
+{
+    __m256i v = _mm256_loadu_si256((const __m256i*)bytes);
+    __m256i letter = _mm256_sub_epi8(v, _mm256_set1_epi8('a'));
+    __m256i digit = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+    __m256i end = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());
+    __m256i mode = _mm256_set1_epi8(-tokens);
+    __m256i operator;
+    __m256i c;
+
+    /* v - 'a' is at most 'z' - 'a' as an unsigned byte for a-z only */
+    letter = _mm256_cmpeq_epi8(_mm256_min_epu8(letter, _mm256_set1_epi8('z' - 'a')), letter);
+    digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+
+    /* all the operations have the same class, the precedence table tells them apart */
+    operator = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('+')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('-')));
+    operator = _mm256_or_si256(operator, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('*')));
+    operator = _mm256_or_si256(operator, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/')));
+    operator = _mm256_or_si256(operator, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('%')));
+    operator = _mm256_or_si256(operator, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('^')));
+
+    /* the checks are mutually exclusive, so the classes can be mixed with | */
+    c = _mm256_and_si256(end, _mm256_set1_epi8(HANDLE_END));
+    c = _mm256_or_si256(c, _mm256_and_si256(letter, _mm256_set1_epi8(HANDLE_SYMBOL)));
+    c = _mm256_or_si256(c, _mm256_and_si256(operator, _mm256_set1_epi8(HANDLE_OPERATOR)));
+    c = _mm256_or_si256(c, _mm256_and_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('(')),
+                                            _mm256_set1_epi8(HANDLE_OPEN_BRKT)));
+    c = _mm256_or_si256(c, _mm256_and_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(')')),
+                                            _mm256_set1_epi8(HANDLE_CLOSE_BRKT)));
+
+    /* digits, '_' and '.' are valid in the tokenizer mode only */
+    c = _mm256_or_si256(c, _mm256_and_si256(_mm256_and_si256(digit, mode), _mm256_set1_epi8(HANDLE_NUMBER)));
+    c = _mm256_or_si256(c, _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')), mode),
+                                            _mm256_set1_epi8(HANDLE_SYMBOL)));
+    c = _mm256_or_si256(c, _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('.')), mode),
+                                            _mm256_set1_epi8(HANDLE_DOT)));
+
+    _mm256_storeu_si256((__m256i*)classes, c);
+
+    /* errors have class 0 */
+    masks->stops = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(end, _mm256_cmpeq_epi8(c, _mm256_setzero_si256())));
+    masks->opens = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('(')));
+    masks->closes = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(')')));
+    masks->dots = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(HANDLE_DOT)));
+    masks->symbols = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(letter, _mm256_and_si256(mode,
+                                    _mm256_or_si256(digit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'))))));
+}
+#elif defined(__SSE2__)
+/********************************************
+* Classifies PREPASS_BLOCK bytes with SSE2
+* and makes the masks of the block
+********************************************/
+static void classify_block(const char* bytes, unsigned char* classes, int tokens, MASKS* masks)
+{
+    __m128i v = _mm_loadu_si128((const __m128i*)bytes);
+    __m128i letter = _mm_sub_epi8(v, _mm_set1_epi8('a'));
+    __m128i digit = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i end = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+    __m128i mode = _mm_set1_epi8(-tokens);
+    __m128i operator;
+    __m128i c;
+
+    /* v - 'a' is at most 'z' - 'a' as an unsigned byte for a-z only */
+    letter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8('z' - 'a')), letter);
+    digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+
+    /* all the operations have the same class, the precedence table tells them apart */
+    operator = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('+')), _mm_cmpeq_epi8(v, _mm_set1_epi8('-')));
+    operator = _mm_or_si128(operator, _mm_cmpeq_epi8(v, _mm_set1_epi8('*')));
+    operator = _mm_or_si128(operator, _mm_cmpeq_epi8(v, _mm_set1_epi8('/')));
+    operator = _mm_or_si128(operator, _mm_cmpeq_epi8(v, _mm_set1_epi8('%')));
+    operator = _mm_or_si128(operator, _mm_cmpeq_epi8(v, _mm_set1_epi8('^')));
+
+    /* the checks are mutually exclusive, so the classes can be mixed with | */
+    c = _mm_and_si128(end, _mm_set1_epi8(HANDLE_END));
+    c = _mm_or_si128(c, _mm_and_si128(letter, _mm_set1_epi8(HANDLE_SYMBOL)));
+    c = _mm_or_si128(c, _mm_and_si128(operator, _mm_set1_epi8(HANDLE_OPERATOR)));
+    c = _mm_or_si128(c, _mm_and_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('(')),
+                                      _mm_set1_epi8(HANDLE_OPEN_BRKT)));
+    c = _mm_or_si128(c, _mm_and_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(')')),
+                                      _mm_set1_epi8(HANDLE_CLOSE_BRKT)));
+
+    /* digits, '_' and '.' are valid in the tokenizer mode only */
+    c = _mm_or_si128(c, _mm_and_si128(_mm_and_si128(digit, mode), _mm_set1_epi8(HANDLE_NUMBER)));
+    c = _mm_or_si128(c, _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('_')), mode),
+                                      _mm_set1_epi8(HANDLE_SYMBOL)));
+    c = _mm_or_si128(c, _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('.')), mode),
+                                      _mm_set1_epi8(HANDLE_DOT)));
+
+    _mm_storeu_si128((__m128i*)classes, c);
+
+    /* errors have class 0 */
+    masks->stops = (uint32_t)_mm_movemask_epi8(_mm_or_si128(end, _mm_cmpeq_epi8(c, _mm_setzero_si128())));
+    masks->opens = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('(')));
+    masks->closes = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(')')));
+    masks->dots = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(HANDLE_DOT)));
+    masks->symbols = (uint32_t)_mm_movemask_epi8(_mm_or_si128(letter, _mm_and_si128(mode,
+                                    _mm_or_si128(digit, _mm_cmpeq_epi8(v, _mm_set1_epi8('_'))))));
+}
+#elif defined(__ARM_NEON)
+/********************************************
+* Classifies PREPASS_BLOCK bytes with NEON
+* and makes the masks of the block
+********************************************/
+static void classify_block(const char* bytes, unsigned char* classes, int tokens, MASKS* masks)
+{
+    uint8x16_t v = vld1q_u8((const uint8_t*)bytes);
+    uint8x16_t end = vceqq_u8(v, vdupq_n_u8(0));
+    uint8x16_t letter = vcleq_u8(vsubq_u8(v, vdupq_n_u8('a')), vdupq_n_u8('z' - 'a'));
+    uint8x16_t digit = vcleq_u8(vsubq_u8(v, vdupq_n_u8('0')), vdupq_n_u8(9));
+    uint8x16_t mode = vdupq_n_u8(-tokens);
+    uint8x16_t operator;
+    uint8x16_t c;
+
+    /* all the operations have the same class, the precedence table tells them apart */
+    operator = vorrq_u8(vceqq_u8(v, vdupq_n_u8('+')), vceqq_u8(v, vdupq_n_u8('-')));
+    operator = vorrq_u8(operator, vceqq_u8(v, vdupq_n_u8('*')));
+    operator = vorrq_u8(operator, vceqq_u8(v, vdupq_n_u8('/')));
+    operator = vorrq_u8(operator, vceqq_u8(v, vdupq_n_u8('%')));
+    operator = vorrq_u8(operator, vceqq_u8(v, vdupq_n_u8('^')));
+
+    /* the checks are mutually exclusive, so the classes can be mixed with | */
+    c = vandq_u8(end, vdupq_n_u8(HANDLE_END));
+    c = vorrq_u8(c, vandq_u8(letter, vdupq_n_u8(HANDLE_SYMBOL)));
+    c = vorrq_u8(c, vandq_u8(operator, vdupq_n_u8(HANDLE_OPERATOR)));
+    c = vorrq_u8(c, vandq_u8(vceqq_u8(v, vdupq_n_u8('(')), vdupq_n_u8(HANDLE_OPEN_BRKT)));
+    c = vorrq_u8(c, vandq_u8(vceqq_u8(v, vdupq_n_u8(')')), vdupq_n_u8(HANDLE_CLOSE_BRKT)));
+
+    /* digits, '_' and '.' are valid in the tokenizer mode only */
+    c = vorrq_u8(c, vandq_u8(vandq_u8(digit, mode), vdupq_n_u8(HANDLE_NUMBER)));
+    c = vorrq_u8(c, vandq_u8(vandq_u8(vceqq_u8(v, vdupq_n_u8('_')), mode), vdupq_n_u8(HANDLE_SYMBOL)));
+    c = vorrq_u8(c, vandq_u8(vandq_u8(vceqq_u8(v, vdupq_n_u8('.')), mode), vdupq_n_u8(HANDLE_DOT)));
+
+    vst1q_u8(classes, c);
+
+    /* errors have class 0 */
+    masks->stops = neon_mask(vorrq_u8(end, vceqq_u8(c, vdupq_n_u8(0))));
+    masks->opens = neon_mask(vceqq_u8(v, vdupq_n_u8('(')));
+    masks->closes = neon_mask(vceqq_u8(v, vdupq_n_u8(')')));
+    masks->dots = neon_mask(vceqq_u8(c, vdupq_n_u8(HANDLE_DOT)));
+    masks->symbols = neon_mask(vorrq_u8(letter, vandq_u8(mode, vorrq_u8(digit, vceqq_u8(v, vdupq_n_u8('_'))))));
+}
+
+/********************************************
+* Returns the mask of the bytes that are all
+* ones, bit N for byte N
+********************************************/
+static uint64_t neon_mask(uint8x16_t bytes)
+{
+    static const uint8_t weights[8] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x8_t w = vld1_u8(weights);
+
+    /* weigh every byte of the mask by its bit and add them up */
+    return vaddv_u8(vand_u8(vget_low_u8(bytes), w)) |
+           ((uint64_t)vaddv_u8(vand_u8(vget_high_u8(bytes), w)) << 8);
+}
+#else
+/********************************************
+* Classifies PREPASS_BLOCK bytes one by one
+* and makes the masks of the block
+********************************************/
+static void classify_block(const char* bytes, unsigned char* classes, int tokens, MASKS* masks)
+{
+    memset(masks, 0, sizeof(MASKS));
+
+    classify_bytes(bytes, classes, PREPASS_BLOCK, tokens, masks);
+}
+
+/********************************************
+* Classifies count bytes
+********************************************/
+static void classify_bytes(const char* bytes, unsigned char* classes, int count, int tokens, MASKS* masks)
+{
+    bytes_call_table[count == 0](bytes, classes, count, tokens, masks);
+}
+
+/********************************************
+* Classifies the last of count bytes and the
+* bytes before it
+********************************************/
+static void classify_bytes_rest(const char* bytes, unsigned char* classes, int count, int tokens, MASKS* masks)
+{
+    int index = count - 1;
+    int class = classify_char(bytes[index], tokens);
+
+    classes[index] = class;
+    masks->stops |= (uint64_t)(class <= HANDLE_END) << index;
+    masks->opens |= (uint64_t)(class == HANDLE_OPEN_BRKT) << index;
+    masks->closes |= (uint64_t)(class == HANDLE_CLOSE_BRKT) << index;
+    masks->dots |= (uint64_t)(class == HANDLE_DOT) << index;
+    masks->symbols |= (uint64_t)((class == HANDLE_SYMBOL) | (class == HANDLE_NUMBER)) << index;
+
+    classify_bytes(bytes, classes, index, tokens, masks);
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+static void classify_bytes_nothing(const char* bytes, unsigned char* classes, int count, int tokens, MASKS* masks)
+{
+}
+#endif
+
+/********************************************
+* Classifies the character at the position
+* and returns an index in global call table
+* The end of the input is classified as the
+* end of string without reading it
+********************************************/
+static int  classify(CONTEXT* ctx, const char* str)
+{
+    int at_end = (str == ctx->end);
+    const char* chars[2] = { str, "" };
+
+    return classify_char(*chars[at_end], ctx->tokens);
+}
+
+#ifdef TABLE_CLASSIFIER
+/********************************************
+* Classifies the character and returns an
+* index in global call table
+* This is a single load from the table of
+* the mode
+********************************************/
+static int  classify_char(char c, int tokens)
+{
+    return class_table[tokens][(unsigned char)c];
+}
+#else
+/********************************************
+* Classifies the character and returns an
+* index in global call table
+********************************************/
+static int  classify_char(char c, int tokens)
+{
+    int call_index;
+
+    /* all the checks below are mutually exclusive */
+
+    /* check for end of string */
+    call_index = check_interval(c, '\0', '\0') * HANDLE_END;
+
+    /* check for symbol a-z */
+    call_index += check_interval(c, 'a', 'z') * HANDLE_SYMBOL;
+
+    /* check for arithmetical operations */
+    call_index += check_interval(c, '+', '+') * HANDLE_OPERATOR;
+    call_index += check_interval(c, '-', '-') * HANDLE_OPERATOR;
+    call_index += check_interval(c, '*', '*') * HANDLE_OPERATOR;
+    call_index += check_interval(c, '/', '/') * HANDLE_OPERATOR;
+    call_index += check_interval(c, '%', '%') * HANDLE_OPERATOR;
+    call_index += check_interval(c, '^', '^') * HANDLE_OPERATOR;
+
+    /* check for brackets */
+    call_index += check_interval(c, '(', '(') * HANDLE_OPEN_BRKT;
+    call_index += check_interval(c, ')', ')') * HANDLE_CLOSE_BRKT;
+
+    /* check for digits, '_' and '.', valid in the tokenizer mode only */
+    call_index += check_interval(c, '0', '9') * HANDLE_NUMBER * tokens;
+    call_index += check_interval(c, '_', '_') * HANDLE_SYMBOL * tokens;
+    call_index += check_interval(c, '.', '.') * HANDLE_DOT * tokens;
+
+    return call_index;
+}
+#endif
+
+/********************************************
+* Checks the brackets at the position of the
+* character of the class given by call_index
+* Returns HANDLE_ERROR for ')' at the depth 0
+* and for the end at a depth above 0, call
+* index as is otherwise
+********************************************/
+static int  balance(CONTEXT* ctx, int call_index)
+{
+    int unmatched = (call_index == HANDLE_CLOSE_BRKT) & (ctx->depth == 0);
+    int unclosed = (call_index == HANDLE_END) & (ctx->depth != 0);
+
+    /* the checks are mutually exclusive */
+    ctx->imbalance = unmatched * STATUS_UNMATCHED_CLOSE + unclosed * STATUS_UNCLOSED_OPEN;
+
+    return call_index * ((unmatched | unclosed) ^ 1);
+}
+
+/********************************************
+* This function returns 1 if:
+*  low <= value <= high
+* Otherwise it returns 0
+********************************************/
+int  check_interval(int value, int low, int high)
+{
+    /* if value lies between low and high then                          */
+    /* both high - value and value - low are greater than or equal to 0 */
+    /* use | to mix them together                                       */
+    /* then take inverted sign bit as result                            */
+    return ~(((high - value) | (value - low)) >> (sizeof(int) * 8 - 1)) & 1;
+}
+
+/********************************************
+* This function indicates errors in the
+* input expression
+********************************************/
+static void handle_error(CONTEXT* ctx, const char* str)
+{
+    step_error(ctx, str);
+}
+
+/********************************************
+* This function handles the end of
+* input expression
+********************************************/
+static void handle_end(CONTEXT* ctx, const char* str)
+{
+    step_end(ctx, str);
+}
+
+/********************************************
+* This function handles a symbol a-z from
+* input expression
+********************************************/
+static void handle_symbol(CONTEXT* ctx, const char* str)
+{
+    convert_recursive(ctx, step_symbol(ctx, str));
+}
+
+/********************************************
+* This function handles an operation from
+* input expression
+********************************************/
+static void handle_operator(CONTEXT* ctx, const char* str)
+{
+    convert_recursive(ctx, step_operator(ctx, str));
+}
+
+/********************************************
+* This function handles open brackets from
+* input expression
+********************************************/
+static void handle_open_bracket(CONTEXT* ctx, const char* str)
+{
+    /* convert the bracketed expression separately */
+    convert_recursive(ctx, step_open_bracket(ctx, str));
+}
+
+/********************************************
+* This function handles close brackets from
+* input expression
+********************************************/
+static void handle_close_bracket(CONTEXT* ctx, const char* str)
+{
+    /* continue convertion */
+    convert_recursive(ctx, step_close_bracket(ctx, str));
+}
+
+/********************************************
+* This function handles a decimal literal,
+* only in the tokenizer mode
+********************************************/
+static void handle_number(CONTEXT* ctx, const char* str)
+{
+    convert_recursive(ctx, step_number(ctx, str));
+}
+
+/********************************************
+* Indicates errors in the input expression,
+* discards the output of the expression and
+* finishes the conversion
+********************************************/
+static const char* step_error(CONTEXT* ctx, const char* str)
+{
+    char message[96];
+    int length;
+    int unclosed = (ctx->imbalance == STATUS_UNCLOSED_OPEN);
+
+    /* an unclosed bracket is reported where it is open, not at the end */
+    size_t offsets[2] = { str - ctx->begin, ctx->open_offset };
+
+    /* a bracket error or an invalid character */
+    ctx->status = ctx->imbalance + STATUS_ERROR * (ctx->imbalance == STATUS_OK);
+    ctx->error_offset = offsets[unclosed];
+    ++ctx->errors;
+    ctx->finished = 1;
+
+    /* the output of the expression is still in the buffer unless it was too big */
+    ctx->output->length = ctx->output->mark;
+
+    length = snprintf(message, sizeof(message), "Error in the expression at offset %zu: %s\n",
+                      ctx->error_offset, error_reasons[ctx->status]);
+    output_string(ctx->output, message, length);
+
+    return str;
+}
+
+/********************************************
+* Handles the end of input expression
+* and finishes the conversion
+********************************************/
+static const char* step_end(CONTEXT* ctx, const char* str)
+{
+    /* extract and print all the operations left in the stack */
+    pop_operators(ctx, BINDING_ALL);
+
+    tree_end_table[ctx->tree](ctx);
+
+    /* a record has no line terminator */
+    output_string(ctx->output, "\n", ctx->packing ^ 1);
+
+    ctx->finished = 1;
+
+    return str;
+}
+
+/********************************************
+* Handles a symbol a-z
+* Returns the next position
+********************************************/
+static const char* step_symbol(CONTEXT* ctx, const char* str)
+{
+    /* look at the next character without reading past the end */
+    const char* next = str + 1;
+    int at_end = (next == ctx->end);
+    const char* chars[2] = { next, "" };
+
+    /* 0 - a single symbol, 1 - a run of symbols, 2 - an identifier */
+    int call_index = check_interval(*chars[at_end], 'a', 'z') * (ctx->tokens ^ 1) + ctx->tokens * 2;
+
+    /* a '-' after the operand is binary */
+    ctx->operand = 1;
+
+    return symbol_call_table[call_index](ctx, str);
+}
+
+/********************************************
+* Handles a single symbol a-z
+* Returns the next position
+********************************************/
+static const char* symbol_single(CONTEXT* ctx, const char* str)
+{
+    /* display the symbol */
+    ctx->char_emitter(ctx, str);
+
+    return ++str;
+}
+
+/********************************************
+* Handles a run of symbols a-z, the whole run
+* is copied to the output at once
+* Returns the position after the run
+********************************************/
+static const char* symbol_run(CONTEXT* ctx, const char* str)
+{
+    RUN run;
+
+    /* the first two symbols are known already */
+    run.position = str + 2;
+    run.end = ctx->end;
+    run.done = 0;
+
+    iterate(run_step, &run);
+
+    /* display the symbols */
+    ctx->emitter(ctx, str, run.position - str);
+
+    return run.position;
+}
+
+/********************************************
+* Handles an identifier [a-z_][a-z0-9_]* in
+* the tokenizer mode
+* Returns the position after the identifier
+********************************************/
+static const char* symbol_identifier(CONTEXT* ctx, const char* str)
+{
+    const char* end = span(ctx, str + 1, identifier_char);
+
+    ctx->emitter(ctx, str, end - str);
+
+    return end;
+}
+
+/********************************************
+* Handles a decimal literal [0-9]+(.[0-9]*)?
+* in the tokenizer mode
+* Returns the position after the literal
+********************************************/
+static const char* step_number(CONTEXT* ctx, const char* str)
+{
+    const char* integer = span(ctx, str + 1, digit_char);
+
+    /* the fraction starts with a dot, without it the second span is empty */
+    int at_end = (integer == ctx->end);
+    const char* chars[2] = { integer, "" };
+    int dot = check_interval(*chars[at_end], '.', '.');
+    const char* end = span(ctx, integer + dot, digit_char);
+
+    ctx->emitter(ctx, str, end - str);
+    ctx->operand = 1;
+
+    return end;
+}
+
+/********************************************
+* Returns the position after the characters
+* the member function accepts
+********************************************/
+static const char* span(CONTEXT* ctx, const char* str, int (*member)(int c))
+{
+    RUN run;
+
+    run.position = str;
+    run.end = ctx->end;
+    run.done = 0;
+    run.member = member;
+
+    iterate(span_step, &run);
+
+    return run.position;
+}
+
+/********************************************
+* Scans one more character of the span
+* Returns 1 at the end of the span
+********************************************/
+static int  span_step(void* arg)
+{
+    RUN* run = arg;
+    int at_end = (run->position == run->end);
+    const char* chars[2] = { run->position, "" };
+    int member = run->member(*chars[at_end]);
+
+    run->position += member;
+
+    return member ^ 1;
+}
+
+/********************************************
+* Returns 1 for a-z, 0-9 and '_'
+********************************************/
+static int  identifier_char(int c)
+{
+    return check_interval(c, 'a', 'z') | check_interval(c, '0', '9') | check_interval(c, '_', '_');
+}
+
+/********************************************
+* Returns 1 for 0-9
+********************************************/
+static int  digit_char(int c)
+{
+    return check_interval(c, '0', '9');
+}
+
+/********************************************
+* Scans the next part of the run
+* Returns 1 when the end of the run is found
+********************************************/
+static int  run_step(void* arg)
+{
+    RUN* run = arg;
+
+    run_call_table[run->end - run->position >= (ptrdiff_t)sizeof(uint64_t)](run);
+
+    return run->done;
+}
+
+/********************************************
+* Scans 8 bytes at once
+********************************************/
+static void run_word(RUN* run)
+{
+    const uint64_t ones = 0x0101010101010101ull;
+    const uint64_t highs = 0x8080808080808080ull;
+    uint64_t word;
+    uint64_t low;
+    uint64_t symbols;
+    uint64_t others;
+
+    memcpy(&word, run->position, sizeof(word));
+
+    /* with the high bits cleared every byte can be checked in place:     */
+    /* low + 0x80 - 'a' has the high bit set when the byte is at least 'a' */
+    /* 0x80 + 'z' - low has the high bit set when the byte is at most 'z'  */
+    low = word & ~highs;
+    symbols = (low + ones * (0x80 - 'a')) & (ones * (0x80 + 'z') - low) & ~word & highs;
+    others = ~symbols & highs;
+
+    /* the first byte of the word that is not a symbol ends the run, */
+    /* the extra bit keeps the count defined for a word of symbols    */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    run->position += (__builtin_clzll(others | 1) >> 3) + (others == 0);
+#else
+    run->position += (__builtin_ctzll(others | (1ull << 63)) >> 3) + (others == 0);
+#endif
+    run->done = (others != 0);
+}
+
+/********************************************
+* Scans the bytes shorter than a word one
+* by one
+********************************************/
+static void run_bytes(RUN* run)
+{
+    run_byte(run);
+    run_byte(run);
+    run_byte(run);
+    run_byte(run);
+    run_byte(run);
+    run_byte(run);
+    run_byte(run);
+
+    /* at most 7 bytes are left, so the run ends here */
+    run->done = 1;
+}
+
+/********************************************
+* Scans one byte, stops at the end of the
+* run or at the end of the input
+********************************************/
+static void run_byte(RUN* run)
+{
+    int at_end = (run->position == run->end);
+    const char* chars[2] = { run->position, "" };
+
+    /* once the run ends the position stays where it is */
+    run->position += check_interval(*chars[at_end], 'a', 'z') & (run->done ^ 1);
+    run->done |= check_interval(*chars[at_end], 'a', 'z') ^ 1;
+}
+
+/********************************************
+* Handles an operation
+* Returns the next position
+********************************************/
+static const char* step_operator(CONTEXT* ctx, const char* str)
+{
+    /* '-' is the unary minus unless it follows an operand or ')' */
+    int unary = check_interval(*str, '-', '-') & (ctx->operand ^ 1);
+    char c = *str ^ (('-' ^ UNARY_MINUS) * unary);
+
+    /* extract and print the operations that bind at least as tightly */
+    pop_operators(ctx, binding_table[(unsigned char)c]);
+
+    /* then we have to push current operation */
+    push(c, &ctx->stack_top);
+    STATS_STACK(ctx);
+    ctx->operand = 0;
+
+    return ++str;
+}
+
+/********************************************
+* Handles open brackets
+* Returns the next position
+********************************************/
+static const char* step_open_bracket(CONTEXT* ctx, const char* str)
+{
+    checkpoint_call_table[ctx->checkpoint != 0](ctx, str);
+
+    /* place delimiter 0 in the stack to separate the bracketed expression */
+    push(0, &ctx->stack_top);
+    STATS_STACK(ctx);
+
+    /* remember where the outermost bracket opens */
+    ctx->open_offset += (str - ctx->begin - ctx->open_offset) * (ctx->depth == 0);
+    ++ctx->depth;
+    ctx->operand = 0;
+
+    return ++str;
+}
+
+/********************************************
+* Handles close brackets
+* Returns the next position
+********************************************/
+static const char* step_close_bracket(CONTEXT* ctx, const char* str)
+{
+    checkpoint_call_table[ctx->checkpoint != 0](ctx, str);
+
+    /* extract and print all the operations of the bracketed expression */
+    pop_operators(ctx, BINDING_ALL);
+
+    /* remove delimiter, it is always there since balance() has checked the depth */
+    pop0(&ctx->stack_top);
+    --ctx->depth;
+    ctx->operand = 1;
+
+    return ++str;
+}
+
+/********************************************
+* Stays at the same position after the end
+* of conversion
+********************************************/
+static const char* step_finished(CONTEXT* ctx, const char* str)
+{
+    STATS_HANDLER(ctx, STEP_FINISHED);
+
+    return str;
+}
+
+/********************************************
+* Passes the state before the bracket to the
+* checkpoint hook
+********************************************/
+static void take_checkpoint(CONTEXT* ctx, const char* str)
+{
+    CHECKPOINT at;
+
+    at.offset = str - ctx->begin;
+    at.output_length = ctx->output->length - ctx->output->mark;
+    at.stack = ctx->stack_bottom + 1;
+    at.stack_length = ctx->stack_top - ctx->stack_bottom;
+    at.depth = ctx->depth;
+    at.open_offset = ctx->open_offset;
+    at.operand = ctx->operand;
+    at.emitted = ctx->emitted;
+
+    ctx->checkpoint(ctx, &at);
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+static void skip_checkpoint(CONTEXT* ctx, const char* str)
+{
+}
+
+/********************************************
+* Does a block of steps and goes on with a
+* twice bigger block if necessary
+********************************************/
+static void trampoline(CONTEXT* ctx, int level)
+{
+    trampoline_block(ctx, level);
+
+    trampoline_next_table[ctx->finished](ctx, level + 1);
+}
+
+/********************************************
+* Does up to TRAMPOLINE_UNROLL * 2^level steps
+********************************************/
+static void trampoline_block(CONTEXT* ctx, int level)
+{
+    /* 0 - conversion is finished, 1 - split the block, 2 - do the steps */
+    int call_index = (1 + check_interval(level, 0, 0)) * (ctx->finished ^ 1);
+
+    trampoline_call_table[call_index](ctx, level);
+}
+
+/********************************************
+* Splits the block into two halves
+********************************************/
+static void trampoline_split(CONTEXT* ctx, int level)
+{
+    trampoline_block(ctx, level - 1);
+    trampoline_block(ctx, level - 1);
+}
+
+/********************************************
+* Does TRAMPOLINE_UNROLL steps, the steps
+* after the end of conversion do nothing
+********************************************/
+static void trampoline_steps(CONTEXT* ctx, int level)
+{
+    trampoline_step(ctx);
+    trampoline_step(ctx);
+    trampoline_step(ctx);
+    trampoline_step(ctx);
+    trampoline_step(ctx);
+    trampoline_step(ctx);
+    trampoline_step(ctx);
+    trampoline_step(ctx);
+}
+
+/********************************************
+* Does one step of the conversion
+********************************************/
+static void trampoline_step(CONTEXT* ctx)
+{
+    const STEP_ACTION steps[2] = { ctx->step, step_finished };
+
+    ctx->cursor = steps[ctx->finished](ctx, ctx->cursor);
+}
+
+/********************************************
+* Classifies the character at the position
+* and handles it
+* Returns the next position
+********************************************/
+static const char* step_classified(CONTEXT* ctx, const char* str)
+{
+    int call_index = balance(ctx, classify(ctx, str));
+
+    STATS_HANDLER(ctx, call_index);
+
+    return step_table[call_index](ctx, str);
+}
+
+/********************************************
+* Handles the character at the position with
+* the class found by the prepass
+* Returns the next position
+********************************************/
+static const char* step_prepared(CONTEXT* ctx, const char* str)
+{
+    int call_index = balance(ctx, ctx->classes[str - ctx->begin]);
+
+    STATS_HANDLER(ctx, call_index);
+
+    return step_table[call_index](ctx, str);
+}
+
+/********************************************
+* Handles the token at the position of the
+* input the prepass found no error in
+* Returns the next position
+********************************************/
+static const char* step_validated(CONTEXT* ctx, const char* str)
+{
+    int call_index = ctx->classes[str - ctx->begin];
+
+    STATS_HANDLER(ctx, call_index);
+
+    return validated_table[call_index](ctx, str);
+}
+
+/********************************************
+* Handles the run of symbols a-z, or the
+* identifier in the tokenizer mode, at the
+* position: its end is the first byte that
+* is not marked in the masks; the token
+* after it is handled too, it is not a symbol
+* Returns the position after the token
+********************************************/
+static const char* symbols_marked(CONTEXT* ctx, const char* str)
+{
+    SKIP skip;
+    const char* end;
+
+    skip.words = ctx->symbols;
+    skip.base = str - ctx->symbols_from;
+    skip.word = skip.base >> 6;
+
+    /* the bits shifted in are zeros, as if the bytes after the word were symbols */
+    skip.others = ~ctx->symbols[skip.word] >> (skip.base & 63);
+
+    skip_call_table[skip.others == 0](&skip);
+
+    end = ctx->symbols_from + skip.base + __builtin_ctzll(skip.others);
+
+    ctx->emitter(ctx, str, end - str);
+    ctx->operand = 1;
+
+    return step_validated(ctx, end);
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+static void skip_nothing(SKIP* skip)
+{
+}
+
+/********************************************
+* Looks for the end of the run in the words
+* after the first one
+********************************************/
+static void skip_words(SKIP* skip)
+{
+    iterate(skip_step, skip);
+}
+
+/********************************************
+* Looks at the next word for a byte that is
+* not a symbol, the end of the input is not
+* Returns 1 when it is found
+********************************************/
+static int  skip_step(void* arg)
+{
+    SKIP* skip = arg;
+
+    ++skip->word;
+    skip->base = skip->word << 6;
+    skip->others = ~skip->words[skip->word];
+
+    return skip->others != 0;
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+static void trampoline_nothing(CONTEXT* ctx, int level)
+{
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+static void print_nothing(CONTEXT* ctx, char c)
+{
+}
+
+/********************************************
+* Prints the symbol
+********************************************/
+static void print_char(CONTEXT* ctx, char c)
+{
+    ctx->char_emitter(ctx, &c);
+}
+
+/********************************************
+* Writes the token to the output
+********************************************/
+static void emit_text(CONTEXT* ctx, const char* token, size_t length)
+{
+    output_string(ctx->output, token, length);
+}
+
+/********************************************
+* Writes the token to the output separated
+* from the previous one by a space
+********************************************/
+static void emit_spaced(CONTEXT* ctx, const char* token, size_t length)
+{
+    output_string(ctx->output, " ", ctx->emitted);
+    output_string(ctx->output, token, length);
+
+    ctx->emitted = 1;
+}
+
+/********************************************
+* Writes the single character token to the
+* output
+********************************************/
+static void emit_char_text(CONTEXT* ctx, const char* c)
+{
+    output_char(ctx->output, *c);
+}
+
+/********************************************
+* Emits the single character token by the
+* emitter of the conversion
+********************************************/
+static void emit_char(CONTEXT* ctx, const char* c)
+{
+    ctx->emitter(ctx, c, 1);
+}
+
+/********************************************
+* Adds the token to the tree, operations are
+* told from operands by their precedence
+********************************************/
+static void emit_tree(CONTEXT* ctx, const char* token, size_t length)
+{
+    int operation = (precedence_table[(unsigned char)*token] != 0);
+
+    tree_call_table[operation * 2 + (operation ^ 1) * ctx->tokens](ctx, token, length);
+}
+
+/********************************************
+* Packs the opcodes of the token, a run of
+* symbols has one opcode per symbol
+********************************************/
+static void emit_packed(CONTEXT* ctx, const char* token, size_t length)
+{
+    LETTERS letters;
+
+    letters.ctx = ctx;
+    letters.position = token;
+    letters.end = token + length;
+
+    iterate(packed_step, &letters);
+}
+
+/********************************************
+* Packs the opcode of the next symbol of the
+* token
+* Returns 1 after the last symbol
+********************************************/
+static int  packed_step(void* arg)
+{
+    LETTERS* letters = arg;
+
+    pack_code(letters->ctx, *letters->position);
+    ++letters->position;
+
+    return letters->position == letters->end;
+}
+
+/********************************************
+* Packs the opcode of the symbol or of the
+* operation after the codes before it and
+* writes the bytes that are full
+********************************************/
+static void pack_code(CONTEXT* ctx, char c)
+{
+    char operation[2] = { c, 0 };
+    int symbol = check_interval(c, 'a', 'z');
+    uint64_t opcode = symbol * (c - 'a') + (symbol ^ 1) * (OPCODE_ADD + strcspn(RECORD_OPERATIONS, operation));
+
+    /* an opcode from RECORD_ESCAPE on is the escape code and the rest of the opcode */
+    int escaped = (opcode >= RECORD_ESCAPE);
+    uint64_t codes[2] = { opcode, RECORD_ESCAPE | (opcode - RECORD_ESCAPE) << RECORD_CODE_BITS };
+    uint64_t bytes;
+    unsigned full;
+
+    ctx->bits |= codes[escaped] << ctx->bit_count;
+    ctx->bit_count += RECORD_CODE_BITS << escaped;
+
+    /* the low bits go first */
+    full = ctx->bit_count / 8;
+    bytes = ctx->bits;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    bytes = __builtin_bswap64(bytes);
+#endif
+    output_string(ctx->output, (const char*)&bytes, full);
+
+    ctx->bits >>= full * 8;
+    ctx->bit_count -= full * 8;
+}
+
+/********************************************
+* Writes the last bits of the record and
+* fills in its header, the record of an
+* expression with an error has the error
+* line
+********************************************/
+static void record_end(CONTEXT* ctx)
+{
+    OUTPUT* out = ctx->output;
+    int ok = (ctx->status == STATUS_OK);
+
+    /* the bits after the last code are ones, too few for a code or an escape */
+    /* code with no code after it, so the end of the codes needs no count     */
+    uint64_t bytes = ctx->bits | (uint64_t)-1 << ctx->bit_count;
+    uint32_t header;
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    bytes = __builtin_bswap64(bytes);
+#endif
+    output_string(out, (const char*)&bytes, (ctx->bit_count + 7) / 8 * ok);
+
+    /* the length must fit in the header above the status bits */
+    record_length_table[out->length - out->mark > RECORD_LENGTH_MAX](ctx);
+
+    header = (uint32_t)(out->length - out->mark) << RECORD_STATUS_BITS | ctx->status;
+
+    memcpy(out->buffer + out->mark - RECORD_HEADER, &header, RECORD_HEADER);
+}
+
+/********************************************
+* Does nothing, there is no record
+********************************************/
+static void record_nothing(CONTEXT* ctx)
+{
+}
+
+/********************************************
+* Replaces the postfix form too long for the
+* header of the record with the error line
+********************************************/
+static void record_rejected(CONTEXT* ctx)
+{
+    char message[96];
+    int length;
+
+    ctx->status = STATUS_ERROR;
+    ctx->error_offset = ctx->end - ctx->begin;
+    ++ctx->errors;
+
+    ctx->output->length = ctx->output->mark;
+
+    length = snprintf(message, sizeof(message), "Error in the expression at offset %zu: record too long\n",
+                      ctx->error_offset);
+    output_string(ctx->output, message, length);
+}
+
+/********************************************
+* Starts the tree of the expression with the
+* empty node, it stands for the operands
+* missing in the expression and links to
+* itself, so taking operands below it never
+* leaves the arena
+********************************************/
+static void tree_start(CONTEXT* ctx)
+{
+    NODE* empty = ctx->nodes;
+
+    empty->token = "";
+    empty->length = 0;
+    empty->left = 0;
+    empty->right = 0;
+    empty->next = empty;
+    empty->arity = 0;
+    empty->operation = 0;
+    empty->same = empty;
+    empty->uses = 0;
+    empty->slot = 0;
+    empty->simple = empty;
+    empty->inner = 0;
+    empty->sign = 0;
+    empty->weight = 0;
+
+    ctx->node_next = empty + 1;
+    ctx->tree_top = empty;
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+static void tree_nothing(CONTEXT* ctx)
+{
+}
+
+/********************************************
+* Adds a run of symbols a-z to the tree, each
+* symbol is an operand of its own
+********************************************/
+static void tree_letters(CONTEXT* ctx, const char* token, size_t length)
+{
+    LETTERS letters;
+
+    letters.ctx = ctx;
+    letters.position = token;
+    letters.end = token + length;
+
+    iterate(letters_step, &letters);
+}
+
+/********************************************
+* Adds the next symbol of the run
+* Returns 1 after the last symbol
+********************************************/
+static int  letters_step(void* arg)
+{
+    LETTERS* letters = arg;
+
+    tree_operand(letters->ctx, letters->position, 1);
+    ++letters->position;
+
+    return letters->position == letters->end;
+}
+
+/********************************************
+* Adds an operand to the tree, the node
+* points to the token in the input
+********************************************/
+static void tree_operand(CONTEXT* ctx, const char* token, size_t length)
+{
+    NODE* node = ctx->node_next++;
+
+    node->token = token;
+    node->length = length;
+    node->left = 0;
+    node->right = 0;
+    node->next = ctx->tree_top;
+    node->arity = 0;
+    node->operation = 0;
+    node->uses = 0;
+    node->slot = 0;
+    node->simple = node;
+    node->inner = 0;
+    node->sign = 0;
+    node->weight = 0;
+
+    share_call_table[ctx->dag | ctx->simplify](ctx, node);
+
+    ctx->tree_top = node;
+}
+
+/********************************************
+* Adds an operation to the tree, it takes
+* the last subtrees built as its operands,
+* or the identical ones built before them
+********************************************/
+static void tree_operation(CONTEXT* ctx, const char* token, size_t length)
+{
+    NODE* node = ctx->node_next++;
+    NODE* top = ctx->tree_top;
+
+    /* the unary minus takes one operand, the other operations two */
+    int binary = check_interval(*token, UNARY_MINUS, UNARY_MINUS) ^ 1;
+    NODE* lefts[2] = { top, top->next };
+    NODE* rights[2] = { 0, top->same };
+
+    node->operation = *token;
+    node->token = &node->operation;
+    node->length = 1;
+    node->left = lefts[binary]->same;
+    node->right = rights[binary];
+    node->next = lefts[binary]->next;
+    node->arity = 1 + binary;
+    node->uses = 0;
+    node->slot = 0;
+    node->simple = node;
+    node->inner = 0;
+    node->sign = 0;
+    node->weight = 0;
+
+    share_call_table[ctx->dag | ctx->simplify](ctx, node);
+
+    ctx->tree_top = node;
+}
+
+/********************************************
+* Leaves the node as it is, it is not looked
+* for outside of the DAG mode
+********************************************/
+static void tree_distinct(CONTEXT* ctx, NODE* node)
+{
+    node->same = node;
+}
+
+/********************************************
+* Looks for a subtree identical to the node
+* in the hash table, the operands of the node
+* are the distinct ones, so the subtrees are
+* identical if the nodes are
+********************************************/
+static void tree_share(CONTEXT* ctx, NODE* node)
+{
+    SHARE share;
+
+    share.ctx = ctx;
+    share.node = node;
+    share.position = node_hash(node) & ctx->shared_mask;
+
+    iterate(share_step, &share);
+
+    found_call_table[ctx->shared[share.position] != 0](&share);
+}
+
+/********************************************
+* Takes a node from the arena with the token,
+* the operation and the operands of the model
+* and looks for the identical one in the hash
+* table, the DAG or simplify mode keeps it
+* Returns the node, or the identical one
+********************************************/
+NODE* share_node(CONTEXT* ctx, const NODE* model)
+{
+    NODE* node = ctx->node_next++;
+    const char* tokens[2] = { model->token, &node->operation };
+
+    node->operation = model->operation;
+    node->token = tokens[model->arity != 0];
+    node->length = model->length;
+    node->left = model->left;
+    node->right = model->right;
+    node->next = 0;
+    node->arity = model->arity;
+    node->uses = 0;
+    node->slot = 0;
+    node->simple = node;
+    node->inner = 0;
+    node->sign = 0;
+    node->weight = 0;
+
+    tree_share(ctx, node);
+
+    return node->same;
+}
+
+/********************************************
+* Looks at the next entry of the table, the
+* table is never full, so there is always a
+* vacant one
+* Returns 1 at the identical subtree or at a
+* vacant entry
+********************************************/
+static int  share_step(void* arg)
+{
+    SHARE* share = arg;
+    const NODE* entry = share->ctx->shared[share->position];
+    int vacant = (entry == 0);
+    const NODE* entries[2] = { entry, &vacant_node };
+    int stop = vacant | node_equal(entries[vacant], share->node);
+
+    share->position = (share->position + (stop ^ 1)) & share->ctx->shared_mask;
+
+    return stop;
+}
+
+/********************************************
+* Keeps the node in the vacant entry, it is
+* the first subtree of its kind, and counts
+* the uses of its operands
+********************************************/
+static void share_new(SHARE* share)
+{
+    NODE* node = share->node;
+
+    /* the uses of missing operands go to the empty node, it never gets a slot */
+    NODE* lefts[2] = { share->ctx->nodes, node->left };
+    NODE* rights[2] = { share->ctx->nodes, node->right };
+
+    share->ctx->shared[share->position] = node;
+    node->same = node;
+
+    share_use(share->ctx, lefts[node->left != 0]);
+    share_use(share->ctx, rights[node->right != 0]);
+}
+
+/********************************************
+* Uses the identical subtree instead of the
+* node
+********************************************/
+static void share_found(SHARE* share)
+{
+    share->node->same = share->ctx->shared[share->position];
+}
+
+/********************************************
+* Counts a use of the node, an operation used
+* the second time gets a slot
+********************************************/
+static void share_use(CONTEXT* ctx, NODE* node)
+{
+    int shared = (++node->uses == 2) & (node->arity != 0);
+
+    ctx->slots += shared;
+    node->slot += ctx->slots * shared;
+}
+
+/********************************************
+* Hashes the node by its token and operands,
+* the token by its length, first and last
+* characters, as the nodes are compared
+* anyway
+********************************************/
+static uint64_t node_hash(const NODE* node)
+{
+    uint64_t hash = (unsigned char)node->token[0] |
+                    (uint64_t)(unsigned char)node->token[node->length - (node->length != 0)] << 8 |
+                    (uint64_t)node->length << 16;
+
+    hash ^= (uintptr_t)node->left * 0x9E3779B97F4A7C15ull;
+    hash ^= (uintptr_t)node->right * 0xC2B2AE3D27D4EB4Full;
+    hash *= 0xFF51AFD7ED558CCDull;
+
+    return hash ^ (hash >> 32);
+}
+
+/********************************************
+* Returns 1 if the nodes have the same token
+* and the same operands
+* The tokens are compared only if the rest
+* is the same, as memcmp() of 0 bytes
+* compares nothing
+********************************************/
+static int  node_equal(const NODE* a, const NODE* b)
+{
+    int tagged = (a->arity == b->arity) & (a->left == b->left) & (a->right == b->right) &
+                 (a->length == b->length);
+
+    return tagged & (memcmp(a->token, b->token, a->length * tagged) == 0);
+}
+
+/********************************************
+* Empties the part of the hash table used by
+* an expression of count nodes, twice as big
+* as needed, so the entries are found fast
+********************************************/
+static void shared_reset(CONTEXT* ctx, size_t count)
+{
+    size_t size = power_of_2(count * 2);
+
+    ctx->shared_mask = size - 1;
+    memset(ctx->shared, 0, size * sizeof(NODE*));
+}
+
+/********************************************
+* Keeps the hash table as is, it is not used
+* outside of the DAG mode
+********************************************/
+static void shared_keep(CONTEXT* ctx, size_t count)
+{
+}
+
+/********************************************
+* Returns the smallest power of 2 that is not
+* less than the value
+********************************************/
+static size_t power_of_2(size_t value)
+{
+    size_t bits = value - 1;
+
+    bits |= bits >> 1;
+    bits |= bits >> 2;
+    bits |= bits >> 4;
+    bits |= bits >> 8;
+    bits |= bits >> 16;
+    bits |= bits >> 32;
+
+    return bits + 1;
+}
+
+/********************************************
+* Ends the tree, the last subtree built is
+* the whole tree, and prints it
+********************************************/
+static void tree_end(CONTEXT* ctx)
+{
+    ctx->root = ctx->tree_top->same;
+
+    finish_call_table[ctx->simplify](ctx);
+}
+
+/********************************************
+* Prints the tree as (operation operand ...),
+* nested. The pending nodes are kept in a
+* stack of their own, so the depth of the
+* tree does not matter
+********************************************/
+static void print_tree(CONTEXT* ctx)
+{
+    WALK walk;
+
+    walk.output = ctx->output;
+    walk.pending = ctx->pending;
+    walk.pending[0] = ctx->root;
+    walk.count = 1;
+    walk.spaced = 0;
+    walk.labels = ctx->labels;
+    walk.label = 0;
+
+    /* no shared subtree is printed yet, slot 0 stays unlabeled for the rest */
+    memset(walk.labels, 0, (ctx->slots + 1) * sizeof(size_t));
+
+    iterate(walk_step, &walk);
+}
+
+/********************************************
+* Prints the next pending node
+* Returns 1 when there is nothing to print
+********************************************/
+static int  walk_step(void* arg)
+{
+    WALK* walk = arg;
+    const NODE* node = walk->pending[--walk->count];
+    int printed = (walk->labels[node->slot] != 0);
+
+    walk_call_table[node->arity + (WALK_REFERENCE - node->arity) * printed](walk, node);
+
+    return walk->count == 0;
+}
+
+/********************************************
+* Prints an operand
+********************************************/
+static void walk_operand(WALK* walk, const NODE* node)
+{
+    output_string(walk->output, " ", walk->spaced);
+    output_string(walk->output, node->token, node->length);
+
+    walk->spaced = 1;
+}
+
+/********************************************
+* Prints an operation and leaves its operands
+* and the close bracket pending
+********************************************/
+static void walk_operation(WALK* walk, const NODE* node)
+{
+    int binary = node->arity - 1;
+
+    output_string(walk->output, " ", walk->spaced);
+    label_call_table[node->slot != 0](walk, node);
+    output_char(walk->output, '(');
+    output_char(walk->output, node->operation);
+
+    walk->spaced = 1;
+
+    /* the left operand is printed first, so it is pushed last, and the */
+    /* right one of the unary minus is overwritten by the left one      */
+    walk->pending[walk->count++] = &tree_close;
+    walk->pending[walk->count] = node->right;
+    walk->count += binary;
+    walk->pending[walk->count++] = node->left;
+}
+
+/********************************************
+* Prints the close bracket of an operation
+********************************************/
+static void walk_close(WALK* walk, const NODE* node)
+{
+    output_char(walk->output, ')');
+}
+
+/********************************************
+* Prints a shared subtree printed before as
+* #N#
+********************************************/
+static void walk_reference(WALK* walk, const NODE* node)
+{
+    char reference[32];
+    int length = snprintf(reference, sizeof(reference), "#%zu#", walk->labels[node->slot]);
+
+    output_string(walk->output, " ", walk->spaced);
+    output_string(walk->output, reference, length);
+
+    walk->spaced = 1;
+}
+
+/********************************************
+* Labels a shared subtree printed the first
+* time, it is printed as #N=(...)
+********************************************/
+static void walk_label(WALK* walk, const NODE* node)
+{
+    char label[32];
+    int length;
+
+    walk->labels[node->slot] = ++walk->label;
+    length = snprintf(label, sizeof(label), "#%zu=", walk->label);
+
+    output_string(walk->output, label, length);
+}
+
+/********************************************
+* Labels nothing, the subtree is used once
+********************************************/
+static void walk_unlabeled(WALK* walk, const NODE* node)
+{
+}
+
+/********************************************
+* Passes the token to the emit function of
+* the caller
+********************************************/
+static void emit_hook(CONTEXT* ctx, const char* token, size_t length)
+{
+    ctx->emit(ctx, token, length);
+}
+
+/********************************************
+* Pushes data into the stack
+********************************************/
+static void push(char c, char** stack_top)
+{
+    ++(*stack_top);
+    **stack_top = c;
+}
+
+#ifdef ACYCLOMATIC_STATS
+/********************************************
+* Counts the depth of the stack after a push
+********************************************/
+static void stats_stack(CONTEXT* ctx)
+{
+    uint64_t depth = ctx->stack_top - ctx->stack_bottom;
+
+    ctx->stats.max_stack ^= (ctx->stats.max_stack ^ depth) & -(uint64_t)(depth > ctx->stats.max_stack);
+}
+#endif
+
+/********************************************
+* Pops 0 from the stack
+* to go below the bottom
+********************************************/
+static void pop0(char** stack_top)
+{
+    *stack_top -= check_interval(**stack_top, 0, 0);
+}
+
+/********************************************
+* Pops and prints the operations with the
+* precedence of at least binding, down to
+* the delimiter of brackets
+********************************************/
+static void pop_operators(CONTEXT* ctx, int binding)
+{
+    /* mostly there are up to two operations to pop, they are popped here */
+    /* and the rest, if the second one is popped too, by iterate()       */
+    int more = pop_operator(ctx, binding);
+
+    more &= pop_operator(ctx, binding);
+
+    drain_call_table[more](ctx, binding);
+}
+
+/********************************************
+* Pops and prints the operation at the top of
+* the stack if its precedence is at least
+* binding
+* Returns 1 if the operation is popped
+********************************************/
+static int  pop_operator(CONTEXT* ctx, int binding)
+{
+    char c = *ctx->stack_top;
+    int popped = (precedence_table[(unsigned char)c] >= binding);
+
+    STATS_PRINT(ctx, popped);
+    print_call_table[popped](ctx, c);
+    ctx->stack_top -= popped;
+
+    return popped;
+}
+
+/********************************************
+* Pops the rest of operations
+********************************************/
+static void drain_operators(CONTEXT* ctx, int binding)
+{
+    DRAIN drain;
+
+    drain.ctx = ctx;
+    drain.binding = binding;
+
+    iterate(drain_step, &drain);
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+static void drain_nothing(CONTEXT* ctx, int binding)
+{
+}
+
+/********************************************
+* Pops one more operation
+* Returns 1 when there is nothing to pop
+********************************************/
+static int  drain_step(void* arg)
+{
+    DRAIN* drain = arg;
+
+    return pop_operator(drain->ctx, drain->binding) ^ 1;
+}
+
+/********************************************
+* Makes the stack empty and big enough for
+* an expression of the given length
+* Every push consumes a character of the
+* expression, so the stack never needs more
+* than length + 1 bytes and push() does not
+* need to check for overflow
+********************************************/
+static void reset_stack(CONTEXT* ctx, size_t length)
+{
+    reserve_call_table[length >= ctx->stack_size](ctx, length + 1);
+
+    ctx->stack_top = ctx->stack_bottom;
+    *ctx->stack_top = 0;
+}
+
+/********************************************
+* Grows the stack geometrically to hold at
+* least depth bytes
+********************************************/
+static void stack_grow(CONTEXT* ctx, size_t depth)
+{
+    size_t doubled = ctx->stack_size * 2;
+
+    /* take the maximum of doubled and depth */
+    ctx->stack_size = doubled ^ ((doubled ^ depth) & -(size_t)(doubled < depth));
+
+    /* the stack is empty here, so it does not need to be copied */
+    free(ctx->stack_bottom);
+    ctx->stack_bottom = malloc(ctx->stack_size);
+
+    allocation_check_table[ctx->stack_bottom == 0](ctx->stack_bottom);
+}
+
+/********************************************
+* Grows the class buffer of the prepass to
+* hold at least size classes, and a bit for
+* every one of them after the classes
+********************************************/
+static void classes_grow(CONTEXT* ctx, size_t size)
+{
+    size_t doubled = ctx->classes_size * 2;
+    size_t aligned;
+
+    /* take the maximum of doubled and size */
+    ctx->classes_size = doubled ^ ((doubled ^ size) & -(size_t)(doubled < size));
+    aligned = (ctx->classes_size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+
+    free(ctx->classes);
+    ctx->classes = malloc(aligned + ((ctx->classes_size >> 6) + 1) * sizeof(uint64_t));
+
+    allocation_check_table[ctx->classes == 0](ctx->classes);
+    ctx->symbols = (uint64_t*)(ctx->classes + aligned);
+}
+
+/********************************************
+* Keeps the class buffer as is
+********************************************/
+static void classes_keep(CONTEXT* ctx, size_t size)
+{
+}
+
+/********************************************
+* Grows the node arena geometrically to hold
+* at least count nodes, and the stack of the
+* nodes pending to print, the hash table and
+* the labels of the DAG mode and the terms of
+* the simplify mode with it
+* An operation leaves 3 nodes pending for 1
+* printed, so count nodes never leave more
+* than 2 * count + 1 of them
+********************************************/
+static void nodes_grow(CONTEXT* ctx, size_t count)
+{
+    size_t doubled = ctx->nodes_size * 2;
+
+    /* take the maximum of doubled and count */
+    ctx->nodes_size = doubled ^ ((doubled ^ count) & -(size_t)(doubled < count));
+
+    /* the nodes of the previous expression are not needed any more */
+    free(ctx->nodes);
+    free(ctx->pending);
+    free(ctx->shared);
+    free(ctx->labels);
+    free(ctx->terms);
+    ctx->nodes = malloc(ctx->nodes_size * sizeof(NODE));
+    ctx->pending = malloc((ctx->nodes_size * 2 + 1) * sizeof(const NODE*));
+    ctx->shared = malloc(power_of_2(ctx->nodes_size * 2) * sizeof(NODE*));
+    ctx->labels = malloc((ctx->nodes_size + 1) * sizeof(size_t));
+    /* the terms of a chain and the ones left of them, then the inner operations */
+    ctx->terms = malloc(ctx->nodes_size * 3 * sizeof(NODE*));
+
+    allocation_check_table[ctx->nodes == 0](ctx->nodes);
+    allocation_check_table[ctx->pending == 0](ctx->pending);
+    allocation_check_table[ctx->shared == 0](ctx->shared);
+    allocation_check_table[ctx->labels == 0](ctx->labels);
+    allocation_check_table[ctx->terms == 0](ctx->terms);
+}
+
+/********************************************
+* Keeps the node arena as is
+********************************************/
+static void nodes_keep(CONTEXT* ctx, size_t count)
+{
+}
+
+/********************************************
+* Keeps the stack as is
+********************************************/
+static void stack_keep(CONTEXT* ctx, size_t depth)
+{
+}
+
+/********************************************
+* Checks the memory allocated, exits if it
+* cannot be allocated
+********************************************/
+void check_allocation(void* memory)
+{
+    allocation_check_table[memory == 0](memory);
+}
+
+/********************************************
+* Accepts the allocated memory
+********************************************/
+static void allocated(void* memory)
+{
+}
+
+/********************************************
+* Reports that memory cannot be allocated
+* and exits
+********************************************/
+static void allocation_failed(void* memory)
+{
+    fprintf(stderr, "Not enough memory\n");
+
+    exit(1);
+}
+
+/********************************************
+* Initializes the output sink writing the
+* caller-owned buffer to the file descriptor
+* each time the buffer is full
+********************************************/
+void init_output(OUTPUT* output, char* buffer, size_t size, int fd)
+{
+    output->buffer = buffer;
+    output->size = size;
+    output->length = 0;
+    output->fd = fd;
+    output->full = output_write;
+    output->mark = 0;
+    output->failed = 0;
+}
+
+/********************************************
+* Initializes the output sink collecting the
+* whole output in memory
+********************************************/
+void init_memory_output(OUTPUT* output, size_t size)
+{
+    output->buffer = malloc(size);
+    allocation_check_table[output->buffer == 0](output->buffer);
+
+    output->size = size;
+    output->length = 0;
+    output->fd = -1;
+    output->full = output_grow;
+    output->mark = 0;
+    output->failed = 0;
+}
+
+/********************************************
+* Deallocates the buffer of a memory output
+********************************************/
+void free_memory_output(OUTPUT* output)
+{
+    free(output->buffer);
+
+    output->buffer = 0;
+    output->size = 0;
+    output->length = 0;
+}
+
+/********************************************
+* Puts the character into the output buffer
+********************************************/
+void output_char(OUTPUT* output, char c)
+{
+    output->buffer[output->length++] = c;
+
+    flush_call_table[output->length == output->size](output);
+}
+
+/********************************************
+* Puts the string into the output buffer
+********************************************/
+void output_string(OUTPUT* output, const char* str, size_t length)
+{
+    output_call_table[length == 0](output, str, length);
+}
+
+/********************************************
+* Puts as much of the string as fits into
+* the output buffer, makes room if the
+* buffer is full and goes on with the rest
+********************************************/
+static void output_string_rest(OUTPUT* output, const char* str, size_t length)
+{
+    size_t space = output->size - output->length;
+
+    /* take the minimum of space and length */
+    size_t count = space ^ ((space ^ length) & -(size_t)(length < space));
+
+    memcpy(output->buffer + output->length, str, count);
+    output->length += count;
+
+    flush_call_table[output->length == output->size](output);
+
+    output_string(output, str + count, length - count);
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+static void output_nothing(OUTPUT* output, const char* str, size_t length)
+{
+}
+
+/********************************************
+* Writes the collected output with a single
+* write() and makes the buffer empty, the
+* output is dropped once a write has failed
+********************************************/
+void flush_output(OUTPUT* output)
+{
+    write_all(output, output->buffer, output->length);
+
+    output->length = 0;
+    output->mark = 0;
+}
+
+/********************************************
+* Makes room in the full output buffer
+********************************************/
+static void output_flush_full(OUTPUT* output)
+{
+    output->full(output);
+}
+
+/********************************************
+* Keeps collecting the output
+********************************************/
+static void output_keep(OUTPUT* output)
+{
+}
+
+/********************************************
+* Writes the full buffer out
+********************************************/
+static void output_write(OUTPUT* output)
+{
+    flush_output(output);
+}
+
+/********************************************
+* Grows the full buffer twice
+********************************************/
+static void output_grow(OUTPUT* output)
+{
+    output->size *= 2;
+    output->buffer = realloc(output->buffer, output->size);
+
+    allocation_check_table[output->buffer == 0](output->buffer);
+}
+
+/********************************************
+* Writes the data to the file descriptor
+* repeating partial writes
+********************************************/
+static void write_all(OUTPUT* output, const char* data, size_t length)
+{
+    write_call_table[(length == 0) | output->failed](output, data, length);
+}
+
+/********************************************
+* Writes the data and goes on with the part
+* that has not been written
+********************************************/
+static void write_rest(OUTPUT* output, const char* data, size_t length)
+{
+    ssize_t written = write(output->fd, data, length);
+
+    /* repeat interrupted writes, fail on writing nothing and on other errors */
+    int interrupted = (written < 0) & (errno == EINTR);
+    size_t count = (size_t)written * (written > 0);
+
+    output->failed = (written <= 0) & (interrupted ^ 1);
+
+    write_all(output, data + count, length - count);
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+static void write_nothing(OUTPUT* output, const char* data, size_t length)
+{
+}
+
+/********************************************
+* Repeats the step until it reports the end
+* Steps are done in blocks of 1, 2, 4, ...
+* steps each, so the depth of recursion is
+* logarithmic in the number of steps
+********************************************/
+void iterate(int (*step)(void* arg), void* arg)
+{
+    ITERATION it;
+
+    it.step = step;
+    it.arg = arg;
+    it.done = 0;
+
+    iterate_blocks(&it, 0);
+}
+
+/********************************************
+* Does a block of 2^level steps and goes on
+* with a twice bigger block if necessary
+********************************************/
+static void iterate_blocks(ITERATION* it, int level)
+{
+    iterate_block(it, level);
+
+    iterate_next_table[it->done](it, level + 1);
+}
+
+/********************************************
+* Does up to 2^level steps
+********************************************/
+static void iterate_block(ITERATION* it, int level)
+{
+    /* 0 - nothing is left to do, 1 - split the block, 2 - do one step */
+    int call_index = (1 + check_interval(level, 0, 0)) * (it->done ^ 1);
+
+    iterate_call_table[call_index](it, level);
+}
+
+/********************************************
+* Splits the block into two halves
+********************************************/
+static void iterate_split(ITERATION* it, int level)
+{
+    iterate_block(it, level - 1);
+    iterate_block(it, level - 1);
+}
+
+/********************************************
+* Does one step
+********************************************/
+static void iterate_once(ITERATION* it, int level)
+{
+    it->done = it->step(it->arg);
+}
+
+/********************************************
+* Does nothing
+********************************************/
+static void iterate_nothing(ITERATION* it, int level)
+{
+}
@@ -0,0 +1,832 @@
+/*============================================================================================
+* Simplification of the expression tree
+*
+* In the simplify mode the tree is built as a DAG: every subtree is looked up in the hash
+* table of the distinct ones, so two subtrees are identical if they are the same node. The
+* nodes are simplified in the order they are built, the operands before the operations:
+*
+* - a chain of + and - with the unary minus, or of * and /, is simplified at its top
+*   operation; its inner operations are the ones of the chain that only the chain uses,
+*   the rest of the operands are its terms, they are simplified before the chain;
+* - every term has a weight: the times it is added less the times it is subtracted (or
+*   multiplied and divided), so the terms that cancel out are left out, and 0 (1) is;
+* - the terms added are added up into a balanced tree, so is the rest, and the chain is
+*   P-N, ~N or P (P/N, 1/N or P), or 0 (1) if no terms are left; a product with 0
+*   multiplied is 0;
+* - x^1 -> x, x^0 -> 1, 1^x -> 1 and 0%x -> 0;
+* - the operands of % are left as they are: the remainder is not continuous, so the
+*   chains computed in another order could change it by a multiple of the divisor.
+*
+* Example:
+*   a-a         ->   0
+*   a*(b/b)     ->   a
+*   a+b-a+c     ->   bc+
+*   a+b+c+d     ->   ab+cd++
+*   a+a+a+a     ->   aa+aa++       the sum a+a is computed once by compile_tree()
+*   a*b/b%c     ->   ab*b/c%
+*
+* The balanced trees make the chains of dependent operations shorter: the operations of a
+* level do not need each other's results, so the evaluators run them one after another
+* with no waiting.
+*
+* Copyright 2006-2016 Mikhail Durnev (mdurnev@gmail.com). Released under the GPLv3
+============================================================================================*/
+#include <string.h>
+
+#include "acyclomatic.h"
+
+
+/* data types */
+typedef struct SIMPLIFY SIMPLIFY;
+typedef struct REDUCE REDUCE;
+typedef struct POSTFIX POSTFIX;
+
+/* function prototypes */
+static int  node_kind(const NODE* node);
+static NODE* make_operation(CONTEXT* ctx, char operation, NODE* left, NODE* right);
+static int  inner_step(void* arg);
+static void mark_inner(NODE* operand, int chain, int distinct);
+static int  simplify_step(void* arg);
+static void simplify_chain(SIMPLIFY* simplify, NODE* node);
+static void simplify_power(SIMPLIFY* simplify, NODE* node);
+static void simplify_remainder(SIMPLIFY* simplify, NODE* node);
+static void simplify_nothing(SIMPLIFY* simplify, NODE* node);
+static NODE* fold_rebuild(SIMPLIFY* simplify, const NODE* node, NODE* left, NODE* right);
+static NODE* fold_left(SIMPLIFY* simplify, const NODE* node, NODE* left, NODE* right);
+static NODE* fold_zero(SIMPLIFY* simplify, const NODE* node, NODE* left, NODE* right);
+static NODE* fold_one(SIMPLIFY* simplify, const NODE* node, NODE* left, NODE* right);
+static int  chain_step(void* arg);
+static void chain_term(SIMPLIFY* simplify, NODE* operand, int sign);
+static void chain_inner(SIMPLIFY* simplify, NODE* operand, int sign);
+static void chain_missing(SIMPLIFY* simplify, NODE* operand, int sign);
+static size_t cancel(SIMPLIFY* simplify, long polarity);
+static int  cancel_step(void* arg);
+static void fill_copies(SIMPLIFY* simplify);
+static void fill_nothing(SIMPLIFY* simplify);
+static int  fill_step(void* arg);
+static NODE* reduce(CONTEXT* ctx, NODE** terms, size_t count, char operation);
+static void reduce_levels(REDUCE* reduce);
+static void reduce_nothing(REDUCE* reduce);
+static int  level_step(void* arg);
+static int  pair_step(void* arg);
+static NODE* combine_neutral(SIMPLIFY* simplify, NODE* added, NODE* subtracted);
+static NODE* combine_added(SIMPLIFY* simplify, NODE* added, NODE* subtracted);
+static NODE* combine_subtracted(SIMPLIFY* simplify, NODE* added, NODE* subtracted);
+static NODE* combine_both(SIMPLIFY* simplify, NODE* added, NODE* subtracted);
+static int  reset_step(void* arg);
+static int  count_step(void* arg);
+static void count_use(SIMPLIFY* simplify, NODE* node);
+static int  postfix_step(void* arg);
+static void postfix_operand(POSTFIX* postfix, const NODE* node);
+static void postfix_operation(POSTFIX* postfix, const NODE* node);
+static void postfix_computed(POSTFIX* postfix, const NODE* node);
+
+/* data types */
+typedef void (*SIMPLIFY_ACTION)(SIMPLIFY* simplify, NODE* node);
+typedef NODE* (*FOLD_ACTION)(SIMPLIFY* simplify, const NODE* node, NODE* left, NODE* right);
+typedef void (*CHAIN_ACTION)(SIMPLIFY* simplify, NODE* operand, int sign);
+typedef void (*FILL_ACTION)(SIMPLIFY* simplify);
+typedef void (*REDUCE_ACTION)(REDUCE* reduce);
+typedef NODE* (*COMBINE_ACTION)(SIMPLIFY* simplify, NODE* added, NODE* subtracted);
+typedef void (*POSTFIX_ACTION)(POSTFIX* postfix, const NODE* node);
+
+/* state of the simplification */
+struct SIMPLIFY
+{
+    CONTEXT* ctx;
+    NODE* constants[2];     /* the nodes of 0 and 1, by the chain they are neutral in */
+    NODE* position;         /* next node of the arena */
+    NODE* end;              /* end of the nodes of the tree as it is built */
+    NODE** inner;           /* inner operations pending, a node at most once */
+    size_t count;           /* number of the pending ones */
+    int chain;              /* chain simplified, CHAIN_SUM or CHAIN_PRODUCT */
+    size_t terms;           /* terms of the chain in ctx->terms, in reverse order */
+    size_t index;           /* next term to look at, from the last one down */
+    long polarity;          /* 1 to take the terms added, -1 the ones subtracted */
+    NODE** fill;            /* next place of a term left, after the terms */
+    NODE* term;             /* term taken */
+    long copies;            /* number of its copies left to take */
+};
+
+/* state of adding up the terms into a balanced tree, level by level */
+struct REDUCE
+{
+    CONTEXT* ctx;
+    NODE** terms;           /* the terms of the level, replaced with the next level */
+    size_t count;           /* number of terms of the level */
+    size_t pair;            /* next pair of terms */
+    char operation;
+};
+
+/* state of printing the postfix form of the tree */
+struct POSTFIX
+{
+    OUTPUT* output;
+    const NODE** pending;   /* nodes left to print, the last one is printed next */
+    size_t count;           /* number of pending nodes */
+    int spaced;             /* 1 when a space goes before the next token */
+    int tokens;             /* 1 - the tokens are separated by spaces */
+};
+
+
+/* constants */
+
+/* operations of the nodes, the index of the operation is the kind of the node, */
+/* an operand is of the kind of the terminator                                  */
+#define SIMPLIFY_OPERATIONS "+-~*/^%"
+
+/* kinds of the chains */
+#define CHAIN_SUM 0
+#define CHAIN_PRODUCT 1
+#define CHAIN_NONE 2
+
+/* operations adding up the terms of a chain, subtracting the ones subtracted, */
+/* and taking the ones subtracted alone, by the kind of the chain              */
+#define CHAIN_OPERATIONS "+*"
+#define CHAIN_INVERSES "-/"
+#define CHAIN_NEGATIONS "~/"
+
+/* index in simplification call table for the nodes simplified with their chain, */
+/* the duplicates and the operands, the operands are simple as they are          */
+#define SIMPLIFY_NOTHING 7
+
+/* index in chain call table for the missing right operand of the unary minus */
+#define CHAIN_MISSING 2
+
+/* arity of the pending node printing an operation after its operands */
+#define POSTFIX_COMPUTED 3
+
+/* the pending operation below it is printed next, see postfix_operation() */
+static const NODE postfix_mark = { .token = "", .arity = POSTFIX_COMPUTED };
+
+
+/* function arrays */
+
+/* kinds of the chains, indexed by the kind of the node */
+static const int chain_table[] =
+{
+    CHAIN_SUM, CHAIN_SUM, CHAIN_SUM,
+    CHAIN_PRODUCT, CHAIN_PRODUCT,
+    CHAIN_NONE, CHAIN_NONE,
+    CHAIN_NONE
+};
+
+/* signs of the operands in the chain, indexed by the kind of the node */
+static const int left_signs[] = { 1, 1, -1, 1, 1, 0, 0, 0 };
+static const int right_signs[] = { 1, -1, 0, 1, -1, 0, 0, 0 };
+
+/* simplification call table, indexed by the kind of the node, or SIMPLIFY_NOTHING */
+static const SIMPLIFY_ACTION simplify_call_table[] =
+{
+    simplify_chain,
+    simplify_chain,
+    simplify_chain,
+    simplify_chain,
+    simplify_chain,
+    simplify_power,
+    simplify_remainder,
+    simplify_nothing
+};
+
+/* power folding call table, indexed by 1 ^ x or x ^ 0, or 2 for x ^ 1 */
+static const FOLD_ACTION power_call_table[] =
+{
+    fold_rebuild,
+    fold_one,
+    fold_left
+};
+
+/* remainder folding call table, indexed by 0 % x */
+static const FOLD_ACTION remainder_call_table[] =
+{
+    fold_rebuild,
+    fold_zero
+};
+
+/* chain call table, indexed by the operand being inner, or CHAIN_MISSING */
+static const CHAIN_ACTION chain_call_table[] =
+{
+    chain_term,
+    chain_inner,
+    chain_missing
+};
+
+/* copies call table, indexed by having copies to take */
+static const FILL_ACTION fill_call_table[] =
+{
+    fill_nothing,
+    fill_copies
+};
+
+/* reduction call table, indexed by having more than one term */
+static const REDUCE_ACTION reduce_call_table[] =
+{
+    reduce_nothing,
+    reduce_levels
+};
+
+/* chain combination call table, indexed by having the terms added (1) */
+/* and the ones subtracted (2)                                          */
+static const COMBINE_ACTION combine_call_table[] =
+{
+    combine_neutral,
+    combine_added,
+    combine_subtracted,
+    combine_both
+};
+
+/* postfix call table, indexed by the arity of the node, or POSTFIX_COMPUTED */
+static const POSTFIX_ACTION postfix_call_table[] =
+{
+    postfix_operand,
+    postfix_operation,
+    postfix_operation,
+    postfix_computed
+};
+
+
+
+/********************************************
+* Simplifies the tree of the conversion, then
+* counts the uses of its nodes again, so the
+* shared ones get their slots, and prints its
+* postfix form
+********************************************/
+void simplify_tree(CONTEXT* ctx)
+{
+    SIMPLIFY simplify;
+    POSTFIX postfix;
+    NODE zero = { .token = "0", .length = 1 };
+    NODE one = { .token = "1", .length = 1 };
+
+    simplify.ctx = ctx;
+    simplify.end = ctx->node_next;
+    simplify.inner = ctx->terms + ctx->nodes_size * 2;
+
+    /* the constants of the input are these too */
+    simplify.constants[0] = share_node(ctx, &zero);
+    simplify.constants[1] = share_node(ctx, &one);
+
+    simplify.position = ctx->nodes;
+    iterate(inner_step, &simplify);
+
+    simplify.position = ctx->nodes;
+    iterate(simplify_step, &simplify);
+
+    ctx->root = ctx->root->simple;
+
+    /* the uses by the nodes left out are not counted */
+    simplify.position = ctx->nodes;
+    simplify.end = ctx->node_next;
+    iterate(reset_step, &simplify);
+
+    ctx->slots = 0;
+    simplify.inner[0] = ctx->root;
+    simplify.count = 1;
+    iterate(count_step, &simplify);
+
+    postfix.output = ctx->output;
+    postfix.pending = ctx->pending;
+    postfix.pending[0] = ctx->root;
+    postfix.count = 1;
+    postfix.spaced = 0;
+    postfix.tokens = ctx->tokens;
+
+    iterate(postfix_step, &postfix);
+}
+
+/********************************************
+* Returns the kind of the node, the index of
+* its operation in SIMPLIFY_OPERATIONS
+********************************************/
+static int  node_kind(const NODE* node)
+{
+    return (int)(strchr(SIMPLIFY_OPERATIONS, node->operation) - SIMPLIFY_OPERATIONS);
+}
+
+/********************************************
+* Makes the operation, a unary one with no
+* right operand
+* Returns the node, or the identical one
+********************************************/
+static NODE* make_operation(CONTEXT* ctx, char operation, NODE* left, NODE* right)
+{
+    NODE model;
+
+    model.token = "";
+    model.length = 1;
+    model.left = left;
+    model.right = right;
+    model.arity = 1 + (right != 0);
+    model.operation = operation;
+
+    return share_node(ctx, &model);
+}
+
+/********************************************
+* Marks the inner operands of the next node
+* of the tree
+* Returns 1 after the last node
+********************************************/
+static int  inner_step(void* arg)
+{
+    SIMPLIFY* simplify = arg;
+    NODE* node = simplify->position++;
+    int chain = chain_table[node_kind(node)];
+    int distinct = (node->same == node);
+
+    /* the missing operands are the empty node, it is never inner */
+    NODE* lefts[2] = { simplify->ctx->nodes, node->left };
+    NODE* rights[2] = { simplify->ctx->nodes, node->right };
+
+    mark_inner(lefts[node->left != 0], chain, distinct);
+    mark_inner(rights[node->right != 0], chain, distinct);
+
+    return simplify->position == simplify->end;
+}
+
+/********************************************
+* Marks the operand inner if it is of the
+* chain of its user and used once, only the
+* distinct nodes are users
+********************************************/
+static void mark_inner(NODE* operand, int chain, int distinct)
+{
+    operand->inner |= (chain_table[node_kind(operand)] == chain) & (chain != CHAIN_NONE) &
+                      (operand->uses == 1) & distinct;
+}
+
+/********************************************
+* Simplifies the next node of the tree, its
+* operands are simplified before it
+* Returns 1 after the last node
+********************************************/
+static int  simplify_step(void* arg)
+{
+    SIMPLIFY* simplify = arg;
+    NODE* node = simplify->position++;
+    int kind = node_kind(node);
+    int skipped = (node->same != node) | node->inner;
+
+    simplify_call_table[kind + (SIMPLIFY_NOTHING - kind) * skipped](simplify, node);
+
+    return simplify->position == simplify->end;
+}
+
+/********************************************
+* Simplifies the chain of the node: takes its
+* terms, cancels them out and adds up the
+* rest into balanced trees
+********************************************/
+static void simplify_chain(SIMPLIFY* simplify, NODE* node)
+{
+    CONTEXT* ctx = simplify->ctx;
+    NODE** added;
+    NODE** subtracted;
+    size_t added_count;
+    size_t subtracted_count;
+    int absorbed;
+    NODE* results[2];
+
+    simplify->chain = chain_table[node_kind(node)];
+    simplify->terms = 0;
+
+    node->sign = 1;
+    simplify->inner[0] = node;
+    simplify->count = 1;
+
+    iterate(chain_step, simplify);
+
+    /* the neutral constant is left out, and a product with 0 multiplied is 0 */
+    simplify->constants[simplify->chain]->weight = 0;
+    absorbed = (simplify->chain == CHAIN_PRODUCT) & (simplify->constants[0]->weight > 0);
+
+    added = ctx->terms + simplify->terms;
+    simplify->fill = added;
+    added_count = cancel(simplify, 1);
+
+    subtracted = simplify->fill;
+    subtracted_count = cancel(simplify, -1);
+
+    results[0] = combine_call_table[(added_count != 0) + 2 * (subtracted_count != 0)](simplify,
+                     reduce(ctx, added, added_count, CHAIN_OPERATIONS[simplify->chain]),
+                     reduce(ctx, subtracted, subtracted_count, CHAIN_OPERATIONS[simplify->chain]));
+    results[1] = simplify->constants[0];
+
+    node->simple = results[absorbed];
+}
+
+/********************************************
+* Folds the power with 1 or 0
+********************************************/
+static void simplify_power(SIMPLIFY* simplify, NODE* node)
+{
+    NODE* left = node->left->simple;
+    NODE* right = node->right->simple;
+    int one = (left == simplify->constants[1]) | (right == simplify->constants[0]);
+    int same = (right == simplify->constants[1]) & (one ^ 1);
+
+    node->simple = power_call_table[one + 2 * same](simplify, node, left, right);
+}
+
+/********************************************
+* Folds the remainder of 0, the operands are
+* left as they are otherwise: the remainder
+* is not continuous, so a chain computed in
+* another order may change it by a multiple
+* of the divisor, not only in the last bits
+********************************************/
+static void simplify_remainder(SIMPLIFY* simplify, NODE* node)
+{
+    node->simple = remainder_call_table[node->left->simple == simplify->constants[0]](simplify, node,
+                                                                                      node->left, node->right);
+}
+
+/********************************************
+* Leaves the node as it is, it is simplified
+* with its chain, or it is not used, or it is
+* an operand
+********************************************/
+static void simplify_nothing(SIMPLIFY* simplify, NODE* node)
+{
+}
+
+/********************************************
+* Makes the operation of the node with the
+* simplified operands
+********************************************/
+static NODE* fold_rebuild(SIMPLIFY* simplify, const NODE* node, NODE* left, NODE* right)
+{
+    return make_operation(simplify->ctx, node->operation, left, right);
+}
+
+/********************************************
+* Folds the operation into its left operand
+********************************************/
+static NODE* fold_left(SIMPLIFY* simplify, const NODE* node, NODE* left, NODE* right)
+{
+    return left;
+}
+
+/********************************************
+* Folds the operation into 0
+********************************************/
+static NODE* fold_zero(SIMPLIFY* simplify, const NODE* node, NODE* left, NODE* right)
+{
+    return simplify->constants[0];
+}
+
+/********************************************
+* Folds the operation into 1
+********************************************/
+static NODE* fold_one(SIMPLIFY* simplify, const NODE* node, NODE* left, NODE* right)
+{
+    return simplify->constants[1];
+}
+
+/********************************************
+* Takes the operands of the next pending
+* operation of the chain, the right one
+* first, so the terms are taken in reverse
+* order of the expression
+* Returns 1 when no operation is pending
+********************************************/
+static int  chain_step(void* arg)
+{
+    SIMPLIFY* simplify = arg;
+    NODE* node = simplify->inner[--simplify->count];
+    int kind = node_kind(node);
+    int missing = (node->right == 0);
+    NODE* rights[2] = { node->right, simplify->ctx->nodes };
+    NODE* right = rights[missing];
+
+    chain_call_table[right->inner + (CHAIN_MISSING - right->inner) * missing](simplify, right,
+                                                                             node->sign * right_signs[kind]);
+    chain_call_table[node->left->inner](simplify, node->left, node->sign * left_signs[kind]);
+
+    return simplify->count == 0;
+}
+
+/********************************************
+* Takes the simplified operand as a term of
+* the chain
+********************************************/
+static void chain_term(SIMPLIFY* simplify, NODE* operand, int sign)
+{
+    NODE* term = operand->simple;
+
+    term->weight += sign;
+    simplify->ctx->terms[simplify->terms++] = term;
+}
+
+/********************************************
+* Leaves the inner operation pending with its
+* sign in the chain
+********************************************/
+static void chain_inner(SIMPLIFY* simplify, NODE* operand, int sign)
+{
+    operand->sign = sign;
+    simplify->inner[simplify->count++] = operand;
+}
+
+/********************************************
+* Takes nothing, the unary minus has no right
+* operand
+********************************************/
+static void chain_missing(SIMPLIFY* simplify, NODE* operand, int sign)
+{
+}
+
+/********************************************
+* Takes every term of the given polarity as
+* many times as its weight is, in order of
+* the expression, so the weight left of the
+* term is of the other polarity
+* Returns the number of the terms taken
+********************************************/
+static size_t cancel(SIMPLIFY* simplify, long polarity)
+{
+    NODE** first = simplify->fill;
+
+    simplify->polarity = polarity;
+    simplify->index = simplify->terms;
+
+    iterate(cancel_step, simplify);
+
+    return (size_t)(simplify->fill - first);
+}
+
+/********************************************
+* Takes the copies of the next term, all of
+* them go with its first place
+* Returns 1 after the first term
+********************************************/
+static int  cancel_step(void* arg)
+{
+    SIMPLIFY* simplify = arg;
+    long weight;
+
+    simplify->term = simplify->ctx->terms[--simplify->index];
+    weight = simplify->term->weight * simplify->polarity;
+
+    /* take the weight if it is of the polarity */
+    simplify->copies = weight & -(long)(weight > 0);
+    simplify->term->weight -= simplify->copies * simplify->polarity;
+
+    fill_call_table[simplify->copies != 0](simplify);
+
+    return simplify->index == 0;
+}
+
+/********************************************
+* Takes the copies of the term
+********************************************/
+static void fill_copies(SIMPLIFY* simplify)
+{
+    iterate(fill_step, simplify);
+}
+
+/********************************************
+* Takes no copies, the term cancels out or is
+* of the other polarity
+********************************************/
+static void fill_nothing(SIMPLIFY* simplify)
+{
+}
+
+/********************************************
+* Takes the next copy of the term
+* Returns 1 after the last copy
+********************************************/
+static int  fill_step(void* arg)
+{
+    SIMPLIFY* simplify = arg;
+
+    *simplify->fill++ = simplify->term;
+
+    return --simplify->copies == 0;
+}
+
+/********************************************
+* Adds up the terms into a balanced tree of
+* the operation, the terms are overwritten
+* Returns the tree, or 0 for no terms
+********************************************/
+static NODE* reduce(CONTEXT* ctx, NODE** terms, size_t count, char operation)
+{
+    REDUCE reduce;
+    NODE* results[2];
+
+    reduce.ctx = ctx;
+    reduce.terms = terms;
+    reduce.count = count;
+    reduce.operation = operation;
+
+    reduce_call_table[count > 1](&reduce);
+
+    results[0] = 0;
+    results[1] = terms[0];
+
+    return results[count != 0];
+}
+
+/********************************************
+* Adds up the terms level by level
+********************************************/
+static void reduce_levels(REDUCE* reduce)
+{
+    iterate(level_step, reduce);
+}
+
+/********************************************
+* Leaves the single term as it is, or no term
+********************************************/
+static void reduce_nothing(REDUCE* reduce)
+{
+}
+
+/********************************************
+* Adds up the terms of the level by pairs,
+* the odd one goes to the next level as is
+* Returns 1 when a single term is left
+********************************************/
+static int  level_step(void* arg)
+{
+    REDUCE* reduce = arg;
+
+    reduce->pair = 0;
+
+    iterate(pair_step, reduce);
+
+    /* with an even number of terms the last one goes after the next level */
+    reduce->terms[reduce->count / 2] = reduce->terms[reduce->count - 1];
+    reduce->count = (reduce->count + 1) / 2;
+
+    return reduce->count == 1;
+}
+
+/********************************************
+* Adds up the next pair of terms
+* Returns 1 after the last pair
+********************************************/
+static int  pair_step(void* arg)
+{
+    REDUCE* reduce = arg;
+    NODE** pair = reduce->terms + reduce->pair * 2;
+
+    reduce->terms[reduce->pair] = make_operation(reduce->ctx, reduce->operation, pair[0], pair[1]);
+    ++reduce->pair;
+
+    return reduce->pair == reduce->count / 2;
+}
+
+/********************************************
+* Makes the chain with no terms left, 0 for
+* a sum, 1 for a product
+********************************************/
+static NODE* combine_neutral(SIMPLIFY* simplify, NODE* added, NODE* subtracted)
+{
+    return simplify->constants[simplify->chain];
+}
+
+/********************************************
+* Makes the chain with nothing subtracted
+********************************************/
+static NODE* combine_added(SIMPLIFY* simplify, NODE* added, NODE* subtracted)
+{
+    return added;
+}
+
+/********************************************
+* Makes the chain with nothing added: ~N for
+* a sum, 1/N for a product
+********************************************/
+static NODE* combine_subtracted(SIMPLIFY* simplify, NODE* added, NODE* subtracted)
+{
+    NODE* lefts[2] = { subtracted, simplify->constants[1] };
+    NODE* rights[2] = { 0, subtracted };
+
+    return make_operation(simplify->ctx, CHAIN_NEGATIONS[simplify->chain],
+                          lefts[simplify->chain], rights[simplify->chain]);
+}
+
+/********************************************
+* Makes the chain of both: P-N or P/N
+********************************************/
+static NODE* combine_both(SIMPLIFY* simplify, NODE* added, NODE* subtracted)
+{
+    return make_operation(simplify->ctx, CHAIN_INVERSES[simplify->chain], added, subtracted);
+}
+
+/********************************************
+* Resets the uses and the slot of the next
+* node of the arena
+* Returns 1 after the last node
+********************************************/
+static int  reset_step(void* arg)
+{
+    SIMPLIFY* simplify = arg;
+    NODE* node = simplify->position++;
+
+    node->uses = 0;
+    node->slot = 0;
+
+    return simplify->position == simplify->end;
+}
+
+/********************************************
+* Counts the uses of the operands of the next
+* node of the simplified tree, a node is
+* pending once, at its first use
+* Returns 1 when no node is pending
+********************************************/
+static int  count_step(void* arg)
+{
+    SIMPLIFY* simplify = arg;
+    NODE* node = simplify->inner[--simplify->count];
+
+    /* the uses of missing operands go to the empty node, it never gets a slot */
+    NODE* lefts[2] = { simplify->ctx->nodes, node->left };
+    NODE* rights[2] = { simplify->ctx->nodes, node->right };
+
+    count_use(simplify, lefts[node->left != 0]);
+    count_use(simplify, rights[node->right != 0]);
+
+    return simplify->count == 0;
+}
+
+/********************************************
+* Counts a use of the node, an operation used
+* the second time gets a slot
+********************************************/
+static void count_use(SIMPLIFY* simplify, NODE* node)
+{
+    CONTEXT* ctx = simplify->ctx;
+    int shared = (++node->uses == 2) & (node->arity != 0);
+
+    ctx->slots += shared;
+    node->slot += ctx->slots * shared;
+
+    simplify->inner[simplify->count] = node;
+    simplify->count += (node->uses == 1);
+}
+
+/********************************************
+* Prints the next pending node
+* Returns 1 when there is nothing to print
+********************************************/
+static int  postfix_step(void* arg)
+{
+    POSTFIX* postfix = arg;
+    const NODE* node = postfix->pending[--postfix->count];
+
+    postfix_call_table[node->arity](postfix, node);
+
+    return postfix->count == 0;
+}
+
+/********************************************
+* Prints an operand, the tokens of the
+* tokenizer mode are separated by spaces, a
+* missing operand is printed as nothing
+********************************************/
+static void postfix_operand(POSTFIX* postfix, const NODE* node)
+{
+    int printed = (node->length != 0);
+
+    output_string(postfix->output, " ", postfix->spaced & printed);
+    output_string(postfix->output, node->token, node->length);
+
+    postfix->spaced |= postfix->tokens & printed;
+}
+
+/********************************************
+* Leaves the operation pending until its
+* operands are printed, the left one first
+********************************************/
+static void postfix_operation(POSTFIX* postfix, const NODE* node)
+{
+    int binary = node->arity - 1;
+
+    /* the left operand is printed first, so it is pushed last, and the */
+    /* right one of the unary minus is overwritten by the left one      */
+    postfix->pending[postfix->count++] = node;
+    postfix->pending[postfix->count++] = &postfix_mark;
+    postfix->pending[postfix->count] = node->right;
+    postfix->count += binary;
+    postfix->pending[postfix->count++] = node->left;
+}
+
+/********************************************
+* Prints the operation below the mark, its
+* operands are printed
+********************************************/
+static void postfix_computed(POSTFIX* postfix, const NODE* mark)
+{
+    const NODE* node = postfix->pending[--postfix->count];
+
+    output_string(postfix->output, " ", postfix->spaced);
+    output_char(postfix->output, node->operation);
+
+    postfix->spaced = postfix->tokens;
+}
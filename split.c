@@ -0,0 +1,585 @@
+/*============================================================================================
+* Parallel conversion of a long expression split at its top level
+*
+* At the top level, outside of all the brackets, + and - bind the loosest and are left
+* associative: every binary + or - there pops all the operations before it, the one before
+* it too, so the postfix form of a+b*c-d is the one of a+b*c followed by the one of d and
+* the '-'. The conversion of the rest after a top-level + or - depends on nothing before
+* it but the value left by the part before it, so it can start as if an operand were just
+* converted: for a+b*c-d+e the conversion of a+b*c gives abc*+, the one of -d+e after an
+* operand gives d-e+, and the whole is abc*+d-e+.
+*
+* The expression is cut into parts of the same size, one per thread. Every thread counts
+* the brackets of its part by words, then adds up the depths of the parts before it, so it
+* knows the depth at every byte of its part and finds the first binary + or - at depth 0
+* in it, the one after an operand or ')'. The run of the thread goes from there to the
+* first one found by the threads after it; the thread converts its run with its own
+* operator stack, and the outputs of the runs are written one after another.
+*
+* An error in any run, or a '\0' in the expression, and the expression is converted again
+* by a single thread, so the error and its offset are the ones of convert(). So it is if
+* a thread cannot be started: the threads wait until all of them are, and exit at once
+* if any of them is not.
+*
+* Copyright 2006-2016 Mikhail Durnev (mdurnev@gmail.com). Released under the GPLv3
+============================================================================================*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "acyclomatic.h"
+
+
+/* counters of the threads, added to the ones of the context with -DACYCLOMATIC_STATS */
+#ifdef ACYCLOMATIC_STATS
+#define STATS_MERGE(into, ctx) add_stats(&(into)->stats, &(ctx)->stats)
+#else
+#define STATS_MERGE(into, ctx) ((void)0)
+#endif
+
+/* data types */
+typedef struct SPLIT SPLIT;
+typedef struct PART PART;
+
+/* function prototypes */
+static void split_parts(SPLIT* split);
+static void split_whole(SPLIT* split);
+static void split_join(SPLIT* split);
+static int  part_init_step(void* arg);
+static int  part_create_step(void* arg);
+static int  part_join_step(void* arg);
+static int  part_check_step(void* arg);
+static int  part_write_step(void* arg);
+static int  part_free_step(void* arg);
+static void* part_main(void* arg);
+static void part_run(PART* part);
+static void part_join(PART* part);
+static int  count_step(void* arg);
+static int  count_bytes(uint64_t word, unsigned char byte);
+static int  level_step(void* arg);
+static int  find_step(void* arg);
+static int  operand_end(unsigned char c, int tokens);
+static int  run_end_step(void* arg);
+static void run_convert(PART* part);
+static void run_nothing(PART* part);
+
+/* data types */
+typedef void (*SPLIT_ACTION)(SPLIT* split);
+typedef void (*PART_ACTION)(PART* part);
+
+/* state of the conversion of the expression */
+struct SPLIT
+{
+    CONTEXT* ctx;           /* the context of the expression, its modes are the ones */
+                            /* of the threads                                        */
+    const char* in;
+    size_t len;
+    OUTPUT* out;
+    PART* parts;            /* parts of the expression, one per thread */
+    size_t count;
+    size_t index;           /* next part to go over */
+    size_t started;         /* parts whose threads are started */
+    int ok;                 /* 1 while all the runs are converted with no error */
+    int printed;            /* 1 once a run printed anything */
+    pthread_barrier_t counted;  /* the threads have counted the brackets of their parts */
+    pthread_barrier_t found;    /* the threads have found the start of their runs */
+    pthread_mutex_t gate;       /* held until all the threads are started or one fails */
+};
+
+/* part of the expression converted by a thread */
+struct PART
+{
+    pthread_t thread;
+    SPLIT* split;
+    size_t index;           /* number of the part */
+    const char* begin;      /* bytes of the part */
+    const char* end;
+    const char* position;   /* next byte or word to look at */
+    long depth;             /* brackets opened in the part less the ones closed */
+    long level;             /* depth of brackets at the position */
+    int after;              /* 1 after an operand or ')', so '-' is binary */
+    int zero;               /* 1 if the part has a '\0' */
+    int found;              /* 1 if the part has a binary + or - at depth 0 */
+    const char* run;        /* the first of them, the run of the thread starts there */
+    const char* run_end;    /* the run of the next thread that has one, or the end */
+    size_t next;            /* next part looked at for the end of the run */
+    CONTEXT ctx;            /* operator stack of the thread */
+    OUTPUT output;          /* output of the run */
+    int status;             /* status of the conversion of the run */
+};
+
+
+/* function arrays */
+
+/* split call table, indexed by the expression being split into parts */
+static const SPLIT_ACTION split_call_table[] =
+{
+    split_whole,
+    split_parts
+};
+
+/* output call table, indexed by all the runs converted with no error */
+static const SPLIT_ACTION join_call_table[] =
+{
+    split_whole,
+    split_join
+};
+
+/* thread call table, indexed by all the threads being started */
+static const PART_ACTION thread_call_table[] =
+{
+    run_nothing,
+    part_run
+};
+
+/* join call table, indexed by the thread of the part being started */
+static const PART_ACTION started_call_table[] =
+{
+    run_nothing,
+    part_join
+};
+
+/* run call table, indexed by the part having a run */
+static const PART_ACTION run_call_table[] =
+{
+    run_nothing,
+    run_convert
+};
+
+
+/* constants */
+
+/* bytes looked at at once for the brackets */
+#define SPLIT_WORD sizeof(uint64_t)
+
+/* the bytes of a word after the end of a part, neither a bracket nor '\0' */
+#define SPLIT_FILLER 0x6161616161616161ull
+
+/* every byte of a word */
+#define BYTES_ONES 0x0101010101010101ull
+#define BYTES_LOW 0x7F7F7F7F7F7F7F7Full
+
+/* size of the output of a run before it grows */
+#define RUN_OUTPUT_SIZE (1 << 16)
+
+
+
+/********************************************
+* Converts the expression by ctx->split
+* threads, or by this one if the mode of the
+* context has no postfix form to join
+********************************************/
+int  convert_split(CONTEXT* ctx, const char* in, size_t len, OUTPUT* out)
+{
+    SPLIT split;
+
+    /* a part has a byte at least, the tree, the packed records, the emit hook */
+    /* and the checkpoints need the whole expression in one conversion        */
+    size_t count = ctx->split ^ ((ctx->split ^ len) & -(size_t)(len < (size_t)ctx->split));
+    int parted = (count > 1) & (ctx->split > 1) & (ctx->tree ^ 1) & (ctx->packed ^ 1) &
+                 (ctx->emit == 0) & (ctx->checkpoint == 0);
+
+    split.ctx = ctx;
+    split.in = in;
+    split.len = len;
+    split.out = out;
+    split.count = count;
+
+    split_call_table[parted](&split);
+
+    return ctx->status;
+}
+
+/********************************************
+* Converts the parts by their threads, then
+* writes the outputs of the runs one after
+* another, or converts the whole expression
+* on error or if a thread cannot be started
+********************************************/
+static void split_parts(SPLIT* split)
+{
+    split->parts = calloc(split->count, sizeof(PART));
+    check_allocation(split->parts);
+    split->started = 0;
+
+    pthread_barrier_init(&split->counted, 0, split->count);
+    pthread_barrier_init(&split->found, 0, split->count);
+    pthread_mutex_init(&split->gate, 0);
+
+    split->index = 0;
+    iterate(part_init_step, split);
+
+    /* the barriers count all the threads, so the threads wait at the gate until all */
+    /* of them are started, or exit at once if one of them cannot be started        */
+    pthread_mutex_lock(&split->gate);
+    split->index = 0;
+    iterate(part_create_step, split);
+    pthread_mutex_unlock(&split->gate);
+
+    split->index = 0;
+    iterate(part_join_step, split);
+
+    split->ok = (split->started == split->count);
+    split->index = 0;
+    iterate(part_check_step, split);
+
+    join_call_table[split->ok](split);
+
+    split->index = 0;
+    iterate(part_free_step, split);
+
+    pthread_barrier_destroy(&split->counted);
+    pthread_barrier_destroy(&split->found);
+    pthread_mutex_destroy(&split->gate);
+    free(split->parts);
+}
+
+/********************************************
+* Converts the whole expression by this
+* thread
+********************************************/
+static void split_whole(SPLIT* split)
+{
+    /* the state at the beginning of the expression */
+    CHECKPOINT start = { 0, 0, "", 0, 0, 0, 0, 0 };
+
+    convert_resume(split->ctx, split->in, split->len, &start, split->out);
+}
+
+/********************************************
+* Writes the outputs of the runs, as the
+* conversion of the whole expression would
+********************************************/
+static void split_join(SPLIT* split)
+{
+    CONTEXT* ctx = split->ctx;
+
+    split->out->mark = split->out->length;
+    split->printed = 0;
+
+    split->index = 0;
+    iterate(part_write_step, split);
+
+    output_char(split->out, '\n');
+
+    ctx->status = STATUS_OK;
+    ctx->error_offset = 0;
+    ctx->root = 0;
+}
+
+/********************************************
+* Sets up the next part, the last one takes
+* the rest of the expression
+* Returns 1 after the last part
+********************************************/
+static int  part_init_step(void* arg)
+{
+    SPLIT* split = arg;
+    PART* part = split->parts + split->index;
+    size_t size = split->len / split->count;
+    int last = (split->index == split->count - 1);
+
+    part->split = split;
+    part->index = split->index;
+    part->begin = split->in + size * split->index;
+    part->end = part->begin + size + (split->len - size * split->count) * last;
+
+    init_context(&part->ctx);
+    part->ctx.engine = split->ctx->engine;
+    part->ctx.tokens = split->ctx->tokens;
+    init_memory_output(&part->output, RUN_OUTPUT_SIZE);
+
+    ++split->index;
+
+    return split->index >= split->count;
+}
+
+/********************************************
+* Starts the thread of the next part
+* Returns 1 after the last part, or if the
+* thread cannot be started
+********************************************/
+static int  part_create_step(void* arg)
+{
+    SPLIT* split = arg;
+    PART* part = split->parts + split->index;
+
+    split->started += (pthread_create(&part->thread, 0, part_main, part) == 0);
+    ++split->index;
+
+    return (split->started < split->index) | (split->index >= split->count);
+}
+
+/********************************************
+* Waits for the thread of the next part if
+* it is started
+* Returns 1 after the last part
+********************************************/
+static int  part_join_step(void* arg)
+{
+    SPLIT* split = arg;
+
+    started_call_table[split->index < split->started](split->parts + split->index);
+
+    ++split->index;
+
+    return split->index >= split->count;
+}
+
+/********************************************
+* Waits for the thread of the part
+********************************************/
+static void part_join(PART* part)
+{
+    pthread_join(part->thread, 0);
+}
+
+/********************************************
+* Checks the run of the next part, a '\0'
+* ends the expression earlier, so it is not
+* what the runs converted
+* Returns 1 after the last part
+********************************************/
+static int  part_check_step(void* arg)
+{
+    SPLIT* split = arg;
+    PART* part = split->parts + split->index;
+
+    split->ok &= (part->status == STATUS_OK) & (part->zero ^ 1);
+
+    ++split->index;
+
+    return split->index >= split->count;
+}
+
+/********************************************
+* Writes the output of the run of the next
+* part without its newline, in the tokenizer
+* mode with a space before it if anything
+* was printed before
+* Returns 1 after the last part
+********************************************/
+static int  part_write_step(void* arg)
+{
+    SPLIT* split = arg;
+    PART* part = split->parts + split->index;
+
+    /* a part with no run has no output */
+    size_t length = (part->output.length - 1) * part->found;
+    int printed = (length != 0);
+
+    output_string(split->out, " ", split->ctx->tokens & split->printed & printed);
+    output_string(split->out, part->output.buffer, length);
+    split->printed |= printed;
+
+    ++split->index;
+
+    return split->index >= split->count;
+}
+
+/********************************************
+* Deallocates the next part, its counters
+* are added to the ones of the context
+* Returns 1 after the last part
+********************************************/
+static int  part_free_step(void* arg)
+{
+    SPLIT* split = arg;
+    PART* part = split->parts + split->index;
+
+    STATS_MERGE(split->ctx, &part->ctx);
+
+    free_context(&part->ctx);
+    free_memory_output(&part->output);
+
+    ++split->index;
+
+    return split->index >= split->count;
+}
+
+/********************************************
+* Thread of a part: waits until all the
+* threads are started and converts the part,
+* or exits if any of them cannot be started
+********************************************/
+static void* part_main(void* arg)
+{
+    PART* part = arg;
+    SPLIT* split = part->split;
+
+    pthread_mutex_lock(&split->gate);
+    pthread_mutex_unlock(&split->gate);
+
+    thread_call_table[split->started == split->count](part);
+
+    return 0;
+}
+
+/********************************************
+* Counts the brackets of the part, finds the
+* start of its run, then the end and
+* converts it
+********************************************/
+static void part_run(PART* part)
+{
+    SPLIT* split = part->split;
+
+    part->position = part->begin;
+    part->depth = 0;
+    part->zero = 0;
+    iterate(count_step, part);
+
+    pthread_barrier_wait(&split->counted);
+
+    /* the depth at the beginning of the part is the one of the parts before it */
+    part->level = 0;
+    part->next = 0;
+    iterate(level_step, part);
+
+    /* the first part is the run from the beginning of the expression, the */
+    /* rest look at the byte before them for the end of an operand          */
+    part->position = part->begin;
+    part->after = operand_end(part->begin[-(part->index != 0)], split->ctx->tokens) & (part->index != 0);
+    part->found = 0;
+    part->run = part->end;
+    iterate(find_step, part);
+
+    part->found |= (part->index == 0);
+    part->run += (split->in - part->run) * (part->index == 0);
+
+    pthread_barrier_wait(&split->found);
+
+    part->run_end = split->in + split->len;
+    part->next = split->count;
+    iterate(run_end_step, part);
+
+    part->status = STATUS_OK;
+    run_call_table[part->found](part);
+}
+
+/********************************************
+* Counts the brackets and the zeros of the
+* next word of the part, the last word may
+* be shorter
+* Returns 1 at the end of the part
+********************************************/
+static int  count_step(void* arg)
+{
+    PART* part = arg;
+    size_t left = part->end - part->position;
+
+    /* take the minimum of left and the word */
+    size_t count = left ^ ((left ^ SPLIT_WORD) & -(size_t)(SPLIT_WORD < left));
+    uint64_t word = SPLIT_FILLER;
+
+    memcpy(&word, part->position, count);
+
+    part->depth += count_bytes(word, '(') - count_bytes(word, ')');
+    part->zero |= (count_bytes(word, 0) != 0);
+    part->position += count;
+
+    return part->position == part->end;
+}
+
+/********************************************
+* Returns the number of the bytes of the
+* word that are the given byte
+********************************************/
+static int  count_bytes(uint64_t word, unsigned char byte)
+{
+    uint64_t x = word ^ (BYTES_ONES * byte);
+
+    /* the high bit of every byte that is zero, with no carry between the bytes */
+    uint64_t zeros = ~(((x & BYTES_LOW) + BYTES_LOW) | x | BYTES_LOW);
+
+    return __builtin_popcountll(zeros);
+}
+
+/********************************************
+* Adds the depth of the next part before this
+* one to the level of this one
+* Returns 1 at this part
+********************************************/
+static int  level_step(void* arg)
+{
+    PART* part = arg;
+    int before = (part->next < part->index);
+
+    part->level += part->split->parts[part->next].depth * before;
+    ++part->next;
+
+    return part->next >= part->index;
+}
+
+/********************************************
+* Looks at the next byte of the part for a
+* binary + or - at depth 0
+* Returns 1 when it is found or at the end of
+* the part
+********************************************/
+static int  find_step(void* arg)
+{
+    PART* part = arg;
+    unsigned char c = *part->position;
+    int binary = (check_interval(c, '+', '+') | check_interval(c, '-', '-')) & part->after & (part->level == 0);
+
+    part->run += (part->position - part->run) * binary;
+    part->found |= binary;
+    part->level += check_interval(c, '(', '(') - check_interval(c, ')', ')');
+    part->after = operand_end(c, part->split->ctx->tokens);
+
+    ++part->position;
+
+    return binary | (part->position == part->end);
+}
+
+/********************************************
+* Returns 1 if the byte is the last one of an
+* operand or ')', so a '-' after it is binary
+********************************************/
+static int  operand_end(unsigned char c, int tokens)
+{
+    int digit = check_interval(c, '0', '9') | check_interval(c, '_', '_') | check_interval(c, '.', '.');
+
+    return check_interval(c, 'a', 'z') | check_interval(c, ')', ')') | (tokens & digit);
+}
+
+/********************************************
+* Looks at the part before the last one
+* looked at, from the last part down: the run
+* ends where the nearest run after it starts
+* Returns 1 at this part
+********************************************/
+static int  run_end_step(void* arg)
+{
+    PART* part = arg;
+    const PART* next;
+
+    --part->next;
+    next = part->split->parts + part->next;
+
+    part->run_end += (next->run - part->run_end) * (next->found & (part->next > part->index));
+
+    return part->next <= part->index + 1;
+}
+
+/********************************************
+* Converts the run of the part, the runs
+* after the first one start at a binary
+* operation as if an operand were before it
+********************************************/
+static void run_convert(PART* part)
+{
+    CHECKPOINT starts[2] = { { 0, 0, "", 0, 0, 0, 0, 0 }, { 0, 0, "", 0, 0, 0, 1, 0 } };
+
+    part->status = convert_resume(&part->ctx, part->run, part->run_end - part->run, &starts[part->index != 0],
+                                  &part->output);
+}
+
+/********************************************
+* Just a dummy function
+********************************************/
+static void run_nothing(PART* part)
+{
+}
@@ -0,0 +1,218 @@
+/*============================================================================================
+* Counters of the conversions, built with -DACYCLOMATIC_STATS only
+*
+* Every context counts the calls of the handlers of the global call table, the pops that
+* print an operation and the ones that do not, the largest depth of the operator stack
+* and the clock ticks of every conversion: rdtsc on x86, the virtual counter on AArch64
+* and nanoseconds elsewhere. Without the flag the counters and the hooks that update
+* them are compiled out, and so is this file.
+*
+* Copyright 2006-2016 Mikhail Durnev (mdurnev@gmail.com). Released under the GPLv3
+============================================================================================*/
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "acyclomatic.h"
+
+#ifdef ACYCLOMATIC_STATS
+
+/* data types */
+typedef struct SUM SUM;
+typedef struct BUCKETS BUCKETS;
+
+/* function prototypes */
+static int  sum_step(void* arg);
+static int  bucket_step(void* arg);
+
+/* state of adding up the counters */
+struct SUM
+{
+    uint64_t* total;        /* next counter of the total */
+    const uint64_t* add;    /* next counter added to it */
+    size_t left;            /* number of counters left */
+};
+
+/* state of writing the histogram */
+struct BUCKETS
+{
+    OUTPUT* output;
+    const uint64_t* histogram;
+    size_t index;           /* next bucket */
+};
+
+
+/* constants */
+
+/* number of the counters added up, from handlers to histogram */
+#define STATS_SUMMED ((offsetof(STATS, max_cycles) - offsetof(STATS, handlers)) / sizeof(uint64_t))
+
+/* size of the buffer of the JSON line */
+#define STATS_BUFFER_SIZE 1024
+
+#if defined(__x86_64__) || defined(__i386__)
+#define STATS_CLOCK "rdtsc"
+#elif defined(__aarch64__)
+#define STATS_CLOCK "cntvct"
+#else
+#define STATS_CLOCK "ns"
+#endif
+
+
+/* function arrays */
+
+/* separators of the buckets, indexed by the bucket being the first one */
+static const char* const bucket_separators[] =
+{
+    ",",
+    ""
+};
+
+
+
+/********************************************
+* Resets the counters
+********************************************/
+void init_stats(STATS* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+/********************************************
+* Returns the clock in ticks
+********************************************/
+uint64_t stats_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(ticks));
+
+    return ticks;
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+#endif
+}
+
+/********************************************
+* Counts a conversion of the given number of
+* ticks
+********************************************/
+void stats_expression(STATS* stats, uint64_t cycles)
+{
+    /* log2 of the ticks, the longer conversions go to the last bucket */
+    uint64_t bucket = 63 - __builtin_clzll(cycles | 1);
+
+    bucket ^= (bucket ^ (STATS_BUCKETS - 1)) & -(uint64_t)(bucket > STATS_BUCKETS - 1);
+
+    ++stats->expressions;
+    stats->cycles += cycles;
+    ++stats->histogram[bucket];
+    stats->max_cycles ^= (stats->max_cycles ^ cycles) & -(uint64_t)(cycles > stats->max_cycles);
+}
+
+/********************************************
+* Adds the counters to the total, the maximums
+* are the largest of both
+********************************************/
+void add_stats(STATS* total, const STATS* stats)
+{
+    SUM sum;
+
+    sum.total = total->handlers;
+    sum.add = stats->handlers;
+    sum.left = STATS_SUMMED;
+
+    iterate(sum_step, &sum);
+
+    total->max_cycles ^= (total->max_cycles ^ stats->max_cycles) & -(uint64_t)(stats->max_cycles > total->max_cycles);
+    total->max_stack ^= (total->max_stack ^ stats->max_stack) & -(uint64_t)(stats->max_stack > total->max_stack);
+}
+
+/********************************************
+* Writes the counters to the file descriptor
+* as a line of JSON
+********************************************/
+void write_stats(const STATS* stats, int fd)
+{
+    char buffer[STATS_BUFFER_SIZE];
+    char line[STATS_BUFFER_SIZE];
+    OUTPUT output;
+    BUCKETS buckets;
+    int length;
+    const uint64_t* h = stats->handlers;
+
+    init_output(&output, buffer, sizeof(buffer), fd);
+
+    length = snprintf(line, sizeof(line),
+                      "{\"clock\": \"%s\", \"expressions\": %llu, \"handlers\": {\"error\": %llu, "
+                      "\"end\": %llu, \"symbol\": %llu, \"operator\": %llu, \"open_bracket\": %llu, "
+                      "\"close_bracket\": %llu, \"number\": %llu, \"dot\": %llu, \"finished\": %llu}, "
+                      "\"prints\": {\"print_nothing\": %llu, \"print_char\": %llu}, "
+                      "\"max_stack\": %llu, \"cycles\": {\"total\": %llu, \"max\": %llu, \"mean\": %llu, "
+                      "\"log2_histogram\": [",
+                      STATS_CLOCK, (unsigned long long)stats->expressions,
+                      (unsigned long long)h[0], (unsigned long long)h[1], (unsigned long long)h[2],
+                      (unsigned long long)h[3], (unsigned long long)h[4], (unsigned long long)h[5],
+                      (unsigned long long)h[6], (unsigned long long)h[7], (unsigned long long)h[8],
+                      (unsigned long long)stats->prints[0], (unsigned long long)stats->prints[1],
+                      (unsigned long long)stats->max_stack, (unsigned long long)stats->cycles,
+                      (unsigned long long)stats->max_cycles,
+                      (unsigned long long)(stats->cycles / (stats->expressions + (stats->expressions == 0))));
+    output_string(&output, line, length);
+
+    buckets.output = &output;
+    buckets.histogram = stats->histogram;
+    buckets.index = 0;
+
+    iterate(bucket_step, &buckets);
+
+    output_string(&output, "]}}\n", 4);
+    flush_output(&output);
+}
+
+/********************************************
+* Adds the next counter to the total
+* Returns 1 after the last counter
+********************************************/
+static int  sum_step(void* arg)
+{
+    SUM* sum = arg;
+
+    *sum->total += *sum->add;
+
+    ++sum->total;
+    ++sum->add;
+    --sum->left;
+
+    return sum->left == 0;
+}
+
+/********************************************
+* Writes the next bucket of the histogram
+* Returns 1 after the last bucket
+********************************************/
+static int  bucket_step(void* arg)
+{
+    BUCKETS* buckets = arg;
+    char number[32];
+    int length = snprintf(number, sizeof(number), "%s%llu", bucket_separators[buckets->index == 0],
+                          (unsigned long long)buckets->histogram[buckets->index]);
+
+    output_string(buckets->output, number, length);
+    ++buckets->index;
+
+    return buckets->index >= STATS_BUCKETS;
+}
+
+#endif